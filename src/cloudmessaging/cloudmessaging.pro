@@ -1,6 +1,7 @@
 TARGET = QtCloudMessaging
 
 QT = core network
+QT_PRIVATE += websockets
 
 QMAKE_DOCS = $$PWD/doc/qtcloudmessaging.qdocconf
 
@@ -13,12 +14,35 @@ HEADERS += \
     $$PWD/qcloudmessagingclient_p.h \
     $$PWD/qcloudmessagingprovider_p.h \
     $$PWD/qcloudmessagingrestapi_p.h \
-    $$PWD/qcloudmessagingrestapi.h
+    $$PWD/qcloudmessagingrestapi.h \
+    $$PWD/qcloudmessagingoutboundqueue_p.h \
+    $$PWD/qcloudmessagingrestjournal_p.h \
+    $$PWD/qcloudmessagingratelimiter_p.h \
+    $$PWD/qcloudmessagingringbuffer_p.h \
+    $$PWD/qcloudmessaginginboundhistory_p.h \
+    $$PWD/qcloudmessagingproviderworker_p.h \
+    $$PWD/qcloudmessagingloopbackprovider.h \
+    $$PWD/qcloudmessagingloopbackprovider_p.h \
+    $$PWD/qcloudmessagingloopbackclient.h \
+    $$PWD/qcloudmessagingloopbackclient_p.h \
+    $$PWD/qcloudmessagingtokenstore.h \
+    $$PWD/qcloudmessagingtokenstore_p.h \
+    $$PWD/qcloudmessagingdatastream.h \
+    $$PWD/qcloudmessagingdatastream_p.h
 
 SOURCES += \
     $$PWD/qcloudmessaging.cpp \
     $$PWD/qcloudmessagingclient.cpp \
     $$PWD/qcloudmessagingprovider.cpp \
-    $$PWD/qcloudmessagingrestapi.cpp
+    $$PWD/qcloudmessagingrestapi.cpp \
+    $$PWD/qcloudmessagingoutboundqueue.cpp \
+    $$PWD/qcloudmessagingrestjournal.cpp \
+    $$PWD/qcloudmessagingratelimiter.cpp \
+    $$PWD/qcloudmessaginginboundhistory.cpp \
+    $$PWD/qcloudmessagingproviderworker.cpp \
+    $$PWD/qcloudmessagingloopbackprovider.cpp \
+    $$PWD/qcloudmessagingloopbackclient.cpp \
+    $$PWD/qcloudmessagingtokenstore.cpp \
+    $$PWD/qcloudmessagingdatastream.cpp
 
 load(qt_module)
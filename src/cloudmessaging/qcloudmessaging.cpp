@@ -28,6 +28,8 @@
 
 #include "qcloudmessaging.h"
 #include "qcloudmessaging_p.h"
+#include "qcloudmessagingproviderworker_p.h"
+#include "qcloudmessagingprovider_p.h"
 #include <QString>
 
 
@@ -62,6 +64,33 @@
         \endlist
     \endlist
 
+    \section1 Threads
+
+    By default QCloudMessaging and its providers are used from one thread.
+    A provider registered with the \c worker_thread parameter runs on a
+    thread of its own instead, and QCloudMessaging can then be called from
+    any thread:
+
+    \list
+    \li sendMessage only places the message into a lock-free submission
+        queue of the provider and returns. The provider thread sends queued
+        messages in submission order. sendMessage returns false if the queue
+        was full and the message was dropped.
+    \li Other calls to the provider are run in the provider thread, and the
+        caller waits for their result.
+    \li Signals of QCloudMessaging are always emitted in the thread
+        QCloudMessaging lives in. Signals the provider and its clients emit
+        in the provider thread are queued to it.
+    \endlist
+
+    Calls which wait for the provider thread first let it send the messages
+    submitted before them, so each caller sees its calls run in order.
+
+    A provider running in a worker thread must not call QCloudMessaging
+    functions which wait for the same provider.
+
+    Destroying QCloudMessaging deregisters every provider still registered,
+    which removes their clients. Providers themselves are not deleted.
 */
 
 QT_BEGIN_NAMESPACE
@@ -79,9 +108,22 @@ QCloudMessaging::QCloudMessaging(QObject *parent) :
 }
 /*!
  * \brief QCloudMessaging::~QCloudMessaging
+ * Deregisters every provider still registered, as deregisterProvider
+ * does. Their clients are removed, the providers are not deleted.
  */
 QCloudMessaging::~QCloudMessaging()
 {
+    // To verify that all providers and clients are removed
+    // without memory leaks
+    d->m_serviceState = 0;
+
+    QStringList providerIds;
+    {
+        QReadLocker locker(&d->m_lock);
+        providerIds = d->m_cloudProviders.keys();
+    }
+    for (const QString &providerId : qAsConst(providerIds))
+        deregisterProvider(providerId);
 }
 
 /*!
@@ -98,7 +140,16 @@ QCloudMessaging::~QCloudMessaging()
  * server and can have multiple internal and external clients.
  *
  * \param parameters
- * Provider specific parameters in a variant map.
+ * Provider specific parameters in a variant map. Following parameters are
+ * read by QCloudMessaging:
+ * \list
+ * \li \c worker_thread - if true, the provider is moved to a thread of its
+ *     own. Provider must not have a parent. Default is false.
+ * \li \c submission_queue_size - capacity of the submission queue of the
+ *     worker thread. Default is 4096.
+ * \li \c submission_overflow - \c block makes producers wait while the
+ *     submission queue is full. By default the message is dropped.
+ * \endlist
  *
  * \return
  * true if register succeeds, false if fails.
@@ -107,13 +158,28 @@ bool QCloudMessaging::registerProvider(const QString &providerId,
                                        QCloudMessagingProvider *provider,
                                        const QVariantMap &parameters)
 {
-    bool return_value = false;
-    // If this is duplicate service name
-    if (!d->m_cloudProviders.contains(providerId)) {
-        d->m_cloudProviders.insert(providerId, provider);
+    if (!provider)
+        return false;
 
+    QCloudMessagingProviderEntry entry;
+    {
+        QWriteLocker locker(&d->m_lock);
+        // If this is duplicate service name
+        QCloudMessagingProviderEntry &registered = d->m_cloudProviders[providerId];
+        if (registered.provider) {
+            entry = registered;
+            locker.unlock();
+            return entry.call<bool>([&entry]() -> bool {
+                return entry.provider->getServiceState();
+            });
+        }
+
+        registered.provider = provider;
+
+        // Signals emitted in the provider thread are queued to this thread
         connect(provider, &QCloudMessagingProvider::messageReceived,
                 this, &QCloudMessaging::messageReceived);
+        provider->d->m_relays.append(this);
 
         connect(provider, &QCloudMessagingProvider::serviceStateUpdated,
                 this, &QCloudMessaging::serviceStateUpdated);
@@ -124,13 +190,30 @@ bool QCloudMessaging::registerProvider(const QString &providerId,
         connect(provider, &QCloudMessagingProvider::clientTokenReceived,
                 this, &QCloudMessaging::clientTokenReceived);
 
-        return_value = d->m_cloudProviders[providerId]->
-                registerProvider(providerId,parameters);
-    } else {
-        return_value = d->m_cloudProviders[providerId]->getServiceState();
+        // Objects with a parent cannot be moved, such provider runs here.
+        if (parameters.value(QStringLiteral("worker_thread")).toBool()
+                && !provider->parent()
+                && provider->thread() == QThread::currentThread()) {
+            const int queueSize = parameters.value(
+                        QStringLiteral("submission_queue_size"),
+                        int(QCloudMessagingProviderWorker::DefaultQueueSize)).toInt();
+            const QCloudMessagingSubmissionQueue::OverflowPolicy policy =
+                    parameters.value(QStringLiteral("submission_overflow")).toString()
+                        == QLatin1String("block")
+                    ? QCloudMessagingSubmissionQueue::Block
+                    : QCloudMessagingSubmissionQueue::DropNewest;
+
+            // Last producer releasing the worker may run in any thread.
+            registered.worker.reset(new QCloudMessagingProviderWorker(provider, queueSize, policy),
+                                    &QObject::deleteLater);
+            registered.worker->start();
+        }
+        entry = registered;
     }
 
-    return return_value;
+    return entry.call<bool>([&] {
+        return entry.provider->registerProvider(providerId, parameters);
+    });
 }
 
 /*!
@@ -156,13 +239,65 @@ QString QCloudMessaging::connectClient(const QString &providerId,
                                        const QString &clientId,
                                        const QVariantMap &parameters)
 {
-    if (d->m_cloudProviders.contains(providerId))
-        return d->m_cloudProviders[providerId]->connectClient(clientId,
-                                                              parameters);
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider)
+        return entry.call<QString>([&] { return entry.provider->connectClient(clientId, parameters); });
 
     return QString();
 }
 
+/*!
+ * \brief connectClient
+ * Attaches the client into the provider and fills the \a handle, which can
+ * be used to send messages without looking up the provider again.
+ *
+ * \param providerId
+ * \param clientId
+ * \param parameters
+ * \param handle
+ *
+ * \return
+ * return given ClientId when succeeds, empty string if not.
+ */
+QString QCloudMessaging::connectClient(const QString &providerId,
+                                       const QString &clientId,
+                                       const QVariantMap &parameters,
+                                       QCloudMessagingClientHandle *handle)
+{
+    const QString connected = connectClient(providerId, clientId, parameters);
+    if (handle)
+        *handle = connected.isEmpty() ? QCloudMessagingClientHandle()
+                                      : clientHandle(providerId, connected);
+    return connected;
+}
+
+/*!
+ * \brief clientHandle
+ * Looks up the provider and client once, for use with the sendMessage
+ * overload taking a handle.
+ *
+ * \param providerId
+ * \param clientId
+ *
+ * \return
+ * Handle which is invalid if the provider was not found.
+ */
+QCloudMessagingClientHandle QCloudMessaging::clientHandle(const QString &providerId,
+                                                          const QString &clientId)
+{
+    QCloudMessagingClientHandle handle;
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider) {
+        handle.provider = entry.provider;
+        handle.client = entry.call<QCloudMessagingClient *>([&] {
+            return entry.provider->client(clientId);
+        });
+        handle.providerId = providerId;
+        handle.clientId = clientId;
+    }
+    return handle;
+}
+
 /*!
  * \brief sendMessage
  * Sends a message to one single client or or to a subscribed channel
@@ -185,7 +320,8 @@ QString QCloudMessaging::connectClient(const QString &providerId,
  * Channel name if broadcasting the message to channel
  *
  * \return
- * return true when succeeds, false otherwise.
+ * return true when succeeds, false otherwise. For a provider running in a
+ * worker thread, true means that the message was queued for sending.
  */
 bool QCloudMessaging::sendMessage(const QByteArray &msg,
                                   const QString &providerId,
@@ -193,16 +329,77 @@ bool QCloudMessaging::sendMessage(const QByteArray &msg,
                                   const QString &clientToken,
                                   const QString &channel)
 {
+    // The entry keeps the worker alive, submit may wait for room in the
+    // queue and must not hold the registry lock.
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+
+    if (entry.worker)
+        return entry.worker->submit(msg, clientId, clientToken, channel);
 
-    if (d->m_cloudProviders.contains(providerId))
-        return d->m_cloudProviders[providerId]->sendMessage(msg,
-                                                            clientId,
-                                                            clientToken,
-                                                            channel);
+    if (entry.provider)
+        return entry.provider->sendMessage(msg, clientId, clientToken, channel);
 
     return false;
 }
 
+/*!
+ * \brief sendMessage
+ * Sends a message with the client \a handle. Only the provider id and
+ * client id of the handle are used, so the handle can be copied to and
+ * used from any thread.
+ *
+ * \param handle
+ * Handle from connectClient or clientHandle
+ *
+ * \param msg
+ * \param clientToken
+ * \param channel
+ *
+ * \return
+ * return true when succeeds, false otherwise or if the provider is no
+ * longer registered.
+ */
+bool QCloudMessaging::sendMessage(const QCloudMessagingClientHandle &handle,
+                                  const QByteArray &msg,
+                                  const QString &clientToken,
+                                  const QString &channel)
+{
+    // Pointers of the handle are not safe to read from other threads, the
+    // provider is validated in the registry instead.
+    return sendMessage(msg, handle.providerId, handle.clientId, clientToken, channel);
+}
+
+
+/*!
+ * \brief sendMessages
+ * Sends a batch of messages with one provider lookup. Provider can send
+ * the batch as multicast or pipelined requests, otherwise the messages are
+ * sent one by one.
+ *
+ * \param messages
+ * Messages with their client tokens or channels
+ *
+ * \param providerId
+ * Provider identification string that is defined by the user when using
+ * the API
+ *
+ * \param clientId
+ * Mobile or IoT client identification string (defined by user) added for
+ * the provider
+ *
+ * \return
+ * return the amount of messages sent or queued successfully.
+ */
+int QCloudMessaging::sendMessages(const QVector<QCloudMessagingBatchMessage> &messages,
+                                  const QString &providerId,
+                                  const QString &clientId)
+{
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (!entry.provider)
+        return 0;
+
+    return entry.call<int>([&] { return entry.provider->sendMessages(messages, clientId); });
+}
 
 /*!
  * \brief disconnectClient
@@ -223,9 +420,9 @@ void QCloudMessaging::disconnectClient(const QString &providerId,
                                        const QString &clientId,
                                        const QVariantMap &parameters)
 {
-    if (d->m_cloudProviders.contains(providerId))
-        d->m_cloudProviders[providerId]->disconnectClient(clientId,
-                                                          parameters);
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider)
+        entry.run([&] { entry.provider->disconnectClient(clientId, parameters); });
 }
 
 /*!
@@ -243,9 +440,9 @@ void QCloudMessaging::disconnectClient(const QString &providerId,
 void QCloudMessaging::removeClient(const QString &providerId,
                                    const QString &clientId)
 {
-    if (d->m_cloudProviders.contains(providerId))
-        d->m_cloudProviders[providerId]->removeClient(clientId);
-
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider)
+        entry.run([&] { entry.provider->removeClient(clientId); });
 }
 
 /*!
@@ -258,12 +455,25 @@ void QCloudMessaging::removeClient(const QString &providerId,
  */
 void QCloudMessaging::deregisterProvider(const QString &providerId)
 {
-    if (d->m_cloudProviders.contains(providerId)) {
-        disconnect(d->m_cloudProviders[providerId]);
+    QCloudMessagingProviderEntry entry;
+    {
+        QWriteLocker locker(&d->m_lock);
+        entry = d->m_cloudProviders.take(providerId);
+    }
+
+    if (entry.provider) {
+        disconnect(entry.provider);
 
-        d->m_cloudProviders[providerId]->deregisterProvider();
-        d->m_cloudProviders.remove(providerId);
+        // Messages queued before deregistering are still sent. Stopping
+        // waits for producers still queueing and hands the provider back to
+        // this thread, producers holding the worker after this are refused.
+        if (entry.worker)
+            entry.worker->stop();
 
+        entry.run([this, &entry] {
+            entry.provider->d->m_relays.removeAll(this);
+            entry.provider->deregisterProvider();
+        });
     }
 }
 
@@ -282,8 +492,9 @@ void QCloudMessaging::deregisterProvider(const QString &providerId)
  */
 const QStringList QCloudMessaging::localClients(const QString &providerId)
 {
-    if (d->m_cloudProviders.contains(providerId))
-        return d->m_cloudProviders[providerId]->clients()->keys();
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider)
+        return entry.call<QStringList>([&entry] { return entry.provider->clients()->keys(); });
 
     return QStringList();
 }
@@ -304,9 +515,9 @@ const QStringList QCloudMessaging::localClients(const QString &providerId)
  */
 bool QCloudMessaging::requestRemoteClients(const QString &providerId)
 {
-    if (d->m_cloudProviders.contains(providerId)) {
-        return d->m_cloudProviders[providerId]->remoteClients();
-    }
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider)
+        return entry.call<bool>([&entry] { return entry.provider->remoteClients(); });
 
     return false;
 }
@@ -329,8 +540,9 @@ bool QCloudMessaging::requestRemoteClients(const QString &providerId)
 QString QCloudMessaging::clientToken(const QString &providerId,
                                               const QString &clientId)
 {
-    if (d->m_cloudProviders.contains(providerId))
-        return d->m_cloudProviders[providerId]->clientToken(clientId);
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider)
+        return entry.call<QString>([&] { return entry.provider->clientToken(clientId); });
 
     return QString();
 }
@@ -357,9 +569,15 @@ void QCloudMessaging::setClientToken(const QString &providerId,
                                      const QString &clientId,
                                      const QString &token)
 {
-    if (d->m_cloudProviders.contains(providerId))
-        return d->m_cloudProviders[providerId]->
-                client(clientId)->setClientToken(token);
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (!entry.provider)
+        return;
+
+    entry.run([&] {
+        QCloudMessagingClient *client = entry.provider->client(clientId);
+        if (client)
+            client->setClientToken(token);
+    });
 }
 
 /*!
@@ -383,18 +601,17 @@ bool QCloudMessaging::subscribeToChannel(const QString &channel,
                                          const QString &providerId,
                                          const QString &clientId)
 {
-    if (!d->m_cloudProviders.contains(providerId))
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (!entry.provider)
         return false;
 
-    if (!clientId.isEmpty())
-    {
-        return d->m_cloudProviders[providerId]->client(clientId)->
-                                                subscribeToChannel(channel);
-    } else
-    {
-        return d->m_cloudProviders[providerId]->subscribeToChannel(channel,
-                                                                  clientId);
-    }
+    return entry.call<bool>([&] {
+        if (!clientId.isEmpty()) {
+            QCloudMessagingClient *client = entry.provider->client(clientId);
+            return client ? client->subscribeToChannel(channel) : false;
+        }
+        return entry.provider->subscribeToChannel(channel, clientId);
+    });
 }
 
 /*!
@@ -419,18 +636,52 @@ bool QCloudMessaging::unsubscribeFromChannel(const QString &channel,
                                              const QString &providerId,
                                              const QString &clientId)
 {
-    if (!d->m_cloudProviders.contains(providerId))
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (!entry.provider)
         return false;
 
-    if (!clientId.isEmpty())
-    {
-        return d->m_cloudProviders[providerId]->client(clientId)->
-                                                unsubscribeFromChannel(channel);
-    } else
-    {
-        return d->m_cloudProviders[providerId]->unsubscribeFromChannel(channel,
-                                                                      clientId);
-    }
+    return entry.call<bool>([&] {
+        if (!clientId.isEmpty()) {
+            QCloudMessagingClient *client = entry.provider->client(clientId);
+            return client ? client->unsubscribeFromChannel(channel) : false;
+        }
+        return entry.provider->unsubscribeFromChannel(channel, clientId);
+    });
+}
+
+/*!
+ * \brief QCloudMessaging::subscribeToChannels
+ * Subscribing the client to several channels at once. Clients supporting it
+ * register the whole list with the service in one request.
+ *
+ * \param channels
+ * Channel names as string list
+ *
+ * \param providerId
+ * Provider identification string that is defined by the user when using the API
+ *
+ * \param clientId
+ * Mobile or IoT client identification string (defined by user) added for
+ * the provider
+ *
+ * \return
+ * the amount of channels subscribed.
+ */
+int QCloudMessaging::subscribeToChannels(const QStringList &channels,
+                                         const QString &providerId,
+                                         const QString &clientId)
+{
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (!entry.provider)
+        return 0;
+
+    return entry.call<int>([&] {
+        if (!clientId.isEmpty()) {
+            QCloudMessagingClient *client = entry.provider->client(clientId);
+            return client ? client->subscribeToChannels(channels) : 0;
+        }
+        return entry.provider->subscribeToChannels(channels, clientId);
+    });
 }
 
 /*!
@@ -447,8 +698,21 @@ bool QCloudMessaging::unsubscribeFromChannel(const QString &channel,
  */
 void QCloudMessaging::flushMessageQueue(const QString &providerId)
 {
-    if (d->m_cloudProviders.contains(providerId))
-        d->m_cloudProviders[providerId]->flushMessageQueue();
+    const QCloudMessagingProviderEntry entry = d->entry(providerId);
+    if (entry.provider)
+        entry.run([&entry] { entry.provider->flushMessageQueue(); });
+}
+
+/*!
+ * \brief isMessageReceivedObserved
+ * Private function, called by providers to check whether messageReceived
+ * has receivers. Safe to call from the provider thread.
+ *
+ * \return
+ */
+bool QCloudMessaging::isMessageReceivedObserved()
+{
+    return receivers(SIGNAL(messageReceived(QString,QString,QByteArray))) > 0;
 }
 
 // Signals documentation
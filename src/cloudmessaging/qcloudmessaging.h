@@ -66,6 +66,14 @@ public:
                                       const QVariantMap &parameters =
                                                         QVariantMap());
 
+    QString connectClient(const QString &providerId,
+                          const QString &clientId,
+                          const QVariantMap &parameters,
+                          QCloudMessagingClientHandle *handle);
+
+    QCloudMessagingClientHandle clientHandle(const QString &providerId,
+                                             const QString &clientId);
+
     Q_INVOKABLE void disconnectClient(const QString &providerId,
                                       const QString &clientId,
                                       const QVariantMap &parameters =
@@ -91,6 +99,15 @@ public:
                                  const QString &clientToken = QString(),
                                  const QString &channel = QString()) ;
 
+    bool sendMessage(const QCloudMessagingClientHandle &handle,
+                     const QByteArray &msg,
+                     const QString &clientToken = QString(),
+                     const QString &channel = QString());
+
+    int sendMessages(const QVector<QCloudMessagingBatchMessage> &messages,
+                     const QString &providerId = QString(),
+                     const QString &clientId = QString());
+
     Q_INVOKABLE bool subscribeToChannel(const QString &channel,
                                        const QString &providerId = QString(),
                                        const QString &clientId = QString());
@@ -99,6 +116,10 @@ public:
                                            const QString &providerId = QString(),
                                            const QString &clientId = QString());
 
+    Q_INVOKABLE int subscribeToChannels(const QStringList &channels,
+                                        const QString &providerId = QString(),
+                                        const QString &clientId = QString());
+
     Q_INVOKABLE void flushMessageQueue(const QString &providerId);
 
 Q_SIGNALS:
@@ -113,8 +134,12 @@ Q_SIGNALS:
     void serviceStateUpdated(int state);
 
 private:
+    bool isMessageReceivedObserved();
+
     QScopedPointer<QCloudMessagingPrivate> d;
 
+    friend class QCloudMessagingProvider;
+
 };
 
 QT_END_NAMESPACE
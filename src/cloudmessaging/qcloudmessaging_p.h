@@ -39,12 +39,61 @@
 // We mean it.
 //
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
-#include <QMap>
-#include <QMapIterator>
+#include <QtCloudMessaging/qcloudmessagingprovider.h>
+#include <QtCloudMessaging/private/qcloudmessagingproviderworker_p.h>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+#include <QThread>
 
 QT_BEGIN_NAMESPACE
 
-class QCloudMessagingProvider;
+// Registered provider and the worker running it, if any. Producers keep
+// their copy of the worker after releasing the registry lock.
+class QCloudMessagingProviderEntry
+{
+public:
+    QCloudMessagingProviderEntry()
+        : provider(nullptr)
+    {
+    }
+
+    // Runs function in the provider thread and returns its result, after the
+    // messages submitted before the call have been sent. Providers without a
+    // worker are called directly, like before the threaded mode.
+    template <typename T, typename Function>
+    T call(Function function) const
+    {
+        if (!worker || provider->thread() == QThread::currentThread())
+            return function();
+
+        T result = T();
+        QCloudMessagingProviderWorker *w = worker.data();
+        QMetaObject::invokeMethod(provider, [w, &function, &result] {
+            w->drainAll();
+            result = function();
+        }, Qt::BlockingQueuedConnection);
+        return result;
+    }
+
+    template <typename Function>
+    void run(Function function) const
+    {
+        if (!worker || provider->thread() == QThread::currentThread()) {
+            function();
+            return;
+        }
+
+        QCloudMessagingProviderWorker *w = worker.data();
+        QMetaObject::invokeMethod(provider, [w, &function] {
+            w->drainAll();
+            function();
+        }, Qt::BlockingQueuedConnection);
+    }
+
+    QCloudMessagingProvider *provider;
+    QSharedPointer<QCloudMessagingProviderWorker> worker;
+};
 
 class QCloudMessagingPrivate
 {
@@ -55,22 +104,19 @@ public:
     {
     }
 
-    ~QCloudMessagingPrivate()
+    // Single hash lookup, unknown ids are never inserted
+    QCloudMessagingProviderEntry entry(const QString &providerId) const
     {
-        m_serviceState = 0;
-
-        // To verify that all providers and clients are removed
-        // without memory leaks
-        QMapIterator<QString, QCloudMessagingProvider *> i(m_cloudProviders);
-        while (i.hasNext()) {
-            i.next();
-            m_cloudProviders[i.key()]->deregisterProvider();
-            m_cloudProviders.remove(i.key());
-        }
+        QReadLocker locker(&m_lock);
+        return m_cloudProviders.value(providerId);
     }
 
     int m_serviceState;
-    QMap<QString, QCloudMessagingProvider *> m_cloudProviders;
+
+    // Registry is read by every producer thread and written only when
+    // providers are registered or deregistered.
+    mutable QReadWriteLock m_lock;
+    QHash<QString, QCloudMessagingProviderEntry> m_cloudProviders;
 
 };
 
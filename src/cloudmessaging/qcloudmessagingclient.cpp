@@ -28,6 +28,7 @@
 
 #include "qcloudmessagingclient.h"
 #include "qcloudmessagingclient_p.h"
+#include "qcloudmessagingprovider.h"
 
 /*!
     \class QCloudMessagingClient
@@ -92,6 +93,15 @@ QString QCloudMessagingClient::connectClient(const QString &clientId,
     d->m_clientState = QtCloudMessagingClientConnecting;
     d->m_client_parameters = parameters;
 
+    if (parameters.contains(QStringLiteral("inbound_history_size"))
+            || parameters.contains(QStringLiteral("inbound_history_bytes"))) {
+        setInboundHistoryLimits(
+                    parameters.value(QStringLiteral("inbound_history_size"),
+                                     d->m_history.maxMessages()).toInt(),
+                    parameters.value(QStringLiteral("inbound_history_bytes"),
+                                     d->m_history.maxBytes()).toLongLong());
+    }
+
     return QString();
 }
 
@@ -195,19 +205,184 @@ QVariantMap QCloudMessagingClient::clientParameters()
     return d->m_client_parameters;
 }
 
-// Pure Virtual functions documentation
+/*!
+ * \brief QCloudMessagingClient::subscribeToChannels
+ * Subscribes client to several broadcast channels at once.
+ * Default implementation calls subscribeToChannel for every channel. Clients
+ * can override this function to apply the whole list with one service
+ * registration.
+ *
+ * \param channels
+ * Channel names as QStringList
+ *
+ * \return
+ * Returns the amount of channels subscribed.
+ */
+int QCloudMessagingClient::subscribeToChannels(const QStringList &channels)
+{
+    int subscribed = 0;
+    for (const QString &channel : channels) {
+        if (subscribeToChannel(channel))
+            subscribed++;
+    }
+    return subscribed;
+}
 
 /*!
-    \fn QCloudMessagingClient::flushMessageQueue()
-    When receiving push messages they can be stored by clients internally.
-    This function gives developers possibility to do flush commnand for them.
+ * \brief QCloudMessagingClient::flushMessageQueue
+ * Emits messageReceived for the kept messages which reached no receiver
+ * when they were received and have not been flushed before, so that
+ * messages received before the application connected to the signals are
+ * not lost. Can be re-implemented in the inheritance.
+ *
+ * \return
+ * return true when successful, false otherwise.
+ */
+bool QCloudMessagingClient::flushMessageQueue()
+{
+    const QVector<QCloudMessagingInboundHistory::Entry> entries =
+            d->m_history.entries(d->m_replay_cursor, true);
+    for (const QCloudMessagingInboundHistory::Entry &entry : entries) {
+        d->m_replay_cursor = entry.sequence + 1;
+        emit messageReceived(entry.clientId, entry.payload);
+    }
+    return true;
+}
 
-    This is pure virtual function and needs to be implemented in the
-    inheritance.
+/*!
+ * \brief QCloudMessagingClient::replayMessages
+ * Emits messageReceived again for the kept messages.
+ *
+ * \param fromSequence
+ * Sequence number of the first message to replay, as returned by
+ * deliverMessage. Evicted messages are skipped.
+ *
+ * \return
+ * Number of replayed messages.
+ */
+int QCloudMessagingClient::replayMessages(quint64 fromSequence)
+{
+    const QVector<QCloudMessagingInboundHistory::Entry> entries = d->m_history.entries(fromSequence);
+    for (const QCloudMessagingInboundHistory::Entry &entry : entries)
+        emit messageReceived(entry.clientId, entry.payload);
+    return entries.size();
+}
+
+/*!
+ * \brief QCloudMessagingClient::setInboundHistoryLimits
+ * Sets how many received messages are kept for flushMessageQueue. Also
+ * settable with the "inbound_history_size" and "inbound_history_bytes"
+ * client parameters. Defaults are 64 messages and 1 MiB.
+ *
+ * \param maxMessages
+ * Number of messages kept, 0 disables the history.
+ *
+ * \param maxBytes
+ * Total payload size kept.
+ */
+void QCloudMessagingClient::setInboundHistoryLimits(int maxMessages, qint64 maxBytes)
+{
+    d->m_history.setLimits(maxMessages, maxBytes);
+}
+
+/*!
+ * \brief QCloudMessagingClient::inboundHistoryCount
+ * \return
+ * Number of kept messages.
+ */
+int QCloudMessagingClient::inboundHistoryCount()
+{
+    return d->m_history.count();
+}
+
+/*!
+ * \brief QCloudMessagingClient::evictedMessageCount
+ * \return
+ * Number of received messages dropped from the history because of the
+ * limits.
+ */
+quint64 QCloudMessagingClient::evictedMessageCount()
+{
+    return d->m_history.evictedCount();
+}
+
+/*!
+ * \brief QCloudMessagingClient::deliverMessage
+ * Keeps the received message in the history and emits messageReceived.
+ * Implementations call this for every message received from the service.
+ *
+ * \param clientId
+ * \param msg
+ *
+ * \return
+ * Sequence number of the message.
+ */
+quint64 QCloudMessagingClient::deliverMessage(const QString &clientId, const QByteArray &msg)
+{
+    // Flush skips the message if the signal reaches a receiver now
+    const quint64 sequence = d->m_history.append(clientId, msg, isMessageReceivedObserved());
+    emit messageReceived(clientId, msg);
+    return sequence;
+}
+
+/*!
+ * \brief QCloudMessagingClient::deliverMessage
+ * Keeps the received message in the history without serializing it and
+ * emits messageReceived only if the signal reaches a receiver. Otherwise
+ * the payload is serialized when the history is first read, for
+ * flushMessageQueue or replayMessages.
+ *
+ * \param clientId
+ * \param sizeHint
+ * Estimated payload size, used for the history byte limit.
+ * \param serialize
+ * Returns the payload. Called at most once for the signal and once for
+ * the history, from the thread delivering or replaying the message.
+ *
+ * \return
+ * Sequence number of the message.
+ */
+quint64 QCloudMessagingClient::deliverMessage(const QString &clientId, qint64 sizeHint,
+                                              const std::function<QByteArray()> &serialize)
+{
+    const bool observed = isMessageReceivedObserved();
+    const quint64 sequence = d->m_history.append(clientId, sizeHint, serialize, observed);
+    if (observed)
+        emit messageReceived(clientId, serialize());
+    return sequence;
+}
+
+/*!
+ * \brief QCloudMessagingClient::isMessageReceivedObserved
+ * Private function to check whether messageReceived has a receiver other
+ * than the provider, or the provider relays it to one.
+ *
+ * \return
+ */
+bool QCloudMessagingClient::isMessageReceivedObserved()
+{
+    int relays = 0;
+    QCloudMessagingProvider *provider = d->m_provider.data();
+    if (provider) {
+        if (provider->isMessageReceivedObserved())
+            return true;
+        relays = 1;
+    }
+    return receivers(SIGNAL(messageReceived(QString,QByteArray))) > relays;
+}
+
+/*!
+ * \brief QCloudMessagingClient::inboundHistoryLimit
+ * \return
+ * Number of messages the history keeps, 0 if disabled.
+ */
+int QCloudMessagingClient::inboundHistoryLimit()
+{
+    return d->m_history.maxMessages();
+}
+
+// Pure Virtual functions documentation
 
-    \return
-    return true when successful, false otherwise.
-*/
 /*!
     \fn QCloudMessagingClient::sendMessage(
         const QByteArray &msg,
@@ -34,11 +34,15 @@
 #include <QObject>
 #include <QVariantMap>
 #include <QString>
+#include <QStringList>
 #include <QScopedPointer>
 
+#include <functional>
+
 QT_BEGIN_NAMESPACE
 
 class QCloudMessagingClientPrivate;
+class QCloudMessagingProvider;
 
 class Q_CLOUDMESSAGING_EXPORT QCloudMessagingClient : public QObject
 {
@@ -77,12 +81,22 @@ public:
             const QString &clientToken =  QString(),
             const QString &channel = QString()) = 0;
 
-    virtual bool flushMessageQueue() = 0;
+    virtual bool flushMessageQueue();
+
+    int replayMessages(quint64 fromSequence);
+
+    void setInboundHistoryLimits(int maxMessages, qint64 maxBytes);
+
+    int inboundHistoryCount();
+
+    quint64 evictedMessageCount();
 
     virtual bool subscribeToChannel(const QString &channel) = 0;
 
     virtual bool unsubscribeFromChannel(const QString &channel) = 0;
 
+    virtual int subscribeToChannels(const QStringList &channels);
+
     void setClientState(int state);
 
     int clientState();
@@ -104,10 +118,21 @@ Q_SIGNALS:
 
     void clientTokenReceived(const QString &token);
 
+protected:
+    quint64 deliverMessage(const QString &clientId, const QByteArray &msg);
+
+    quint64 deliverMessage(const QString &clientId, qint64 sizeHint,
+                           const std::function<QByteArray()> &serialize);
+
+    int inboundHistoryLimit();
+
 private:
+    bool isMessageReceivedObserved();
 
     QScopedPointer<QCloudMessagingClientPrivate> d;
 
+    friend class QCloudMessagingProvider;
+
 };
 
 QT_END_NAMESPACE
@@ -39,19 +39,23 @@
 // We mean it.
 //
 
+#include <QPointer>
 #include <QVariantMap>
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/private/qcloudmessaginginboundhistory_p.h>
 
 QT_BEGIN_NAMESPACE
 
 
 class QCloudMessagingClient;
+class QCloudMessagingProvider;
 
 class QCloudMessagingClientPrivate
 {
 public:
     QCloudMessagingClientPrivate()
-        : m_clientState(0)
+        : m_clientState(0),
+          m_replay_cursor(1)
     {
     }
 
@@ -62,6 +66,12 @@ public:
     int m_clientState;
     QVariantMap m_client_parameters;
 
+    QCloudMessagingInboundHistory m_history;
+    quint64 m_replay_cursor;
+
+    // Provider relaying messageReceived, set by connectClientToProvider
+    QPointer<QCloudMessagingProvider> m_provider;
+
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,449 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qcloudmessagingdatastream.h"
+#include "qcloudmessagingdatastream_p.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <QRandomGenerator>
+
+/*!
+    \class QCloudMessagingDataStream
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingDataStream class receives device data from a
+    persistent WebSocket session of the cloud messaging service.
+
+    When a session request is set, open() first creates the session with an
+    HTTP POST and then connects the WebSocket to the stream URL extended
+    with \c {/sessionId/<id>}. Without a session request the stream URL is
+    used as is.
+
+    A dropped connection is reconnected with exponential backoff as defined
+    by reconnectPolicy(), resuming the same session so the service can
+    deliver the data buffered meanwhile. A session that cannot be resumed
+    is replaced with a new one.
+
+    Incoming WebSocket frames are parsed as they arrive. Every message, and
+    every newline separated record within a message, is delivered with
+    messageReceived().
+*/
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingDataStream::QCloudMessagingDataStream
+ * \param parent
+ * QObject parent
+ */
+QCloudMessagingDataStream::QCloudMessagingDataStream(QObject *parent) :
+    QObject(parent),
+    d(new QCloudMessagingDataStreamPrivate)
+{
+    connect(&d->m_socket, &QWebSocket::connected,
+            this, &QCloudMessagingDataStream::socketConnected);
+    connect(&d->m_socket, &QWebSocket::disconnected,
+            this, &QCloudMessagingDataStream::socketDisconnected);
+    connect(&d->m_socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error),
+            this, [this](QAbstractSocket::SocketError) {
+        // Failed handshakes and refused connections may not emit disconnected.
+        if (d->m_socket.state() == QAbstractSocket::UnconnectedState)
+            socketDisconnected();
+    });
+    connect(&d->m_socket, &QWebSocket::binaryFrameReceived,
+            this, &QCloudMessagingDataStream::processFrame);
+    connect(&d->m_socket, &QWebSocket::textFrameReceived,
+            this, [this](const QString &frame, bool isLastFrame) {
+        processFrame(frame.toUtf8(), isLastFrame);
+    });
+    connect(&d->m_reconnect_timer, &QTimer::timeout,
+            this, &QCloudMessagingDataStream::open);
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::~QCloudMessagingDataStream
+ */
+QCloudMessagingDataStream::~QCloudMessagingDataStream()
+{
+    close();
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::setSessionRequest
+ * \param request
+ * Request used to create a persistent session with HTTP POST. The reply
+ * contains the session id as JSON \c sessionId or as plain text.
+ */
+void QCloudMessagingDataStream::setSessionRequest(const QNetworkRequest &request)
+{
+    d->m_session_request = request;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::sessionRequest
+ * \return
+ */
+QNetworkRequest QCloudMessagingDataStream::sessionRequest() const
+{
+    return d->m_session_request;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::setStreamUrl
+ * \param url
+ * WebSocket URL of the data stream, without the session id.
+ */
+void QCloudMessagingDataStream::setStreamUrl(const QUrl &url)
+{
+    d->m_stream_url = url;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::streamUrl
+ * \return
+ */
+QUrl QCloudMessagingDataStream::streamUrl() const
+{
+    return d->m_stream_url;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::setSessionId
+ * Sets the session to resume, e.g. one stored from sessionCreated.
+ *
+ * \param sessionId
+ */
+void QCloudMessagingDataStream::setSessionId(const QString &sessionId)
+{
+    d->m_session_id = sessionId;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::sessionId
+ * \return
+ */
+QString QCloudMessagingDataStream::sessionId() const
+{
+    return d->m_session_id;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::setReconnectPolicy
+ * \param policy
+ * Backoff of the reconnects. QCloudMessagingRetryPolicy::maxAttempts of 0
+ * reconnects until the stream is closed. Deadline is not used.
+ */
+void QCloudMessagingDataStream::setReconnectPolicy(const QCloudMessagingRetryPolicy &policy)
+{
+    d->m_reconnect_policy = policy;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::reconnectPolicy
+ * \return
+ */
+QCloudMessagingRetryPolicy QCloudMessagingDataStream::reconnectPolicy() const
+{
+    return d->m_reconnect_policy;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::state
+ * \return
+ */
+QCloudMessagingDataStream::StreamState QCloudMessagingDataStream::state() const
+{
+    return d->m_state;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::receivedMessageCount
+ * \return
+ * Amount of messages delivered since the stream was created.
+ */
+qint64 QCloudMessagingDataStream::receivedMessageCount() const
+{
+    return d->m_received;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::open
+ * Creates the session if needed and connects the stream.
+ */
+void QCloudMessagingDataStream::open()
+{
+    d->m_reconnect_timer.stop();
+    if (d->m_state == StreamOpen || d->m_state == StreamConnecting
+            || d->m_state == StreamCreatingSession)
+        return;
+
+    if (d->m_session_id.isEmpty() && !d->m_session_request.url().isEmpty())
+        createSession();
+    else
+        connectSocket();
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::close
+ * Closes the stream. Session id is kept for a later open.
+ */
+void QCloudMessagingDataStream::close()
+{
+    if (d->m_state == StreamClosed)
+        return;
+
+    setState(StreamClosed);
+    d->m_reconnect_timer.stop();
+    d->m_attempts = 0;
+
+    QNetworkReply *reply = d->m_session_reply.data();
+    d->m_session_reply.clear();
+    if (reply) {
+        reply->abort();
+        reply->deleteLater();
+    }
+    d->m_socket.abort();
+    d->m_buffer.clear();
+    d->m_scanned = d->m_consumed = 0;
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::createSession
+ */
+void QCloudMessagingDataStream::createSession()
+{
+    setState(StreamCreatingSession);
+    d->m_session_reply = d->m_manager.post(d->m_session_request, QByteArray());
+    connect(d->m_session_reply.data(), &QNetworkReply::finished,
+            this, &QCloudMessagingDataStream::sessionReplyFinished);
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::sessionReplyFinished
+ */
+void QCloudMessagingDataStream::sessionReplyFinished()
+{
+    QNetworkReply *reply = d->m_session_reply.data();
+    if (!reply || reply != sender())
+        return;
+
+    reply->deleteLater();
+    d->m_session_reply.clear();
+
+    if (d->m_state != StreamCreatingSession)
+        return;
+
+    const QByteArray body = reply->readAll();
+    QString sessionId;
+    if (reply->error() == QNetworkReply::NoError) {
+        const QJsonObject object = QJsonDocument::fromJson(body).object();
+        sessionId = object.value(QLatin1String("sessionId")).toString();
+        if (sessionId.isEmpty() && object.isEmpty())
+            sessionId = QString::fromUtf8(body.trimmed());
+    }
+
+    if (sessionId.isEmpty()) {
+        emit streamError(reply->error() == QNetworkReply::NoError
+                         ? QStringLiteral("No session id in reply")
+                         : reply->errorString());
+        scheduleReconnect();
+        return;
+    }
+
+    d->m_session_id = sessionId;
+    emit sessionCreated(sessionId);
+    connectSocket();
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::connectSocket
+ */
+void QCloudMessagingDataStream::connectSocket()
+{
+    QUrl url = d->m_stream_url;
+    if (!d->m_session_id.isEmpty()) {
+        QString path = url.path();
+        if (path.endsWith(QLatin1Char('/')))
+            path.chop(1);
+        url.setPath(path + QStringLiteral("/sessionId/") + d->m_session_id);
+    }
+
+    d->m_connected = false;
+    setState(StreamConnecting);
+    d->m_socket.open(url);
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::socketConnected
+ */
+void QCloudMessagingDataStream::socketConnected()
+{
+    d->m_connected = true;
+    d->m_attempts = 0;
+    d->m_failed_resumes = 0;
+    setState(StreamOpen);
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::socketDisconnected
+ */
+void QCloudMessagingDataStream::socketDisconnected()
+{
+    if (d->m_state == StreamClosed || d->m_state == StreamReconnecting)
+        return;
+
+    // Partial message is not completed by the next connection.
+    d->m_buffer.clear();
+    d->m_scanned = d->m_consumed = 0;
+
+    if (!d->m_connected && !d->m_session_id.isEmpty()
+            && !d->m_session_request.url().isEmpty()
+            && ++d->m_failed_resumes >= QCloudMessagingDataStreamPrivate::MaxFailedResumes) {
+        // Session has expired on the server, start a new one.
+        d->m_session_id.clear();
+        d->m_failed_resumes = 0;
+    }
+
+    if (!d->m_connected)
+        emit streamError(d->m_socket.errorString());
+
+    d->m_connected = false;
+    scheduleReconnect();
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::scheduleReconnect
+ * Reconnects after exponential backoff with jitter.
+ */
+void QCloudMessagingDataStream::scheduleReconnect()
+{
+    const QCloudMessagingRetryPolicy &policy = d->m_reconnect_policy;
+    if (policy.maxAttempts > 0 && d->m_attempts >= policy.maxAttempts) {
+        close();
+        return;
+    }
+
+    qreal delay = policy.initialBackoff;
+    for (int i = 0; i < d->m_attempts && delay < policy.maxBackoff; i++)
+        delay *= policy.multiplier;
+    delay = qMin(delay, qreal(policy.maxBackoff));
+    delay -= delay * policy.jitter * QRandomGenerator::global()->generateDouble();
+
+    d->m_attempts++;
+    setState(StreamReconnecting);
+    d->m_reconnect_timer.start(int(delay));
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::processFrame
+ * Delivers complete records as soon as their frame arrives. Searching
+ * continues from where the previous frame ended, and delivered bytes are
+ * dropped only once they make up half of the buffer.
+ *
+ * \param frame
+ * \param isLastFrame
+ */
+void QCloudMessagingDataStream::processFrame(const QByteArray &frame, bool isLastFrame)
+{
+    // Single frame message with one record is delivered without copying.
+    if (d->m_buffer.isEmpty() && isLastFrame && frame.indexOf('\n') < 0) {
+        if (!frame.isEmpty()) {
+            d->m_received++;
+            emit messageReceived(frame);
+        }
+        return;
+    }
+
+    d->m_buffer.append(frame);
+
+    int pos;
+    while ((pos = d->m_buffer.indexOf('\n', d->m_scanned)) >= 0) {
+        if (pos > d->m_consumed) {
+            d->m_received++;
+            emit messageReceived(d->m_buffer.mid(d->m_consumed, pos - d->m_consumed));
+        }
+        d->m_consumed = d->m_scanned = pos + 1;
+    }
+    d->m_scanned = d->m_buffer.size();
+
+    if (isLastFrame) {
+        if (d->m_consumed < d->m_buffer.size()) {
+            d->m_received++;
+            emit messageReceived(d->m_buffer.mid(d->m_consumed));
+        }
+        d->m_buffer.clear();
+        d->m_scanned = d->m_consumed = 0;
+    } else if (d->m_consumed > d->m_buffer.size() / 2) {
+        d->m_buffer.remove(0, d->m_consumed);
+        d->m_scanned -= d->m_consumed;
+        d->m_consumed = 0;
+    }
+}
+
+/*!
+ * \brief QCloudMessagingDataStream::setState
+ * \param state
+ */
+void QCloudMessagingDataStream::setState(StreamState state)
+{
+    if (d->m_state == state)
+        return;
+
+    d->m_state = state;
+    emit stateChanged(state);
+}
+
+// Signals documentation
+/*!
+    \fn QCloudMessagingDataStream::sessionCreated(const QString &sessionId)
+    This signal is triggered when a new persistent session was created.
+    Storing \a sessionId allows resuming the session after restart.
+*/
+
+/*!
+    \fn QCloudMessagingDataStream::messageReceived(const QByteArray &message)
+    This signal is triggered for every message or record received from the
+    stream.
+*/
+
+/*!
+    \fn QCloudMessagingDataStream::stateChanged(QCloudMessagingDataStream::StreamState state)
+    This signal is triggered when the stream state changes.
+*/
+
+/*!
+    \fn QCloudMessagingDataStream::streamError(const QString &errorString)
+    This signal is triggered when creating the session or connecting the
+    stream fails. The stream keeps reconnecting as defined by the policy.
+*/
+
+QT_END_NAMESPACE
@@ -0,0 +1,112 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGDATASTREAM_H
+#define QCLOUDMESSAGINGDATASTREAM_H
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/qcloudmessagingrestapi.h>
+
+#include <QObject>
+#include <QNetworkRequest>
+#include <QUrl>
+#include <QScopedPointer>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingDataStreamPrivate;
+
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingDataStream : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum StreamState {
+        StreamClosed = 0,
+        StreamCreatingSession,
+        StreamConnecting,
+        StreamOpen,
+        StreamReconnecting
+    };
+    Q_ENUM(StreamState)
+
+    explicit QCloudMessagingDataStream(QObject *parent = nullptr);
+
+    ~QCloudMessagingDataStream();
+
+    void setSessionRequest(const QNetworkRequest &request);
+
+    QNetworkRequest sessionRequest() const;
+
+    void setStreamUrl(const QUrl &url);
+
+    QUrl streamUrl() const;
+
+    void setSessionId(const QString &sessionId);
+
+    QString sessionId() const;
+
+    void setReconnectPolicy(const QCloudMessagingRetryPolicy &policy);
+
+    QCloudMessagingRetryPolicy reconnectPolicy() const;
+
+    StreamState state() const;
+
+    qint64 receivedMessageCount() const;
+
+public Q_SLOTS:
+    void open();
+
+    void close();
+
+Q_SIGNALS:
+    void sessionCreated(const QString &sessionId);
+
+    void messageReceived(const QByteArray &message);
+
+    void stateChanged(QCloudMessagingDataStream::StreamState state);
+
+    void streamError(const QString &errorString);
+
+private:
+    void createSession();
+    void sessionReplyFinished();
+    void connectSocket();
+    void socketConnected();
+    void socketDisconnected();
+    void scheduleReconnect();
+    void processFrame(const QByteArray &frame, bool isLastFrame);
+    void setState(StreamState state);
+
+    QScopedPointer<QCloudMessagingDataStreamPrivate> d;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGDATASTREAM_H
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGDATASTREAM_P_H
+#define QCLOUDMESSAGINGDATASTREAM_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/qcloudmessagingdatastream.h>
+#include <QNetworkAccessManager>
+#include <QPointer>
+#include <QTimer>
+#include <QWebSocket>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingDataStreamPrivate
+{
+public:
+    QCloudMessagingDataStreamPrivate()
+        : m_state(QCloudMessagingDataStream::StreamClosed),
+          m_connected(false),
+          m_attempts(0),
+          m_failed_resumes(0),
+          m_scanned(0),
+          m_consumed(0),
+          m_received(0)
+    {
+        // Keep reconnecting until closed.
+        m_reconnect_policy.maxAttempts = 0;
+        m_reconnect_policy.initialBackoff = 500;
+        m_reconnect_policy.maxBackoff = 30000;
+        m_reconnect_timer.setSingleShot(true);
+    }
+
+    ~QCloudMessagingDataStreamPrivate() = default;
+
+    // Session is recreated after this many failed resumes in a row.
+    enum { MaxFailedResumes = 2 };
+
+    QCloudMessagingDataStream::StreamState m_state;
+    QNetworkRequest m_session_request;
+    QUrl m_stream_url;
+    QString m_session_id;
+    QCloudMessagingRetryPolicy m_reconnect_policy;
+
+    QNetworkAccessManager m_manager;
+    QPointer<QNetworkReply> m_session_reply;
+    QWebSocket m_socket;
+    QTimer m_reconnect_timer;
+    bool m_connected;
+    int m_attempts;
+    int m_failed_resumes;
+
+    // Message being received: m_scanned bytes are searched for record
+    // separators, m_consumed bytes are already delivered.
+    QByteArray m_buffer;
+    int m_scanned;
+    int m_consumed;
+    qint64 m_received;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGDATASTREAM_P_H
@@ -0,0 +1,306 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qcloudmessaginginboundhistory_p.h"
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingInboundHistory::QCloudMessagingInboundHistory
+ * \param maxMessages
+ * Number of messages kept, 0 disables the history.
+ * \param maxBytes
+ * Total payload size kept.
+ */
+QCloudMessagingInboundHistory::QCloudMessagingInboundHistory(int maxMessages, qint64 maxBytes) :
+    m_head(0),
+    m_count(0),
+    m_max_messages(0),
+    m_max_bytes(maxBytes),
+    m_bytes(0),
+    m_next_sequence(1),
+    m_evicted_count(0),
+    m_evicted_bytes(0)
+{
+    resize(qMax(0, maxMessages));
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::setLimits
+ * Changes the limits, the oldest messages are evicted if they no longer fit.
+ * \param maxMessages
+ * \param maxBytes
+ */
+void QCloudMessagingInboundHistory::setLimits(int maxMessages, qint64 maxBytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    maxMessages = qMax(0, maxMessages);
+    m_max_bytes = qMax(qint64(0), maxBytes);
+
+    while (m_count > 0 && (m_count > maxMessages || m_bytes > m_max_bytes))
+        evictOldest();
+
+    if (maxMessages != m_max_messages)
+        resize(maxMessages);
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::maxMessages
+ * \return
+ */
+int QCloudMessagingInboundHistory::maxMessages() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_max_messages;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::maxBytes
+ * \return
+ */
+qint64 QCloudMessagingInboundHistory::maxBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_max_bytes;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::append
+ * Records the message. A payload larger than the byte limit is not kept,
+ * but it is counted as evicted and consumes its sequence number.
+ * \param clientId
+ * \param payload
+ * \param delivered
+ * true if the message already reached a receiver when it was received.
+ * \return
+ * Sequence number of the message.
+ */
+quint64 QCloudMessagingInboundHistory::append(const QString &clientId, const QByteArray &payload,
+                                              bool delivered)
+{
+    return appendSlot(clientId, payload.size(), payload, Serializer(), delivered);
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::append
+ * Records the message without its payload. The serializer is run once,
+ * when entries first returns the message, and never for messages evicted
+ * before that.
+ * \param clientId
+ * \param size
+ * Estimated payload size, used for the byte limit.
+ * \param serialize
+ * \param delivered
+ * \return
+ * Sequence number of the message.
+ */
+quint64 QCloudMessagingInboundHistory::append(const QString &clientId, qint64 size,
+                                              const Serializer &serialize, bool delivered)
+{
+    return appendSlot(clientId, size, QByteArray(), serialize, delivered);
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::entries
+ * \param fromSequence
+ * \param undeliveredOnly
+ * If true, messages delivered when they were received are skipped and
+ * not serialized.
+ * \return
+ * Kept messages with sequence number fromSequence or later, oldest first.
+ */
+QVector<QCloudMessagingInboundHistory::Entry> QCloudMessagingInboundHistory::entries(
+        quint64 fromSequence, bool undeliveredOnly) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QVector<Entry> result;
+    for (int i = 0; i < m_count; i++) {
+        Slot &slot = m_ring[(m_head + i) % m_max_messages];
+        if (slot.entry.sequence < fromSequence || (undeliveredOnly && slot.entry.delivered))
+            continue;
+        if (result.isEmpty())
+            result.reserve(m_count - i);
+        if (slot.serialize) {
+            slot.entry.payload = slot.serialize();
+            slot.serialize = Serializer();
+        }
+        result.append(slot.entry);
+    }
+    return result;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::nextSequence
+ * \return
+ * Sequence number the next message will get.
+ */
+quint64 QCloudMessagingInboundHistory::nextSequence() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_next_sequence;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::count
+ * \return
+ */
+int QCloudMessagingInboundHistory::count() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_count;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::bytes
+ * \return
+ */
+qint64 QCloudMessagingInboundHistory::bytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytes;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::evictedCount
+ * \return
+ * Messages dropped because of the limits.
+ */
+quint64 QCloudMessagingInboundHistory::evictedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_evicted_count;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::evictedBytes
+ * \return
+ */
+qint64 QCloudMessagingInboundHistory::evictedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_evicted_bytes;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::clear
+ * Drops the kept messages, sequence numbers and counters continue.
+ */
+void QCloudMessagingInboundHistory::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = 0; i < m_count; i++) {
+        Slot &slot = m_ring[(m_head + i) % m_max_messages];
+        slot.entry.clientId.clear();
+        slot.entry.payload.clear();
+        slot.serialize = Serializer();
+    }
+    m_head = 0;
+    m_count = 0;
+    m_bytes = 0;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::appendSlot
+ * Private function recording either the payload or its serializer.
+ * \param clientId
+ * \param size
+ * \param payload
+ * \param serialize
+ * \param delivered
+ * \return
+ * Sequence number of the message.
+ */
+quint64 QCloudMessagingInboundHistory::appendSlot(const QString &clientId, qint64 size,
+                                                  const QByteArray &payload,
+                                                  const Serializer &serialize, bool delivered)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const quint64 sequence = m_next_sequence++;
+
+    if (m_max_messages == 0 || size > m_max_bytes) {
+        m_evicted_count++;
+        m_evicted_bytes += size;
+        return sequence;
+    }
+
+    while (m_count > 0 && (m_count == m_max_messages || m_bytes + size > m_max_bytes))
+        evictOldest();
+
+    Slot &slot = m_ring[(m_head + m_count) % m_max_messages];
+    slot.entry.sequence = sequence;
+    slot.entry.clientId = clientId;
+    slot.entry.payload = payload;
+    slot.entry.delivered = delivered;
+    slot.size = size;
+    slot.serialize = serialize;
+    m_bytes += size;
+    m_count++;
+
+    return sequence;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::evictOldest
+ * Private function, called with the mutex held.
+ */
+void QCloudMessagingInboundHistory::evictOldest()
+{
+    Slot &slot = m_ring[m_head];
+    m_bytes -= slot.size;
+    m_evicted_count++;
+    m_evicted_bytes += slot.size;
+    slot.entry.clientId.clear();
+    slot.entry.payload.clear();
+    slot.serialize = Serializer();
+
+    m_head = (m_head + 1) % m_max_messages;
+    m_count--;
+}
+
+/*!
+ * \brief QCloudMessagingInboundHistory::resize
+ * Private function to change the ring capacity, the kept messages must fit.
+ * Called with the mutex held.
+ * \param capacity
+ */
+void QCloudMessagingInboundHistory::resize(int capacity)
+{
+    QVector<Slot> ring(capacity);
+    for (int i = 0; i < m_count; i++)
+        ring[i] = std::move(m_ring[(m_head + i) % m_max_messages]);
+
+    m_ring.swap(ring);
+    m_head = 0;
+    m_max_messages = capacity;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,130 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+#ifndef QCLOUDMESSAGINGINBOUNDHISTORY_P_H
+#define QCLOUDMESSAGINGINBOUNDHISTORY_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+
+/*
+ * Fixed-capacity ring of the latest received messages. Payloads are kept as
+ * implicitly shared QByteArrays, so recording and replaying a message does
+ * not copy it. A message can also be recorded as a serializer, which is run
+ * the first time the message is read. Every message gets a sequence number,
+ * oldest messages are evicted when either the message or the byte limit is
+ * reached.
+ */
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingInboundHistory
+{
+public:
+    class Entry
+    {
+    public:
+        Entry() : sequence(0), delivered(false) {}
+
+        quint64 sequence;
+        QString clientId;
+        QByteArray payload;
+        // Emitted when it was received, not replayed by a flush
+        bool delivered;
+    };
+
+    explicit QCloudMessagingInboundHistory(int maxMessages = 64,
+                                           qint64 maxBytes = 1024 * 1024);
+
+    void setLimits(int maxMessages, qint64 maxBytes);
+    int maxMessages() const;
+    qint64 maxBytes() const;
+
+    typedef std::function<QByteArray()> Serializer;
+
+    quint64 append(const QString &clientId, const QByteArray &payload,
+                   bool delivered = false);
+    quint64 append(const QString &clientId, qint64 size, const Serializer &serialize,
+                   bool delivered = false);
+
+    QVector<Entry> entries(quint64 fromSequence = 0, bool undeliveredOnly = false) const;
+
+    quint64 nextSequence() const;
+    int count() const;
+    qint64 bytes() const;
+    quint64 evictedCount() const;
+    qint64 evictedBytes() const;
+
+    void clear();
+
+private:
+    // Ring slot, size is what the message was accounted with.
+    class Slot
+    {
+    public:
+        Slot() : size(0) {}
+
+        Entry entry;
+        qint64 size;
+        Serializer serialize;
+    };
+
+    quint64 appendSlot(const QString &clientId, qint64 size, const QByteArray &payload,
+                       const Serializer &serialize, bool delivered);
+    void evictOldest();
+    void resize(int capacity);
+
+    mutable QMutex m_mutex;
+    mutable QVector<Slot> m_ring;
+    int m_head;
+    int m_count;
+    int m_max_messages;
+    qint64 m_max_bytes;
+    qint64 m_bytes;
+    quint64 m_next_sequence;
+    quint64 m_evicted_count;
+    qint64 m_evicted_bytes;
+};
+
+Q_DECLARE_TYPEINFO(QCloudMessagingInboundHistory::Entry, Q_MOVABLE_TYPE);
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGINBOUNDHISTORY_P_H
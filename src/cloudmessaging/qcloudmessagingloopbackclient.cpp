@@ -0,0 +1,203 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qcloudmessagingloopbackclient.h"
+#include "qcloudmessagingloopbackclient_p.h"
+#include "qcloudmessagingloopbackprovider.h"
+#include "qcloudmessagingloopbackprovider_p.h"
+
+/*!
+    \class QCloudMessagingLoopbackClient
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingLoopbackClient class is a client of
+    QCloudMessagingLoopbackProvider.
+
+    Clients are created by QCloudMessagingLoopbackProvider::connectClient.
+    Messages sent by a client are routed by its provider.
+*/
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::QCloudMessagingLoopbackClient
+ * \param provider
+ * Provider routing the messages of this client.
+ * \param parent
+ */
+QCloudMessagingLoopbackClient::QCloudMessagingLoopbackClient(QCloudMessagingLoopbackProvider *provider,
+                                                             QObject *parent) :
+    QCloudMessagingClient(parent),
+    d(new QCloudMessagingLoopbackClientPrivate)
+{
+    d->m_provider = provider;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::~QCloudMessagingLoopbackClient
+ */
+QCloudMessagingLoopbackClient::~QCloudMessagingLoopbackClient()
+{
+    disconnectClient();
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::connectClient
+ * \param clientId
+ * \param parameters
+ * \return
+ */
+QString QCloudMessagingLoopbackClient::connectClient(const QString &clientId,
+                                                     const QVariantMap &parameters)
+{
+    QCloudMessagingClient::connectClient(clientId, parameters);
+    if (!d->m_provider)
+        return QString();
+
+    QString token = parameters.value(QStringLiteral("client_token")).toString();
+    if (token.isEmpty())
+        token = d->m_provider->providerId() + QLatin1Char('/') + clientId;
+    setClientToken(token);
+
+    subscribeToChannels(parameters.value(QStringLiteral("channels")).toStringList());
+
+    setClientState(QtCloudMessagingClientOnline);
+    emit clientStateChanged(clientId, QtCloudMessagingClientOnline);
+
+    return clientId;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::disconnectClient
+ * Removes the token and the subscriptions of the client from the provider.
+ */
+void QCloudMessagingLoopbackClient::disconnectClient()
+{
+    if (d->m_provider) {
+        for (const QString &channel : qAsConst(d->m_channels))
+            d->m_provider->d->unsubscribe(this, channel);
+        d->m_provider->d->setToken(this, d->m_token, QString());
+    }
+    d->m_channels.clear();
+
+    QCloudMessagingClient::disconnectClient();
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::cloudMessageReceived
+ * \param client
+ * \param message
+ */
+void QCloudMessagingLoopbackClient::cloudMessageReceived(const QString &client,
+                                                         const QByteArray &message)
+{
+    deliverMessage(client, message);
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::clientToken
+ * \return
+ */
+QString QCloudMessagingLoopbackClient::clientToken()
+{
+    return d->m_token;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::setClientToken
+ * Routes messages sent to \a token to this client.
+ * \param token
+ */
+void QCloudMessagingLoopbackClient::setClientToken(const QString &token)
+{
+    if (d->m_provider)
+        d->m_provider->d->setToken(this, d->m_token, token);
+    d->m_token = token;
+
+    emit clientTokenReceived(d->m_token);
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::sendMessage
+ * \param msg
+ * \param clientToken
+ * \param channel
+ * \return
+ */
+bool QCloudMessagingLoopbackClient::sendMessage(const QByteArray &msg,
+                                                const QString &clientToken,
+                                                const QString &channel)
+{
+    if (!d->m_provider)
+        return false;
+
+    return d->m_provider->sendMessage(msg, clientId(), clientToken, channel);
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::subscribeToChannel
+ * \param channel
+ * \return
+ * false if already subscribed.
+ */
+bool QCloudMessagingLoopbackClient::subscribeToChannel(const QString &channel)
+{
+    if (channel.isEmpty() || !d->m_provider || !d->m_provider->d->subscribe(this, channel))
+        return false;
+
+    d->m_channels.append(channel);
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::unsubscribeFromChannel
+ * \param channel
+ * \return
+ * false if not subscribed.
+ */
+bool QCloudMessagingLoopbackClient::unsubscribeFromChannel(const QString &channel)
+{
+    if (!d->m_provider || !d->m_provider->d->unsubscribe(this, channel))
+        return false;
+
+    d->m_channels.removeOne(channel);
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackClient::channels
+ * \return
+ * Channels the client is subscribed to.
+ */
+QStringList QCloudMessagingLoopbackClient::channels() const
+{
+    return d->m_channels;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCLOUDMESSAGINGLOOPBACKCLIENT_H
+#define QCLOUDMESSAGINGLOOPBACKCLIENT_H
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/qcloudmessagingclient.h>
+#include <QObject>
+#include <QVariantMap>
+#include <QStringList>
+#include <QScopedPointer>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingLoopbackProvider;
+class QCloudMessagingLoopbackClientPrivate;
+
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingLoopbackClient : public QCloudMessagingClient
+{
+    Q_OBJECT
+public:
+
+    explicit QCloudMessagingLoopbackClient(QCloudMessagingLoopbackProvider *provider,
+                                           QObject *parent = nullptr);
+
+    ~QCloudMessagingLoopbackClient();
+
+    QString connectClient(const QString &clientId,
+                          const QVariantMap &parameters = QVariantMap()) override;
+
+    void disconnectClient() override;
+
+    void cloudMessageReceived(const QString &client,
+                              const QByteArray &message) override;
+
+    QString clientToken() override;
+
+    void setClientToken(const QString &token) override;
+
+    bool sendMessage(const QByteArray &msg,
+                     const QString &clientToken = QString(),
+                     const QString &channel = QString()) override;
+
+    bool subscribeToChannel(const QString &channel) override;
+
+    bool unsubscribeFromChannel(const QString &channel) override;
+
+    QStringList channels() const;
+
+private:
+    friend class QCloudMessagingLoopbackProvider;
+
+    QScopedPointer<QCloudMessagingLoopbackClientPrivate> d;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGLOOPBACKCLIENT_H
@@ -0,0 +1,292 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qcloudmessagingloopbackprovider.h"
+#include "qcloudmessagingloopbackprovider_p.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+
+/*!
+    \class QCloudMessagingLoopbackProvider
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingLoopbackProvider class delivers messages
+    between clients of the same process.
+
+    Loopback provider needs no cloud service or SDK. Clients get a token
+    when they connect, and channels, tokens and broadcasts are routed in
+    memory:
+
+    \list
+    \li Message with a client token is delivered to the client owning the
+        token.
+    \li Message to a channel is delivered to every client subscribed to it.
+    \li Message with only a client id is delivered to that local client.
+    \endlist
+
+    Delivery is synchronous and the message payload is shared with every
+    receiver, it is never copied or serialized. The provider can be used
+    for publish-subscribe between components of an application, and for
+    measuring the QtCloudMessaging core without a cloud service.
+*/
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::QCloudMessagingLoopbackProvider
+ * \param parent
+ * QObject parent
+ */
+QCloudMessagingLoopbackProvider::QCloudMessagingLoopbackProvider(QObject *parent) :
+    QCloudMessagingProvider(parent),
+    d(new QCloudMessagingLoopbackProviderPrivate)
+{
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::~QCloudMessagingLoopbackProvider
+ */
+QCloudMessagingLoopbackProvider::~QCloudMessagingLoopbackProvider()
+{
+    deregisterProvider();
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::registerProvider
+ * Registering completes immediately, there is no service to connect to.
+ *
+ * \param providerId
+ * \param parameters
+ * \return
+ */
+bool QCloudMessagingLoopbackProvider::registerProvider(const QString &providerId,
+                                                       const QVariantMap &parameters)
+{
+    QCloudMessagingProvider::registerProvider(providerId, parameters);
+
+    setServiceState(QtCloudMessagingProviderRegistered);
+    emit serviceStateUpdated(QtCloudMessagingProviderRegistered);
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::deregisterProvider
+ * Removes the clients together with their tokens and subscriptions.
+ */
+void QCloudMessagingLoopbackProvider::deregisterProvider()
+{
+    QCloudMessagingProvider::deregisterProvider();
+
+    d->m_tokens.clear();
+    d->m_channels.clear();
+    d->m_generation++;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::connectClient
+ * Creates a loopback client. The client token is read from the
+ * \c client_token parameter, by default it is the provider id and client id
+ * joined with a slash. Channels in the \c channels string list parameter
+ * are subscribed right away.
+ *
+ * \param clientId
+ * \param parameters
+ * \return
+ * Client id, or empty string if the provider is not registered.
+ */
+QString QCloudMessagingLoopbackProvider::connectClient(const QString &clientId,
+                                                       const QVariantMap &parameters)
+{
+    if (providerId().isEmpty() || clientId.isEmpty())
+        return QString();
+
+    if (client(clientId))
+        return clientId;
+
+    QCloudMessagingLoopbackClient *serviceClient = new QCloudMessagingLoopbackClient(this);
+    return connectClientToProvider(clientId, parameters, serviceClient);
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::sendMessage
+ * Delivers the message to the owner of \a clientToken, to the subscribers
+ * of \a channel or to the local client \a clientId, in this order.
+ *
+ * \param msg
+ * \param clientId
+ * \param clientToken
+ * \param channel
+ * \return
+ * false if the token or the client is not known. Channel messages are
+ * always accepted, also when the channel has no subscribers.
+ */
+bool QCloudMessagingLoopbackProvider::sendMessage(const QByteArray &msg,
+                                                  const QString &clientId,
+                                                  const QString &clientToken,
+                                                  const QString &channel)
+{
+    if (!clientToken.isEmpty()) {
+        QCloudMessagingLoopbackClient *receiver = d->m_tokens.value(clientToken, nullptr);
+        if (!receiver)
+            return false;
+
+        receiver->cloudMessageReceived(receiver->clientId(), msg);
+        return true;
+    }
+
+    if (!channel.isEmpty()) {
+        publish(channel, msg);
+        return true;
+    }
+
+    QCloudMessagingClient *receiver = client(clientId);
+    if (!receiver)
+        return false;
+
+    receiver->cloudMessageReceived(clientId, msg);
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::remoteClients
+ * Emits remoteClientsReceived with the tokens of the connected clients as
+ * a JSON array.
+ *
+ * \return
+ */
+bool QCloudMessagingLoopbackProvider::remoteClients()
+{
+    QJsonArray tokens;
+    for (auto it = d->m_tokens.constBegin(); it != d->m_tokens.constEnd(); ++it)
+        tokens.append(it.key());
+
+    emit remoteClientsReceived(QString::fromUtf8(QJsonDocument(tokens).toJson(QJsonDocument::Compact)));
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::subscribeToChannel
+ * \param channel
+ * \param clientId
+ * \return
+ * false if the client is not found or is already subscribed.
+ */
+bool QCloudMessagingLoopbackProvider::subscribeToChannel(const QString &channel,
+                                                         const QString &clientId)
+{
+    QCloudMessagingClient *subscriber = client(clientId);
+    if (subscriber)
+        return subscriber->subscribeToChannel(channel);
+
+    return false;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::unsubscribeFromChannel
+ * \param channel
+ * \param clientId
+ * \return
+ * false if the client is not found or was not subscribed.
+ */
+bool QCloudMessagingLoopbackProvider::unsubscribeFromChannel(const QString &channel,
+                                                             const QString &clientId)
+{
+    QCloudMessagingClient *subscriber = client(clientId);
+    if (subscriber)
+        return subscriber->unsubscribeFromChannel(channel);
+
+    return false;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::publish
+ * Delivers the message to every subscriber of the channel. The payload is
+ * shared with the receivers, not copied.
+ *
+ * \param channel
+ * \param msg
+ * \return
+ * Amount of subscribers the message was delivered to.
+ */
+int QCloudMessagingLoopbackProvider::publish(const QString &channel, const QByteArray &msg)
+{
+    const auto it = d->m_channels.constFind(channel);
+    if (it == d->m_channels.constEnd())
+        return 0;
+
+    // Shallow copy, receivers changing subscriptions detach the original.
+    const QVector<QCloudMessagingLoopbackClient *> subscribers = it.value();
+    const quint64 generation = d->m_generation;
+
+    int delivered = 0;
+    for (QCloudMessagingLoopbackClient *subscriber : subscribers) {
+        // A receiver unsubscribed or removed clients, skip the ones gone.
+        if (d->m_generation != generation && !d->isSubscribed(subscriber, channel))
+            continue;
+
+        subscriber->cloudMessageReceived(subscriber->clientId(), msg);
+        delivered++;
+    }
+    return delivered;
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::channels
+ * \return
+ * Channels with at least one subscriber.
+ */
+QStringList QCloudMessagingLoopbackProvider::channels() const
+{
+    return d->m_channels.keys();
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::subscriberCount
+ * \param channel
+ * \return
+ */
+int QCloudMessagingLoopbackProvider::subscriberCount(const QString &channel) const
+{
+    return d->m_channels.value(channel).count();
+}
+
+/*!
+ * \brief QCloudMessagingLoopbackProvider::clientForToken
+ * \param token
+ * \return
+ * Client owning the token, nullptr if not found.
+ */
+QCloudMessagingLoopbackClient *QCloudMessagingLoopbackProvider::clientForToken(const QString &token) const
+{
+    return d->m_tokens.value(token, nullptr);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCLOUDMESSAGINGLOOPBACKPROVIDER_H
+#define QCLOUDMESSAGINGLOOPBACKPROVIDER_H
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/qcloudmessagingprovider.h>
+#include <QtCloudMessaging/qcloudmessagingloopbackclient.h>
+#include <QObject>
+#include <QVariantMap>
+#include <QByteArray>
+#include <QStringList>
+#include <QScopedPointer>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingLoopbackProviderPrivate;
+
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingLoopbackProvider : public QCloudMessagingProvider
+{
+    Q_OBJECT
+public:
+
+    explicit QCloudMessagingLoopbackProvider(QObject *parent = nullptr);
+
+    ~QCloudMessagingLoopbackProvider();
+
+    bool registerProvider(const QString &providerId,
+                          const QVariantMap &parameters = QVariantMap()) override;
+
+    void deregisterProvider() override;
+
+    QString connectClient(const QString &clientId,
+                          const QVariantMap &parameters = QVariantMap()) override;
+
+    bool sendMessage(const QByteArray &msg,
+                     const QString &clientId = QString(),
+                     const QString &clientToken = QString(),
+                     const QString &channel = QString()) override;
+
+    bool remoteClients() override;
+
+    bool subscribeToChannel(const QString &channel,
+                            const QString &clientId = QString()) override;
+
+    bool unsubscribeFromChannel(const QString &channel,
+                                const QString &clientId = QString()) override;
+
+    int publish(const QString &channel, const QByteArray &msg);
+
+    QStringList channels() const;
+
+    int subscriberCount(const QString &channel) const;
+
+    QCloudMessagingLoopbackClient *clientForToken(const QString &token) const;
+
+private:
+    friend class QCloudMessagingLoopbackClient;
+
+    QScopedPointer<QCloudMessagingLoopbackProviderPrivate> d;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGLOOPBACKPROVIDER_H
@@ -0,0 +1,107 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCLOUDMESSAGINGLOOPBACKPROVIDER_P_H
+#define QCLOUDMESSAGINGLOOPBACKPROVIDER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingLoopbackClient;
+
+// Routing tables of the loopback provider. Each channel keeps a flat list
+// of its subscribers, so a broadcast is one hash lookup and a scan.
+class QCloudMessagingLoopbackProviderPrivate
+{
+public:
+    QCloudMessagingLoopbackProviderPrivate()
+        : m_generation(0)
+    {
+    }
+
+    ~QCloudMessagingLoopbackProviderPrivate() = default;
+
+    void setToken(QCloudMessagingLoopbackClient *client, const QString &previous,
+                  const QString &token)
+    {
+        if (!previous.isEmpty() && m_tokens.value(previous) == client)
+            m_tokens.remove(previous);
+        if (!token.isEmpty())
+            m_tokens.insert(token, client);
+    }
+
+    bool subscribe(QCloudMessagingLoopbackClient *client, const QString &channel)
+    {
+        QVector<QCloudMessagingLoopbackClient *> &subscribers = m_channels[channel];
+        if (subscribers.contains(client))
+            return false;
+        subscribers.append(client);
+        return true;
+    }
+
+    bool unsubscribe(QCloudMessagingLoopbackClient *client, const QString &channel)
+    {
+        const auto it = m_channels.find(channel);
+        if (it == m_channels.end() || !it.value().removeOne(client))
+            return false;
+        if (it.value().isEmpty())
+            m_channels.erase(it);
+
+        // Tells a broadcast in progress to recheck its receivers
+        m_generation++;
+        return true;
+    }
+
+    bool isSubscribed(QCloudMessagingLoopbackClient *client, const QString &channel) const
+    {
+        return m_channels.value(channel).contains(client);
+    }
+
+    QHash<QString, QCloudMessagingLoopbackClient *> m_tokens;
+    QHash<QString, QVector<QCloudMessagingLoopbackClient *> > m_channels;
+    quint64 m_generation;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGLOOPBACKPROVIDER_P_H
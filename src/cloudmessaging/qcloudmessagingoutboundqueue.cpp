@@ -0,0 +1,481 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qcloudmessagingoutboundqueue_p.h"
+
+#include <algorithm>
+
+/*!
+    \class QCloudMessagingOutboundQueue
+    \inmodule QtCloudMessaging
+    \internal
+
+    \brief The QCloudMessagingOutboundQueue class stores the outbound network
+    messages of QCloudMessagingRestApi.
+
+    Messages are kept in two intrusive FIFO lists, one for messages waiting
+    to be sent and one for messages waiting for the response. Every message
+    gets a 64-bit message id which is indexed with a hash. Enqueue, dequeue,
+    acknowledge and cancel are constant time operations.
+
+    Messages waiting for the retry are kept in a hashed timer wheel of
+    100 millisecond slots. Scheduling is a constant time operation and
+    advance() only visits the slots which have passed since the previous
+    call, so one coarse timer drives the retries of all messages.
+
+    Messages can also be parked to lists owned by the caller, for example
+    while their endpoint is throttled, and moved back to the front of the
+    pending messages later.
+*/
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::QCloudMessagingOutboundQueue
+ * Constructor
+ */
+QCloudMessagingOutboundQueue::QCloudMessagingOutboundQueue()
+    : m_scheduled_count(0),
+      m_parked_count(0),
+      m_wheel_tick(-1),
+      m_next_id(1)
+{
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::~QCloudMessagingOutboundQueue
+ * Destructor
+ */
+QCloudMessagingOutboundQueue::~QCloudMessagingOutboundQueue()
+{
+    clear();
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::enqueue
+ * Appends the message to the end of the pending messages. Message
+ * gets new message id and the uuid of the message is set to the
+ * message id.
+ *
+ * \param msg
+ * Network message
+ *
+ * \return
+ * Returns the stored entry.
+ */
+QCloudMessagingOutboundEntry *QCloudMessagingOutboundQueue::enqueue(
+        const QCloudMessagingNetworkMessage &msg)
+{
+    return create(m_next_id++, msg);
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::restore
+ * Appends the message replayed from the journal to the end of the
+ * pending messages. Message keeps its original message id and is
+ * marked as not loaded until its request and data are read from the
+ * journal.
+ *
+ * \param id
+ * Original message id
+ *
+ * \param msg
+ * Network message
+ *
+ * \return
+ * Returns the stored entry or nullptr if message id is already in use.
+ */
+QCloudMessagingOutboundEntry *QCloudMessagingOutboundQueue::restore(
+        quint64 id, const QCloudMessagingNetworkMessage &msg)
+{
+    if (id == 0 || m_index.contains(id))
+        return nullptr;
+
+    if (m_next_id <= id)
+        m_next_id = id + 1;
+
+    QCloudMessagingOutboundEntry *entry = create(id, msg);
+    entry->loaded = false;
+
+    return entry;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::nextPending
+ * Gets the oldest message waiting to be sent.
+ *
+ * \return
+ * Returns the entry or nullptr if no messages are waiting.
+ */
+QCloudMessagingOutboundEntry *QCloudMessagingOutboundQueue::nextPending() const
+{
+    return m_pending.first();
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::find
+ * Finds the message by the message id.
+ *
+ * \param id
+ * Message id
+ *
+ * \return
+ * Returns the entry or nullptr if not found.
+ */
+QCloudMessagingOutboundEntry *QCloudMessagingOutboundQueue::find(quint64 id) const
+{
+    return m_index.value(id, nullptr);
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::entries
+ * \return
+ * Returns all stored messages in the order they were queued.
+ */
+QVector<QCloudMessagingOutboundEntry *> QCloudMessagingOutboundQueue::entries() const
+{
+    QVector<QCloudMessagingOutboundEntry *> entries;
+    entries.reserve(m_index.count());
+    for (QCloudMessagingOutboundEntry *entry : m_index)
+        entries.append(entry);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const QCloudMessagingOutboundEntry *a, const QCloudMessagingOutboundEntry *b) {
+                  return a->id < b->id;
+              });
+    return entries;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::markInFlight
+ * Moves the pending message to the messages waiting for the response.
+ *
+ * \param entry
+ * Pending entry
+ */
+void QCloudMessagingOutboundQueue::markInFlight(QCloudMessagingOutboundEntry *entry)
+{
+    if (entry->state == QCloudMessagingOutboundEntry::InFlight)
+        return;
+
+    detach(entry);
+    m_in_flight.append(entry);
+    entry->state = QCloudMessagingOutboundEntry::InFlight;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::markPending
+ * Moves the message waiting for the response back to the end of the
+ * pending messages.
+ *
+ * \param entry
+ * In-flight entry
+ */
+void QCloudMessagingOutboundQueue::markPending(QCloudMessagingOutboundEntry *entry)
+{
+    if (entry->state == QCloudMessagingOutboundEntry::Pending)
+        return;
+
+    detach(entry);
+    m_pending.append(entry);
+    entry->state = QCloudMessagingOutboundEntry::Pending;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::schedule
+ * Moves the message to the timer wheel. Message is moved back to the
+ * end of the pending messages by advance() when its due time has passed.
+ *
+ * \param entry
+ * Stored entry
+ *
+ * \param due
+ * Time of the next attempt in milliseconds, on the same clock as
+ * given to advance().
+ */
+void QCloudMessagingOutboundQueue::schedule(QCloudMessagingOutboundEntry *entry, qint64 due)
+{
+    detach(entry);
+
+    // Slot which was already passed would wait for the full wheel round
+    const qint64 tick = qMax(due / WheelResolution, m_wheel_tick + 1);
+
+    entry->state = QCloudMessagingOutboundEntry::Scheduled;
+    entry->due = due;
+    m_wheel[tick % WheelSlots].append(entry);
+    m_scheduled_count++;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::advance
+ * Moves the scheduled messages which are due to the end of the pending
+ * messages. Only the wheel slots which have fully passed since the
+ * previous call are visited.
+ *
+ * \param now
+ * Current time in milliseconds
+ *
+ * \return
+ * Returns the amount of messages moved to pending.
+ */
+int QCloudMessagingOutboundQueue::advance(qint64 now)
+{
+    const qint64 lastTick = now / WheelResolution - 1;
+
+    if (m_scheduled_count == 0) {
+        m_wheel_tick = lastTick;
+        return 0;
+    }
+
+    // Visit every slot once if the timer has been stopped for a full round
+    const qint64 firstTick = qMax(m_wheel_tick + 1, lastTick - WheelSlots + 1);
+
+    int moved = 0;
+    for (qint64 tick = firstTick; tick <= lastTick && m_scheduled_count > 0; tick++) {
+        QCloudMessagingOutboundList &slot = m_wheel[tick % WheelSlots];
+        QCloudMessagingOutboundEntry *entry = slot.first();
+        while (entry) {
+            QCloudMessagingOutboundEntry *next = entry->next;
+            // Entries of the later wheel rounds stay in the slot
+            if (entry->due <= now) {
+                slot.remove(entry);
+                m_scheduled_count--;
+                m_pending.append(entry);
+                entry->state = QCloudMessagingOutboundEntry::Pending;
+                moved++;
+            }
+            entry = next;
+        }
+    }
+
+    m_wheel_tick = qMax(m_wheel_tick, lastTick);
+    return moved;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::park
+ * Moves the message to the list owned by the caller, for example the
+ * messages waiting for a throttled endpoint. Parked list is kept in the
+ * message id order, so the message keeps its place among the parked
+ * messages.
+ *
+ * \param entry
+ * Stored entry
+ *
+ * \param list
+ * Parked list
+ */
+void QCloudMessagingOutboundQueue::park(QCloudMessagingOutboundEntry *entry,
+                                        QCloudMessagingOutboundList *list)
+{
+    detach(entry);
+
+    // Newly parked messages are usually the newest ones
+    QCloudMessagingOutboundEntry *pos = list->last();
+    while (pos && pos->id > entry->id)
+        pos = pos->prev;
+
+    list->insertAfter(pos, entry);
+    entry->state = QCloudMessagingOutboundEntry::Parked;
+    m_parked_count++;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::unpark
+ * Moves the oldest parked messages to the front of the pending messages
+ * in their original order.
+ *
+ * \param list
+ * Parked list
+ *
+ * \param count
+ * Maximum amount of messages to move.
+ *
+ * \return
+ * Returns the amount of messages moved to pending.
+ */
+int QCloudMessagingOutboundQueue::unpark(QCloudMessagingOutboundList *list, int count)
+{
+    count = qMin(count, list->count());
+    if (count <= 0)
+        return 0;
+
+    QCloudMessagingOutboundEntry *entry = list->first();
+    for (int i = 1; i < count; i++)
+        entry = entry->next;
+
+    while (entry) {
+        QCloudMessagingOutboundEntry *prev = entry->prev;
+        list->remove(entry);
+        m_pending.prepend(entry);
+        entry->state = QCloudMessagingOutboundEntry::Pending;
+        entry = prev;
+    }
+
+    m_parked_count -= count;
+    return count;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::remove
+ * Removes the message by the message id.
+ *
+ * \param id
+ * Message id
+ *
+ * \return
+ * Returns true if message was found and removed.
+ */
+bool QCloudMessagingOutboundQueue::remove(quint64 id)
+{
+    QCloudMessagingOutboundEntry *entry = m_index.take(id);
+    if (!entry)
+        return false;
+
+    detach(entry);
+
+    delete entry;
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::remove
+ * Removes the stored entry.
+ *
+ * \param entry
+ * Stored entry
+ */
+void QCloudMessagingOutboundQueue::remove(QCloudMessagingOutboundEntry *entry)
+{
+    remove(entry->id);
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::clear
+ * Removes all messages. Message ids are not reused.
+ */
+void QCloudMessagingOutboundQueue::clear()
+{
+    // Parked lists are owned by the caller
+    for (QCloudMessagingOutboundEntry *entry : qAsConst(m_index))
+        entry->list->reset();
+
+    qDeleteAll(m_index);
+    m_index.clear();
+    m_scheduled_count = 0;
+    m_parked_count = 0;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::count
+ * \return
+ * Returns the amount of stored messages.
+ */
+int QCloudMessagingOutboundQueue::count() const
+{
+    return m_index.count();
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::pendingCount
+ * \return
+ * Returns the amount of messages waiting to be sent.
+ */
+int QCloudMessagingOutboundQueue::pendingCount() const
+{
+    return m_pending.count();
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::inFlightCount
+ * \return
+ * Returns the amount of messages waiting for the response.
+ */
+int QCloudMessagingOutboundQueue::inFlightCount() const
+{
+    return m_in_flight.count();
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::scheduledCount
+ * \return
+ * Returns the amount of messages waiting for the retry.
+ */
+int QCloudMessagingOutboundQueue::scheduledCount() const
+{
+    return m_scheduled_count;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::parkedCount
+ * \return
+ * Returns the amount of parked messages.
+ */
+int QCloudMessagingOutboundQueue::parkedCount() const
+{
+    return m_parked_count;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::create
+ * Private function to store new pending entry.
+ */
+QCloudMessagingOutboundEntry *QCloudMessagingOutboundQueue::create(
+        quint64 id, const QCloudMessagingNetworkMessage &msg)
+{
+    QCloudMessagingOutboundEntry *entry = new QCloudMessagingOutboundEntry;
+    entry->id = id;
+    entry->state = QCloudMessagingOutboundEntry::Pending;
+    entry->loaded = true;
+    entry->deadline = 0;
+    entry->due = 0;
+    entry->msg = msg;
+    entry->msg.uuid = QString::number(id);
+
+    m_index.insert(entry->id, entry);
+    m_pending.append(entry);
+
+    return entry;
+}
+
+/*!
+ * \brief QCloudMessagingOutboundQueue::detach
+ * Private function to unlink the entry from its current list.
+ */
+void QCloudMessagingOutboundQueue::detach(QCloudMessagingOutboundEntry *entry)
+{
+    if (entry->state == QCloudMessagingOutboundEntry::Scheduled)
+        m_scheduled_count--;
+    else if (entry->state == QCloudMessagingOutboundEntry::Parked)
+        m_parked_count--;
+
+    entry->list->remove(entry);
+}
+
+QT_END_NAMESPACE
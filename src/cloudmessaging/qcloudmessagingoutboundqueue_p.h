@@ -0,0 +1,208 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGOUTBOUNDQUEUE_P_H
+#define QCLOUDMESSAGINGOUTBOUNDQUEUE_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/qcloudmessagingrestapi.h>
+#include <QHash>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingOutboundList;
+
+class QCloudMessagingOutboundEntry
+{
+public:
+    enum State {
+        Pending,
+        InFlight,
+        Scheduled,
+        Parked
+    };
+
+    quint64 id;
+    State state;
+    bool loaded;
+    qint64 deadline;
+    qint64 due;
+    QCloudMessagingNetworkMessage msg;
+
+    QCloudMessagingOutboundList *list;
+    QCloudMessagingOutboundEntry *prev;
+    QCloudMessagingOutboundEntry *next;
+};
+
+class QCloudMessagingOutboundList
+{
+public:
+    QCloudMessagingOutboundList()
+        : m_head(nullptr), m_tail(nullptr), m_count(0)
+    {
+    }
+
+    void append(QCloudMessagingOutboundEntry *entry)
+    {
+        insertAfter(m_tail, entry);
+    }
+
+    void prepend(QCloudMessagingOutboundEntry *entry)
+    {
+        insertAfter(nullptr, entry);
+    }
+
+    // Inserts after pos, or to the head if pos is nullptr
+    void insertAfter(QCloudMessagingOutboundEntry *pos, QCloudMessagingOutboundEntry *entry)
+    {
+        entry->list = this;
+        entry->prev = pos;
+        entry->next = pos ? pos->next : m_head;
+        if (entry->next)
+            entry->next->prev = entry;
+        else
+            m_tail = entry;
+        if (pos)
+            pos->next = entry;
+        else
+            m_head = entry;
+        m_count++;
+    }
+
+    void remove(QCloudMessagingOutboundEntry *entry)
+    {
+        if (entry->prev)
+            entry->prev->next = entry->next;
+        else
+            m_head = entry->next;
+        if (entry->next)
+            entry->next->prev = entry->prev;
+        else
+            m_tail = entry->prev;
+        entry->list = nullptr;
+        entry->prev = nullptr;
+        entry->next = nullptr;
+        m_count--;
+    }
+
+    QCloudMessagingOutboundEntry *first() const { return m_head; }
+    QCloudMessagingOutboundEntry *last() const { return m_tail; }
+    int count() const { return m_count; }
+
+    void reset()
+    {
+        m_head = nullptr;
+        m_tail = nullptr;
+        m_count = 0;
+    }
+
+private:
+    QCloudMessagingOutboundEntry *m_head;
+    QCloudMessagingOutboundEntry *m_tail;
+    int m_count;
+};
+
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingOutboundQueue
+{
+public:
+    QCloudMessagingOutboundQueue();
+    ~QCloudMessagingOutboundQueue();
+
+    QCloudMessagingOutboundEntry *enqueue(const QCloudMessagingNetworkMessage &msg);
+
+    QCloudMessagingOutboundEntry *restore(quint64 id, const QCloudMessagingNetworkMessage &msg);
+
+    QCloudMessagingOutboundEntry *nextPending() const;
+
+    QCloudMessagingOutboundEntry *find(quint64 id) const;
+
+    QVector<QCloudMessagingOutboundEntry *> entries() const;
+
+    void markInFlight(QCloudMessagingOutboundEntry *entry);
+
+    void markPending(QCloudMessagingOutboundEntry *entry);
+
+    void schedule(QCloudMessagingOutboundEntry *entry, qint64 due);
+
+    int advance(qint64 now);
+
+    void park(QCloudMessagingOutboundEntry *entry, QCloudMessagingOutboundList *list);
+
+    int unpark(QCloudMessagingOutboundList *list, int count);
+
+    bool remove(quint64 id);
+
+    void remove(QCloudMessagingOutboundEntry *entry);
+
+    void clear();
+
+    int count() const;
+
+    int pendingCount() const;
+
+    int inFlightCount() const;
+
+    int scheduledCount() const;
+
+    int parkedCount() const;
+
+private:
+    Q_DISABLE_COPY(QCloudMessagingOutboundQueue)
+
+    enum {
+        WheelSlots = 512,
+        WheelResolution = 100
+    };
+
+    QCloudMessagingOutboundEntry *create(quint64 id, const QCloudMessagingNetworkMessage &msg);
+    void detach(QCloudMessagingOutboundEntry *entry);
+
+    QHash<quint64, QCloudMessagingOutboundEntry *> m_index;
+    QCloudMessagingOutboundList m_pending;
+    QCloudMessagingOutboundList m_in_flight;
+    QCloudMessagingOutboundList m_wheel[WheelSlots];
+    int m_scheduled_count;
+    int m_parked_count;
+    qint64 m_wheel_tick;
+    quint64 m_next_id;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGOUTBOUNDQUEUE_P_H
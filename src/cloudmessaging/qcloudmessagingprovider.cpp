@@ -28,7 +28,8 @@
 
 #include "qcloudmessagingprovider.h"
 #include "qcloudmessagingprovider_p.h"
-#include <QMapIterator>
+#include "qcloudmessagingclient_p.h"
+#include "qcloudmessaging.h"
 
 /*!
     \class QCloudMessagingProvider
@@ -46,6 +47,36 @@
 
 */
 
+/*!
+    \class QCloudMessagingBatchMessage
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingBatchMessage class is one message of the
+    batch sent with QCloudMessaging::sendMessages.
+
+    \c msg is the service specific message, usually JSON string.
+    Message is targeted straight to the client with \c clientToken, or
+    broadcasted to the subscribers of \c channel.
+*/
+
+/*!
+    \class QCloudMessagingClientHandle
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingClientHandle class refers to a connected
+    client without looking it up by id.
+
+    Handle is returned by QCloudMessaging::connectClient and
+    QCloudMessaging::clientHandle, and used with QCloudMessaging::sendMessage
+    on hot paths. It becomes invalid when the provider is deleted.
+
+    \c provider, \c client and isValid() may only be used in the thread
+    QCloudMessaging lives in. QCloudMessaging::sendMessage uses only the ids
+    of the handle, so copies of it can be used from any thread.
+*/
+
 QT_BEGIN_NAMESPACE
 
 /*!
@@ -131,6 +162,7 @@ QString QCloudMessagingProvider::connectClientToProvider(const QString &clientId
 
             connect(serviceClient, &QCloudMessagingClient::messageReceived,
                     this, &QCloudMessagingProvider::messageReceivedSlot);
+            serviceClient->d->m_provider = this;
 
             connect(serviceClient, &QCloudMessagingClient::clientTokenReceived,
                     this, &QCloudMessagingProvider::clientTokenReceived);
@@ -162,6 +194,22 @@ void QCloudMessagingProvider::messageReceivedSlot(const QString &clientId, const
     emit messageReceived(providerId(), clientId, message);
 }
 
+/*!
+ * \brief QCloudMessagingProvider::isMessageReceivedObserved
+ * Private function to check whether messageReceived has a receiver other
+ * than the relaying QCloudMessaging instances, or they have one.
+ *
+ * \return
+ */
+bool QCloudMessagingProvider::isMessageReceivedObserved()
+{
+    for (QCloudMessaging *relay : qAsConst(d->m_relays)) {
+        if (relay->isMessageReceivedObserved())
+            return true;
+    }
+    return receivers(SIGNAL(messageReceived(QString,QString,QByteArray))) > d->m_relays.size();
+}
+
 /*!
  * \brief QCloudMessagingProvider::disconnectClient
  * \param clientId
@@ -173,13 +221,13 @@ void QCloudMessagingProvider::disconnectClient(const QString &clientId,
 {
     Q_UNUSED(parameters);
 
-    if (!d->m_providerId.isEmpty() && d->m_QtCloudMessagingClients[clientId]) {
-        QCloudMessagingClient *client = d->m_QtCloudMessagingClients[clientId];
-
+    QCloudMessagingClient *client = d->m_QtCloudMessagingClients.value(clientId, nullptr);
+    if (!d->m_providerId.isEmpty() && client) {
         // Disconnect connections for the client
         disconnect(client);
+        client->d->m_provider = nullptr;
 
-        d->m_QtCloudMessagingClients[clientId]->disconnectClient();
+        client->disconnectClient();
     }
 
 }
@@ -191,12 +239,12 @@ void QCloudMessagingProvider::disconnectClient(const QString &clientId,
  */
 bool QCloudMessagingProvider::removeClient(const QString &clientId)
 {
-    if (!d->m_providerId.isEmpty() && d->m_QtCloudMessagingClients[clientId]) {
-        disconnectClient(clientId);
-        delete d->m_QtCloudMessagingClients.take(clientId);
-        return true;
-    }
-    return false;
+    if (d->m_providerId.isEmpty() || !d->m_QtCloudMessagingClients.value(clientId, nullptr))
+        return false;
+
+    disconnectClient(clientId);
+    delete d->m_QtCloudMessagingClients.take(clientId);
+    return true;
 }
 
 /*!
@@ -212,18 +260,71 @@ void QCloudMessagingProvider::deregisterProvider()
 {
     if (d->m_QtCloudMessagingClients.count()) {
 
-        QMapIterator<QString, QCloudMessagingClient *> i(d->m_QtCloudMessagingClients);
-
-        while (i.hasNext()) {
-            i.next();
-            removeClient(i.key());
-        }
+        // removeClient modifies the registry
+        const QStringList clientIds = d->m_QtCloudMessagingClients.keys();
+        for (const QString &clientId : clientIds)
+            removeClient(clientId);
 
         d->m_serviceState = CloudMessagingProviderState::QtCloudMessagingProviderNotRegistered;
         emit serviceStateUpdated(d->m_serviceState);
     }
 }
 
+/*!
+ * \brief QCloudMessagingProvider::sendMessages
+ * Sends a batch of messages. Each message is targeted to its client token
+ * or channel like in sendMessage.
+ * Default implementation calls sendMessage for every message. Providers
+ * can override this function to use the multicast or pipelined requests
+ * of the service.
+ *
+ * \param messages
+ * Messages with their targets
+ *
+ * \param clientId
+ * Mobile or IoT client identification string (defined by user) added for
+ * the provider
+ *
+ * \return
+ * Returns the amount of messages which were sent or queued successfully.
+ */
+int QCloudMessagingProvider::sendMessages(const QVector<QCloudMessagingBatchMessage> &messages,
+                                          const QString &clientId)
+{
+    int sent = 0;
+    for (const QCloudMessagingBatchMessage &message : messages) {
+        if (sendMessage(message.msg, clientId, message.clientToken, message.channel))
+            sent++;
+    }
+    return sent;
+}
+
+/*!
+ * \brief QCloudMessagingProvider::subscribeToChannels
+ * Subscribes client to several broadcast channels at once.
+ * Default implementation calls subscribeToChannel for every channel.
+ *
+ * \param channels
+ * Channel names as QStringList
+ *
+ * \param clientId
+ * Mobile or IoT client identification string (defined by user) added for
+ * the provider
+ *
+ * \return
+ * Returns the amount of channels subscribed.
+ */
+int QCloudMessagingProvider::subscribeToChannels(const QStringList &channels,
+                                                 const QString &clientId)
+{
+    int subscribed = 0;
+    for (const QString &channel : channels) {
+        if (subscribeToChannel(channel, clientId))
+            subscribed++;
+    }
+    return subscribed;
+}
+
 /*!
  * \brief QCloudMessagingProvider::flushMessageQueue
  * This function calls the service provider to clear clients message buffers.
@@ -235,11 +336,8 @@ void QCloudMessagingProvider::deregisterProvider()
 bool QCloudMessagingProvider::flushMessageQueue()
 {
     if (d->m_QtCloudMessagingClients.count()) {
-        QMapIterator<QString, QCloudMessagingClient *> i(d->m_QtCloudMessagingClients);
-        while (i.hasNext()) {
-            i.next();
-            d->m_QtCloudMessagingClients[i.key()]->flushMessageQueue();
-        }
+        for (QCloudMessagingClient *client : qAsConst(d->m_QtCloudMessagingClients))
+            client->flushMessageQueue();
         return true;
     }
     return false;
@@ -257,21 +355,22 @@ bool QCloudMessagingProvider::flushMessageQueue()
  */
 QString QCloudMessagingProvider::clientToken(const QString &clientId)
 {
-    if (!d->m_providerId.isEmpty() && d->m_QtCloudMessagingClients[clientId]) {
-        return d->m_QtCloudMessagingClients[clientId]->clientToken();
+    QCloudMessagingClient *client = d->m_QtCloudMessagingClients.value(clientId, nullptr);
+    if (!d->m_providerId.isEmpty() && client)
+        return client->clientToken();
 
-    }
     return QString();
 }
 
 /*!
  * \brief QCloudMessagingProvider::clients
  * Get client instances as key value pairs, where clientId is the key.
+ * The registry is a hash, clients are not in the order of their ids.
  *
  * \return
  * Client instances as key value pairs
  */
-QMap <QString, QCloudMessagingClient *>  *QCloudMessagingProvider::clients()
+QHash<QString, QCloudMessagingClient *> *QCloudMessagingProvider::clients()
 {
     return &d->m_QtCloudMessagingClients;
 }
@@ -288,10 +387,7 @@ QMap <QString, QCloudMessagingClient *>  *QCloudMessagingProvider::clients()
  */
 QCloudMessagingClient *QCloudMessagingProvider::client(const QString &clientId)
 {
-    if (d->m_QtCloudMessagingClients.find(clientId) == d->m_QtCloudMessagingClients.end())
-        return nullptr;
-
-    return d->m_QtCloudMessagingClients[clientId];
+    return d->m_QtCloudMessagingClients.value(clientId, nullptr);
 }
 
 /*!
@@ -31,14 +31,26 @@
 
 #include <QObject>
 #include <QVariantMap>
-#include <QMap>
+#include <QHash>
+#include <QPointer>
 #include <QString>
+#include <QVector>
 #include <QScopedPointer>
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
 #include <QtCloudMessaging/qcloudmessagingclient.h>
 
 QT_BEGIN_NAMESPACE
 
+class QCloudMessaging;
+
+class QCloudMessagingBatchMessage
+{
+public:
+    QByteArray msg;
+    QString clientToken;
+    QString channel;
+};
+
 /*!
  * \brief The QtCloudMessagingProvider class
  */
@@ -80,9 +92,13 @@ public:
             const QString &clientToken = QString(),
             const QString &channel = QString()) = 0;
 
+    virtual int sendMessages(
+            const QVector<QCloudMessagingBatchMessage> &messages,
+            const QString &clientId = QString());
+
     virtual CloudMessagingProviderState setServiceState(QCloudMessagingProvider::CloudMessagingProviderState state);
 
-    virtual QMap <QString, QCloudMessagingClient *>  *clients();
+    virtual QHash<QString, QCloudMessagingClient *> *clients();
 
     QString clientToken(const QString &clientId);
 
@@ -106,6 +122,10 @@ public:
             const QString &channel,
             const QString &clientId = QString()) = 0;
 
+    virtual int subscribeToChannels(
+            const QStringList &channels,
+            const QString &clientId = QString());
+
 
     bool flushMessageQueue();
 
@@ -134,7 +154,23 @@ Q_SIGNALS:
 
 
 private:
+    bool isMessageReceivedObserved();
+
     QScopedPointer<QCloudMessagingProviderPrivate> d;
+
+    friend class QCloudMessagingClient;
+    friend class QCloudMessaging;
+};
+
+class QCloudMessagingClientHandle
+{
+public:
+    bool isValid() const { return !provider.isNull(); }
+
+    QPointer<QCloudMessagingProvider> provider;
+    QPointer<QCloudMessagingClient> client;
+    QString providerId;
+    QString clientId;
 };
 
 QT_END_NAMESPACE
@@ -39,12 +39,14 @@
 // We mean it.
 //
 
-#include <QMap>
+#include <QHash>
 #include <QVariantMap>
+#include <QVector>
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
 
 QT_BEGIN_NAMESPACE
 
+class QCloudMessaging;
 class QCloudMessagingClient;
 class QCloudMessagingProvider;
 
@@ -62,7 +64,11 @@ public:
     int m_serviceState;
 
     QVariantMap m_provider_parameters;
-    QMap <QString, QCloudMessagingClient *> m_QtCloudMessagingClients;
+    QHash<QString, QCloudMessagingClient *> m_QtCloudMessagingClients;
+
+    // QCloudMessaging instances relaying messageReceived. They remove
+    // themselves when deregistering the provider, before being deleted.
+    QVector<QCloudMessaging *> m_relays;
 
 };
 
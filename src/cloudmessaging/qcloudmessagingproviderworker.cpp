@@ -0,0 +1,256 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qcloudmessagingproviderworker_p.h"
+#include "qcloudmessagingprovider.h"
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingProviderWorker::QCloudMessagingProviderWorker
+ * \param provider
+ * Provider run by this worker. Provider must not have a parent.
+ * \param queueSize
+ * Capacity of the submission ring.
+ * \param policy
+ * What happens when producers fill the ring faster than the provider
+ * sends.
+ */
+QCloudMessagingProviderWorker::QCloudMessagingProviderWorker(
+        QCloudMessagingProvider *provider, int queueSize,
+        QCloudMessagingSubmissionQueue::OverflowPolicy policy) :
+    m_provider(provider),
+    m_queue(queueSize, policy)
+{
+    m_thread.setObjectName(QStringLiteral("QCloudMessagingProviderWorker"));
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::~QCloudMessagingProviderWorker
+ */
+QCloudMessagingProviderWorker::~QCloudMessagingProviderWorker()
+{
+    stop();
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::provider
+ * \return
+ */
+QCloudMessagingProvider *QCloudMessagingProviderWorker::provider() const
+{
+    return m_provider;
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::isRunning
+ * \return
+ */
+bool QCloudMessagingProviderWorker::isRunning() const
+{
+    return m_thread.isRunning();
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::start
+ * Moves the provider and the worker to the worker thread and starts it.
+ * Must be called from the thread the provider lives in.
+ */
+void QCloudMessagingProviderWorker::start()
+{
+    if (m_thread.isRunning())
+        return;
+
+    m_stopping.store(0);
+    m_provider->moveToThread(&m_thread);
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::stop
+ * Sends the messages still queued, hands the provider and the worker back
+ * to the calling thread and waits for the worker thread to finish.
+ */
+void QCloudMessagingProviderWorker::stop()
+{
+    if (!m_thread.isRunning())
+        return;
+
+    // Refuse new submissions, doStop waits for the ones in progress.
+    m_stopping.fetchAndStoreOrdered(1);
+
+    QThread *current = QThread::currentThread();
+    if (current == &m_thread) {
+        // Stopped from a provider slot, the thread can only be asked to quit.
+        doStop(current);
+        m_thread.quit();
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, [this, current] { doStop(current); },
+                              Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::flush
+ * Returns once every message submitted before the call has been handed to
+ * the provider.
+ */
+void QCloudMessagingProviderWorker::flush()
+{
+    if (thread() == QThread::currentThread())
+        drainAll();
+    else if (m_thread.isRunning())
+        QMetaObject::invokeMethod(this, [this] { drainAll(); }, Qt::BlockingQueuedConnection);
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::drainAll
+ * Sends every queued message without returning to the event loop. Must be
+ * called in the thread the worker lives in.
+ */
+void QCloudMessagingProviderWorker::drainAll()
+{
+    // A slot claimed by a producer but not yet published blocks the ring;
+    // give the producer a chance to finish instead of spinning.
+    while (!m_queue.isEmpty()) {
+        if (sendQueued(-1) == 0)
+            QThread::yieldCurrentThread();
+    }
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::submit
+ * Queues the message for the provider thread. Safe to call from any thread,
+ * the message payload and strings are shared, not copied.
+ *
+ * \param msg
+ * \param clientId
+ * \param clientToken
+ * \param channel
+ * \return
+ * false if the submission ring was full and the message was dropped, or
+ * the worker is stopping.
+ */
+bool QCloudMessagingProviderWorker::submit(const QByteArray &msg, const QString &clientId,
+                                           const QString &clientToken, const QString &channel)
+{
+    m_producers.ref();
+    if (m_stopping.load()) {
+        m_producers.deref();
+        return false;
+    }
+
+    const bool queued = m_queue.push([&](QCloudMessagingSubmission &slot) {
+        slot.msg = msg;
+        slot.clientId = clientId;
+        slot.clientToken = clientToken;
+        slot.channel = channel;
+    });
+
+    if (queued && m_wakeup.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+
+    m_producers.deref();
+    return queued;
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::pendingCount
+ * \return
+ * Amount of messages waiting for the provider thread.
+ */
+int QCloudMessagingProviderWorker::pendingCount() const
+{
+    return m_queue.count();
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::droppedCount
+ * \return
+ * Amount of messages dropped because the submission ring was full.
+ */
+quint32 QCloudMessagingProviderWorker::droppedCount() const
+{
+    return m_queue.droppedCount();
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::drain
+ * Sends queued messages in order. A long burst is sent in batches of one
+ * ring size to keep the provider's event loop responsive.
+ */
+void QCloudMessagingProviderWorker::drain()
+{
+    // Clear first, a message queued after this wakes us again.
+    m_wakeup.store(0);
+
+    sendQueued(m_queue.capacity());
+
+    if (!m_queue.isEmpty() && m_wakeup.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::sendQueued
+ * Hands published messages to the provider in order.
+ * \param max
+ * Maximum amount of messages to send, -1 for no limit.
+ * \return
+ * Amount of messages sent.
+ */
+int QCloudMessagingProviderWorker::sendQueued(int max)
+{
+    return m_queue.drain([this](QCloudMessagingSubmission &slot) {
+        m_provider->sendMessage(slot.msg, slot.clientId, slot.clientToken, slot.channel);
+        // Release the payload now instead of when the slot is reused.
+        slot.msg.clear();
+    }, max);
+}
+
+/*!
+ * \brief QCloudMessagingProviderWorker::doStop
+ * \param target
+ * Thread the provider and the worker are handed back to.
+ */
+void QCloudMessagingProviderWorker::doStop(QThread *target)
+{
+    // Producers which passed the stopping check may be waiting for room.
+    drainAll();
+    while (m_producers.load() > 0) {
+        QThread::yieldCurrentThread();
+        drainAll();
+    }
+    m_provider->moveToThread(target);
+    moveToThread(target);
+}
+
+QT_END_NAMESPACE
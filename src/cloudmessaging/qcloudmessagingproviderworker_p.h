@@ -0,0 +1,117 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+#ifndef QCLOUDMESSAGINGPROVIDERWORKER_P_H
+#define QCLOUDMESSAGINGPROVIDERWORKER_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/private/qcloudmessagingringbuffer_p.h>
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingProvider;
+
+// Message slot of the submission ring, strings are implicitly shared.
+class QCloudMessagingSubmission
+{
+public:
+    QByteArray msg;
+    QString clientId;
+    QString clientToken;
+    QString channel;
+};
+
+typedef QCloudMessagingRingBuffer<QCloudMessagingSubmission>
+        QCloudMessagingSubmissionQueue;
+
+/*
+ * Runs one provider on its own thread. Any thread may submit messages; they
+ * go through a lock-free ring and the provider thread is woken once per
+ * batch to send them in submission order. The worker and the provider live
+ * on the worker thread between start and stop, stop hands both back to the
+ * calling thread. Producers may still hold the worker after stop, their
+ * submissions are then refused.
+ */
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingProviderWorker : public QObject
+{
+    Q_OBJECT
+public:
+    enum { DefaultQueueSize = 4096 };
+
+    explicit QCloudMessagingProviderWorker(QCloudMessagingProvider *provider,
+                                           int queueSize = DefaultQueueSize,
+                                           QCloudMessagingSubmissionQueue::OverflowPolicy policy =
+                                                QCloudMessagingSubmissionQueue::DropNewest);
+    ~QCloudMessagingProviderWorker();
+
+    QCloudMessagingProvider *provider() const;
+    bool isRunning() const;
+
+    void start();
+    void stop();
+    void flush();
+    void drainAll();
+
+    bool submit(const QByteArray &msg, const QString &clientId,
+                const QString &clientToken, const QString &channel);
+
+    int pendingCount() const;
+    quint32 droppedCount() const;
+
+private Q_SLOTS:
+    void drain();
+
+private:
+    int sendQueued(int max);
+    void doStop(QThread *target);
+
+    QCloudMessagingProvider *m_provider;
+    QThread m_thread;
+    QCloudMessagingSubmissionQueue m_queue;
+    QAtomicInt m_wakeup;
+    QAtomicInt m_stopping;
+    QAtomicInt m_producers;
+
+    Q_DISABLE_COPY(QCloudMessagingProviderWorker)
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGPROVIDERWORKER_P_H
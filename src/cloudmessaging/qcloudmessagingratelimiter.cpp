@@ -0,0 +1,315 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#include "qcloudmessagingratelimiter_p.h"
+
+#include <QLocale>
+
+#include <climits>
+
+/*!
+    \class QCloudMessagingRateLimiter
+    \inmodule QtCloudMessaging
+    \internal
+
+    \brief The QCloudMessagingRateLimiter class keeps the send rate of
+    QCloudMessagingRestApi within the limits of the servers.
+
+    Every host has its own endpoint with a token bucket. Limit can also be
+    set for one request id of the host, in which case the request kind has
+    its own endpoint. Endpoint is blocked when the server responds with
+    \c Retry-After. Messages waiting for the endpoint are parked in the
+    endpoint and do not block the messages to other endpoints.
+
+    Endpoint of the host also keeps the circuit breaker state, which is
+    shared by the request specific endpoints of the host.
+*/
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingRateLimiter::QCloudMessagingRateLimiter
+ * Constructor
+ */
+QCloudMessagingRateLimiter::QCloudMessagingRateLimiter()
+    : m_request_limits(false)
+{
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::~QCloudMessagingRateLimiter
+ * Destructor
+ */
+QCloudMessagingRateLimiter::~QCloudMessagingRateLimiter()
+{
+    qDeleteAll(m_endpoint_list);
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::setLimit
+ * Sets the token bucket of the endpoint.
+ *
+ * \param host
+ * Host of the request url
+ *
+ * \param req_id
+ * Request id which gets its own endpoint, or -1 for all requests
+ * of the host.
+ *
+ * \param rate
+ * Sustained rate in requests per second. Zero means unlimited.
+ *
+ * \param burst
+ * Amount of requests which can be sent at once.
+ */
+void QCloudMessagingRateLimiter::setLimit(const QString &host, int req_id,
+                                          qreal rate, int burst)
+{
+    const QString key = req_id < 0 ? host : requestKey(host, req_id);
+
+    QCloudMessagingEndpoint *endpoint = m_endpoints.value(key);
+    if (!endpoint)
+        endpoint = create(key, host);
+
+    endpoint->rate = qMax(qreal(0), rate);
+    endpoint->burst = qMax(1, burst);
+    endpoint->tokens = endpoint->burst;
+    endpoint->refilled = 0;
+
+    if (req_id >= 0)
+        m_request_limits = true;
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::endpoint
+ * Gets the endpoint of the request. Endpoint of the host is created
+ * when the host is used for the first time.
+ *
+ * \param host
+ * Host of the request url
+ *
+ * \param req_id
+ * Request id of the message
+ *
+ * \return
+ * Returns the endpoint.
+ */
+QCloudMessagingEndpoint *QCloudMessagingRateLimiter::endpoint(const QString &host, int req_id)
+{
+    if (m_request_limits) {
+        QCloudMessagingEndpoint *endpoint = m_endpoints.value(requestKey(host, req_id));
+        if (endpoint)
+            return endpoint;
+    }
+
+    QCloudMessagingEndpoint *endpoint = m_endpoints.value(host);
+    if (!endpoint)
+        endpoint = create(host, host);
+    return endpoint;
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::findEndpoint
+ * Gets the endpoint of the host without creating it.
+ *
+ * \param host
+ * Host of the request url
+ *
+ * \return
+ * Returns the endpoint, or nullptr if the host has not been used.
+ */
+QCloudMessagingEndpoint *QCloudMessagingRateLimiter::findEndpoint(const QString &host) const
+{
+    return m_endpoints.value(host);
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::available
+ * \param endpoint
+ * Endpoint
+ *
+ * \param now
+ * Current time in milliseconds
+ *
+ * \return
+ * Returns the amount of requests which can be sent to the endpoint now.
+ */
+int QCloudMessagingRateLimiter::available(QCloudMessagingEndpoint *endpoint, qint64 now)
+{
+    if (now < endpoint->blocked_until)
+        return 0;
+
+    if (endpoint->rate <= 0)
+        return INT_MAX;
+
+    refill(endpoint, now);
+    return int(endpoint->tokens);
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::tryAcquire
+ * Takes a token from the endpoint.
+ *
+ * \param endpoint
+ * Endpoint
+ *
+ * \param now
+ * Current time in milliseconds
+ *
+ * \return
+ * Returns true if request can be sent.
+ */
+bool QCloudMessagingRateLimiter::tryAcquire(QCloudMessagingEndpoint *endpoint, qint64 now)
+{
+    if (now < endpoint->blocked_until)
+        return false;
+
+    if (endpoint->rate <= 0)
+        return true;
+
+    refill(endpoint, now);
+    if (endpoint->tokens < 1)
+        return false;
+
+    endpoint->tokens -= 1;
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::block
+ * Blocks the endpoint. Bucket is emptied, so that the requests are
+ * resumed at the sustained rate.
+ *
+ * \param endpoint
+ * Endpoint
+ *
+ * \param until
+ * Time in milliseconds when the endpoint can be used again.
+ */
+void QCloudMessagingRateLimiter::block(QCloudMessagingEndpoint *endpoint, qint64 until)
+{
+    endpoint->blocked_until = qMax(endpoint->blocked_until, until);
+    endpoint->tokens = qMin(endpoint->tokens, qreal(1));
+    endpoint->refilled = endpoint->blocked_until;
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::endpoints
+ * \return
+ * Returns all the endpoints.
+ */
+const QList<QCloudMessagingEndpoint *> &QCloudMessagingRateLimiter::endpoints() const
+{
+    return m_endpoint_list;
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::parseRetryAfter
+ * Parses the value of the \c Retry-After header. Value is either delay
+ * in seconds or HTTP date.
+ *
+ * \param value
+ * Header value
+ *
+ * \param now
+ * Current time
+ *
+ * \return
+ * Returns the delay in milliseconds, or -1 if value is invalid.
+ */
+qint64 QCloudMessagingRateLimiter::parseRetryAfter(const QByteArray &value, const QDateTime &now)
+{
+    const QByteArray trimmed = value.trimmed();
+    if (trimmed.isEmpty())
+        return -1;
+
+    bool ok = false;
+    const qint64 seconds = trimmed.toLongLong(&ok);
+    if (ok)
+        return seconds >= 0 ? seconds * 1000 : -1;
+
+    // IMF-fixdate, for example "Wed, 21 Oct 2015 07:28:00 GMT"
+    const QString text = QString::fromLatin1(trimmed);
+    QDateTime date = QLocale::c().toDateTime(text, QStringLiteral("ddd, dd MMM yyyy HH:mm:ss 'GMT'"));
+    if (!date.isValid())
+        date = QDateTime::fromString(text, Qt::RFC2822Date);
+    if (!date.isValid())
+        return -1;
+
+    date.setTimeSpec(Qt::UTC);
+    return qMax(qint64(0), now.msecsTo(date));
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::requestKey
+ * Private function to get the key of the request specific endpoint.
+ */
+QString QCloudMessagingRateLimiter::requestKey(const QString &host, int req_id)
+{
+    return host + QLatin1Char('#') + QString::number(req_id);
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::create
+ * Private function to create the unlimited endpoint.
+ */
+QCloudMessagingEndpoint *QCloudMessagingRateLimiter::create(const QString &key,
+                                                            const QString &host)
+{
+    QCloudMessagingEndpoint *endpoint = new QCloudMessagingEndpoint;
+    endpoint->host = host;
+    m_endpoints.insert(key, endpoint);
+    m_endpoint_list.append(endpoint);
+
+    if (key == host) {
+        endpoint->circuit = endpoint;
+    } else {
+        QCloudMessagingEndpoint *hostEndpoint = m_endpoints.value(host);
+        endpoint->circuit = hostEndpoint ? hostEndpoint : create(host, host);
+    }
+
+    return endpoint;
+}
+
+/*!
+ * \brief QCloudMessagingRateLimiter::refill
+ * Private function to add the tokens earned since the previous refill.
+ */
+void QCloudMessagingRateLimiter::refill(QCloudMessagingEndpoint *endpoint, qint64 now)
+{
+    if (now <= endpoint->refilled)
+        return;
+
+    endpoint->tokens = qMin(qreal(endpoint->burst),
+                            endpoint->tokens + (now - endpoint->refilled) * endpoint->rate / 1000);
+    endpoint->refilled = now;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,117 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef QCLOUDMESSAGINGRATELIMITER_P_H
+#define QCLOUDMESSAGINGRATELIMITER_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/private/qcloudmessagingoutboundqueue_p.h>
+#include <QDateTime>
+#include <QHash>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingEndpoint
+{
+public:
+    QCloudMessagingEndpoint()
+        : rate(0), burst(1), tokens(0), refilled(0), blocked_until(0),
+          circuit(nullptr), circuit_state(0), circuit_opened(0),
+          window_start(0), window_requests(0), window_failures(0),
+          probes_in_flight(0), probe_successes(0)
+    {
+    }
+
+    QString host;
+    qreal rate;
+    int burst;
+    qreal tokens;
+    qint64 refilled;
+    qint64 blocked_until;
+    QCloudMessagingOutboundList parked;
+
+    // Circuit breaker is kept in the endpoint of the host
+    QCloudMessagingEndpoint *circuit;
+    int circuit_state;
+    qint64 circuit_opened;
+    qint64 window_start;
+    int window_requests;
+    int window_failures;
+    int probes_in_flight;
+    int probe_successes;
+};
+
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingRateLimiter
+{
+public:
+    QCloudMessagingRateLimiter();
+    ~QCloudMessagingRateLimiter();
+
+    void setLimit(const QString &host, int req_id, qreal rate, int burst);
+
+    QCloudMessagingEndpoint *endpoint(const QString &host, int req_id);
+
+    QCloudMessagingEndpoint *findEndpoint(const QString &host) const;
+
+    int available(QCloudMessagingEndpoint *endpoint, qint64 now);
+
+    bool tryAcquire(QCloudMessagingEndpoint *endpoint, qint64 now);
+
+    void block(QCloudMessagingEndpoint *endpoint, qint64 until);
+
+    const QList<QCloudMessagingEndpoint *> &endpoints() const;
+
+    static qint64 parseRetryAfter(const QByteArray &value, const QDateTime &now);
+
+private:
+    Q_DISABLE_COPY(QCloudMessagingRateLimiter)
+
+    static QString requestKey(const QString &host, int req_id);
+    void refill(QCloudMessagingEndpoint *endpoint, qint64 now);
+
+    QCloudMessagingEndpoint *create(const QString &key, const QString &host);
+
+    QHash<QString, QCloudMessagingEndpoint *> m_endpoints;
+    QList<QCloudMessagingEndpoint *> m_endpoint_list;
+    bool m_request_limits;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGRATELIMITER_P_H
@@ -28,12 +28,16 @@
 
 #include "qcloudmessagingrestapi.h"
 #include "qcloudmessagingrestapi_p.h"
-#include <QUuid>
+#include "qcloudmessagingoutboundqueue_p.h"
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QAuthenticator>
 #include <QTimer>
+#include <QRandomGenerator>
+#include <QDateTime>
+
+#include <climits>
 
 /*!
     \class QCloudMessagingRestApi
@@ -52,6 +56,73 @@
     QCloudMessagingRestApi
     class and then implement the virtual function to receive responses.
 
+    By default every message is sent once. When
+    QCloudMessagingRetryPolicy::maxAttempts is raised, queued messages
+    which fail with a network error, a timeout or a 5xx response are
+    retried with exponential backoff. Only the final outcome of the
+    message is delivered to xmlHttpRequestReply.
+
+    Every host has a circuit breaker. When the failure rate of the host
+    exceeds QCloudMessagingCircuitBreakerPolicy::failureThreshold, the
+    circuit opens and the messages to the host wait in the queue, or fail
+    immediately, without using the network. After
+    QCloudMessagingCircuitBreakerPolicy::openDuration the circuit is
+    half-open and probe requests decide whether it is closed again.
+
+*/
+
+/*!
+    \class QCloudMessagingRetryPolicy
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingRetryPolicy class defines how the failed
+    queued messages of QCloudMessagingRestApi are retried.
+
+    \list
+    \li \c maxAttempts - maximum amount of sends per message, at least 1.
+        Default is 1. Retried POST requests may be delivered twice by the
+        server, raise it only for idempotent requests or servers which
+        deduplicate them.
+    \li \c initialBackoff - delay before the first retry in milliseconds.
+        Default is 1000.
+    \li \c maxBackoff - upper limit of the delay in milliseconds.
+        Default is 60000.
+    \li \c multiplier - growth of the delay per attempt. Default is 2.0.
+    \li \c jitter - fraction of the delay which is randomized, from 0.0
+        to 1.0. Default is 0.2.
+    \li \c deadline - time in milliseconds from queueing after which the
+        message is dropped and networkMessageExpired() is emitted. Zero
+        means no deadline, which is the default.
+    \endlist
+*/
+
+/*!
+    \class QCloudMessagingCircuitBreakerPolicy
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingCircuitBreakerPolicy class defines when the
+    circuit breaker of a QCloudMessagingRestApi host opens.
+
+    \list
+    \li \c enabled - whether the circuit breaker is used. Default is true.
+    \li \c failureThreshold - failure rate from 0.0 to 1.0 which opens the
+        circuit. Default is 0.5.
+    \li \c minimumRequests - amount of requests in the window before the
+        failure rate is evaluated. Default is 10.
+    \li \c window - length of the measuring window in milliseconds.
+        Default is 30000.
+    \li \c openDuration - time in milliseconds the circuit stays open
+        before probing. Default is 30000.
+    \li \c probeRequests - amount of successful probe requests needed to
+        close the half-open circuit. Default is 1.
+    \li \c failFast - if true, messages to the open circuit are expired
+        immediately. If false, they wait in the queue. Default is false.
+    \endlist
+
+    Network errors, timeouts and 408 or 5xx responses are counted as
+    failures.
 */
 
 QT_BEGIN_NAMESPACE
@@ -67,10 +138,15 @@ QCloudMessagingRestApi::QCloudMessagingRestApi(QObject *parent) :
     QObject(parent),
     d(new QCloudMessagingRestApiPrivate)
 {
-    d->m_wait_for_last_request_response = false;
-    d->m_waiting_counter = 0;
+    d->m_clock.start();
+
+    // Children follow the REST interface when its provider is moved to a
+    // worker thread.
+    d->m_manager.setParent(this);
+    d->m_msgTimer.setParent(this);
 
 #ifndef QT_NO_BEARERMANAGEMENT
+    d->m_network_info.setParent(this);
     d->m_online_state = d->m_network_info.isOnline();
 
     connect(&(d->m_network_info), &QNetworkConfigurationManager::onlineStateChanged,
@@ -87,10 +163,12 @@ QCloudMessagingRestApi::QCloudMessagingRestApi(QObject *parent) :
 
 /*!
  * \brief QCloudMessagingRestApi::~QCloudMessagingRestApi
- * Destructor
+ * Destructor. Messages in the journal are kept for the next start.
  */
 QCloudMessagingRestApi::~QCloudMessagingRestApi()
 {
+    // Parked messages are unlinked while the endpoints still exist
+    d->m_network_requests.clear();
 }
 
 /*!
@@ -98,9 +176,10 @@ QCloudMessagingRestApi::~QCloudMessagingRestApi()
  * Sets rest server message retry and timeouts.
  *
  * \param messageTimer
- * Timeout to wait before sending the next message.
- * Same timeout is used for waiting response from the server.
- * Useful when sending lot of message in fast sequency.
+ * Interval of the message queue timer. Queued messages are sent when
+ * the timer triggers or when a reply frees a slot in the in-flight
+ * window, see setMaxInFlightRequests().
+ * Same interval is used for checking the response timeouts.
  * Default is 800 milliseconds.
  *
  * \param waitForResponseCounter
@@ -110,8 +189,9 @@ QCloudMessagingRestApi::~QCloudMessagingRestApi()
  * Default is 3 times = 3 x 800 ms = 2400 ms
  *
  * \param messageRetryCount
- * Describes how many times the message sending is retried if
- * no response from the server.
+ * Describes how many times the message is sent if no response from
+ * the server. Same as QCloudMessagingRetryPolicy::maxAttempts, values
+ * smaller than 1 are raised to 1.
  */
 void QCloudMessagingRestApi::setServerTimers(int messageTimer,
                                              int waitForResponseCounter,
@@ -139,10 +219,50 @@ void QCloudMessagingRestApi::provideAuthentication(
     Q_UNUSED(authenticator);
 }
 
+/*!
+ * \brief QCloudMessagingRestApi::xmlHttpRequestReply
+ * Delivers the finished reply to the deprecated xmlHttpRequestReply
+ * overload. Request id, uuid and info of the request are set to the
+ * \c req_id, \c uuid and \c info properties of the reply, as the
+ * previous versions did.
+ *
+ * \param reply
+ * Finished QNetworkReply instance
+ *
+ * \param context
+ * Request context of the reply
+ */
+void QCloudMessagingRestApi::xmlHttpRequestReply(QNetworkReply *reply,
+                                                 const QCloudMessagingRequestContext &context)
+{
+    reply->setProperty("req_id", context.req_id);
+    reply->setProperty("uuid", context.uuid);
+    reply->setProperty("info", context.info);
+
+    xmlHttpRequestReply(reply);
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::xmlHttpRequestReply
+ * \obsolete
+ * Reimplement xmlHttpRequestReply(QNetworkReply *, const QCloudMessagingRequestContext &)
+ * instead. Reply is delivered to this function only if the request
+ * context overload is not reimplemented. Reply is delivered exactly once
+ * and deleted by QCloudMessagingRestApi after the function returns, so
+ * the finished signal of the network manager must not be connected.
+ *
+ * \param reply
+ * Finished QNetworkReply instance
+ */
+void QCloudMessagingRestApi::xmlHttpRequestReply(QNetworkReply *reply)
+{
+    Q_UNUSED(reply);
+}
+
 /*!
  * \brief QCloudMessagingRestApi::xmlHttpPostRequest
  * Private function to send Post specific message to server.
- * Connects to virtualized xmlHttpRequestReply function.
+ * Reply is delivered to virtualized xmlHttpRequestReply function.
  *
  * \param request
  * QNetworkRequest instance
@@ -157,7 +277,7 @@ void QCloudMessagingRestApi::provideAuthentication(
  * Unique uuid for internal message array manipulation.
  *
  * \param info
- * Additional info to provide via QNetworkReply instance
+ * Additional info to provide via QCloudMessagingRequestContext
  *
  * \return
  * Returns updated QNetworkReply instance after sending the post message.
@@ -171,14 +291,9 @@ QCloudMessagingRestApi::xmlHttpPostRequest(
         const QString &info)
 {
 
-    connect(&d->m_manager, &QNetworkAccessManager::finished,
-            this, &QCloudMessagingRestApi::xmlHttpRequestReply);
-
     QNetworkReply *reply = d->m_manager.post(request, data);
 
-    reply->setProperty("req_id", req_id);
-    reply->setProperty("uuid", uuid);
-    reply->setProperty("info", info);
+    trackReply(reply, POST_MSG, req_id, uuid, info);
 
     return reply;
 }
@@ -186,7 +301,7 @@ QCloudMessagingRestApi::xmlHttpPostRequest(
 /*!
  * \brief QCloudMessagingRestApi::xmlHttpPutRequest
  * Private function to send Put specific message to server.
- * Connects to virtualized xmlHttpRequestReply function.
+ * Reply is delivered to virtualized xmlHttpRequestReply function.
  *
  * \param request
  * QNetworkRequest instance
@@ -201,7 +316,7 @@ QCloudMessagingRestApi::xmlHttpPostRequest(
  * Unique uuid for internal message array manipulation.
  *
  * \param info
- * Additional info to provide via QNetworkReply instance
+ * Additional info to provide via QCloudMessagingRequestContext
  *
  * \return
  * Returns updated QNetworkReply instance after sending the post message.
@@ -215,15 +330,9 @@ QCloudMessagingRestApi::xmlHttpPutRequest(
         const QString &info)
 {
 
-    connect(&d->m_manager, &QNetworkAccessManager::finished,
-            this, &QCloudMessagingRestApi::xmlHttpRequestReply);
-
-
     QNetworkReply *reply = d->m_manager.put(request, data);
 
-    reply->setProperty("req_id", req_id);
-    reply->setProperty("uuid", uuid);
-    reply->setProperty("info", info);
+    trackReply(reply, PUT_MSG, req_id, uuid, info);
 
     return reply;
 }
@@ -231,7 +340,7 @@ QCloudMessagingRestApi::xmlHttpPutRequest(
 /*!
  * \brief QCloudMessagingRestApi::xmlHttpDeleteRequest
  * Private function to send Delete specific message to server.
- * Connects to virtualized xmlHttpRequestReply function.
+ * Reply is delivered to virtualized xmlHttpRequestReply function.
  *
  * \param request
  * QNetworkRequest instance
@@ -246,7 +355,7 @@ QCloudMessagingRestApi::xmlHttpPutRequest(
  * Unique uuid for internal message array manipulation.
  *
  * \param info
- * Additional info to provide via QNetworkReply instance
+ * Additional info to provide via QCloudMessagingRequestContext
  *
  * \return
  * Returns updated QNetworkReply instance after sending the post message.
@@ -259,15 +368,9 @@ QCloudMessagingRestApi::xmlHttpDeleteRequest(
         const QString &info)
 {
 
-    connect(&d->m_manager, &QNetworkAccessManager::finished,
-            this, &QCloudMessagingRestApi::xmlHttpRequestReply);
-
-
     QNetworkReply *reply = d->m_manager.deleteResource(request);
 
-    reply->setProperty("req_id", req_id);
-    reply->setProperty("uuid", uuid);
-    reply->setProperty("info", info);
+    trackReply(reply, DELETE_MSG, req_id, uuid, info);
 
     return reply;
 }
@@ -275,7 +378,7 @@ QCloudMessagingRestApi::xmlHttpDeleteRequest(
 /*!
  * \brief QCloudMessagingRestApi::xmlHttpGetRequest
  * Private function to send Get specific message to server.
- * Connects to virtualized xmlHttpRequestReply function.
+ * Reply is delivered to virtualized xmlHttpRequestReply function.
  *
  * \param request
  * QNetworkRequest instance
@@ -290,7 +393,7 @@ QCloudMessagingRestApi::xmlHttpDeleteRequest(
  * Unique uuid for internal message array manipulation.
  *
  * \param info
- * Additional info to provide via QNetworkReply instance
+ * Additional info to provide via QCloudMessagingRequestContext
  *
  * \return
  * Returns updated QNetworkReply instance after sending the post message.
@@ -302,19 +405,56 @@ QNetworkReply *QCloudMessagingRestApi::xmlHttpGetRequest(
         const QString &info)
 {
 
-    connect(&d->m_manager, &QNetworkAccessManager::finished,
-            this, &QCloudMessagingRestApi::xmlHttpRequestReply);
-
-
     QNetworkReply *reply = d->m_manager.get(request);
 
-    reply->setProperty("req_id", req_id);
-    reply->setProperty("uuid", uuid);
-    reply->setProperty("info", info);
+    trackReply(reply, GET_MSG, req_id, uuid, info);
 
     return reply;
 }
 
+/*!
+ * \brief QCloudMessagingRestApi::trackReply
+ * Private function to bind the request context to the sent reply.
+ * Reply finishes exactly once and the context is found with single
+ * hash lookup.
+ *
+ * \param reply
+ * Sent QNetworkReply instance
+ *
+ * \param type
+ * Type as QCloudMessagingRestApi::MessageType
+ *
+ * \param req_id
+ * Requirement id to identify the received message.
+ *
+ * \param uuid
+ * Unique uuid for internal message array manipulation.
+ *
+ * \param info
+ * Additional info for the reply handler.
+ */
+void QCloudMessagingRestApi::trackReply(QNetworkReply *reply,
+                                        MessageType type,
+                                        int req_id,
+                                        const QString &uuid,
+                                        const QString &info)
+{
+    QCloudMessagingRequestContext context;
+    context.type = type;
+    context.req_id = req_id;
+    context.uuid = uuid;
+    // Queued messages use the message id as uuid
+    context.msg_id = uuid.toULongLong();
+    context.info = info;
+    context.started = d->m_clock.elapsed();
+
+    d->m_replies.insert(reply, context);
+
+    connect(reply, &QNetworkReply::finished, this, [this, reply] {
+        networkReplyFinished(reply);
+    });
+}
+
 /*!
  * \brief QCloudMessagingRestApi::sendNetworkMessage
  * Sends message with info from the QCloudMessagingNetworkMessage class parameter.
@@ -358,10 +498,11 @@ void QCloudMessagingRestApi::sendNetworkMessage(
  * \param immediate
  * If true, defines that message is sent immediately and no message timers are involved
  * if false, message is set to message queue and message will be sent after message timer
- * timeouts.
+ * timeouts. Immediate message is queued as well if the in-flight window is full
+ * or the rate limit of the endpoint is reached.
  *
  * \param info
- * Additional info to provide via QNetworkReply instance
+ * Additional info to provide via QCloudMessagingRequestContext
  *
  * \return
  * Return true if message was sent immediately. False if it went to the queue.
@@ -374,42 +515,31 @@ bool QCloudMessagingRestApi::sendMessage(QCloudMessagingRestApi::MessageType typ
                                          const QString &info)
 {
     QCloudMessagingNetworkMessage msg;
-    bool sent = false;
-
-    // Remember the message if not online
-    if (!immediate || !d->m_online_state) {
-        QUuid quid = QUuid::createUuid();;
 
-        QString pure_quid = quid.toString();
-        pure_quid = pure_quid.mid(1, pure_quid.length() - 2);
+    msg.req_id = req_id;
+    msg.type = type;
+    msg.request = request;
+    msg.data = data;
+    msg.retry_count = 0;
+    msg.info = info;
+
+    // Message is kept in the queue until the reply is handled, so that also
+    // immediate messages are limited by the in-flight window.
+    QCloudMessagingOutboundEntry *entry = d->m_network_requests.enqueue(msg);
+    if (d->m_retry_policy.deadline > 0)
+        entry->deadline = d->m_clock.elapsed() + d->m_retry_policy.deadline;
+    if (d->m_journal.isOpen())
+        d->m_journal.append(entry->id, entry->msg);
 
-        msg.req_id = req_id;
-        msg.type = type;
-        msg.uuid = pure_quid;
-        msg.request = request;
-        msg.data = data;
-        msg.retry_count = 0;
-        msg.info = info;
-
-        d->m_network_requests.append(msg);
+    bool sent = false;
+    if (immediate && d->m_online_state &&
+        d->m_replies.count() < d->m_max_in_flight_requests &&
+        admitNetworkMessage(entry, d->m_clock.elapsed())) {
+        sent = dispatchNetworkMessage(entry);
+    }
 
-        if (!d->m_msgTimer.isActive()) d->m_msgTimer.start(d->m_server_message_timer);
-    } else {
-        if (type == POST_MSG) {
-            xmlHttpPostRequest(request, data, req_id, msg.uuid, info);
-        }
+    if (!d->m_msgTimer.isActive()) d->m_msgTimer.start(d->m_server_message_timer);
 
-        if (type == GET_MSG) {
-            xmlHttpGetRequest(request, req_id, msg.uuid, info);
-        }
-        if (type == PUT_MSG) {
-            xmlHttpPutRequest(request, data, req_id, msg.uuid, info);
-        }
-        if (type == DELETE_MSG) {
-            xmlHttpDeleteRequest(request, req_id, msg.uuid, info);
-        }
-        sent = true;
-    }
     return sent;
 }
 
@@ -423,108 +553,624 @@ bool QCloudMessagingRestApi::sendMessage(QCloudMessagingRestApi::MessageType typ
  */
 void QCloudMessagingRestApi::clearMessage(const QString &msg_uuid)
 {
-    for (int i = 0; i < d->m_network_requests.length(); i++) {
-        if (d->m_network_requests[i].uuid == msg_uuid) {
-            d->m_network_requests.removeAt(i);
-            return;
-        }
-    }
+    bool ok = false;
+    const quint64 msg_id = msg_uuid.toULongLong(&ok);
+    if (ok)
+        clearMessage(msg_id);
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::clearMessage
+ * Clears the specific messages from the message queue by the message
+ * id given in QCloudMessagingRequestContext.
+ * Should be used in the implementatio of xmlHttpRequestReply
+ *
+ * \param msg_id
+ * Message id of the message
+ */
+void QCloudMessagingRestApi::clearMessage(quint64 msg_id)
+{
+    QCloudMessagingOutboundEntry *entry = d->m_network_requests.find(msg_id);
+    if (entry)
+        d->removeMessage(entry);
 }
 
 
 /*!
  * \brief QCloudMessagingRestApi::clearMessageBuffer
- * Clears the message queue.
+ * Clears the message queue. networkMessageExpired is emitted for every
+ * dropped message which was not sent yet. Replies of the sent messages
+ * are still delivered to xmlHttpRequestReply.
  */
 void QCloudMessagingRestApi::clearMessageBuffer()
 {
+    QVector<QCloudMessagingRequestContext> dropped;
+    const QVector<QCloudMessagingOutboundEntry *> entries = d->m_network_requests.entries();
+    for (const QCloudMessagingOutboundEntry *entry : entries) {
+        if (entry->state == QCloudMessagingOutboundEntry::InFlight)
+            continue;
+
+        QCloudMessagingRequestContext context;
+        context.type = entry->msg.type;
+        context.req_id = entry->msg.req_id;
+        context.uuid = entry->msg.uuid;
+        context.msg_id = entry->id;
+        context.info = entry->msg.info;
+        context.started = 0;
+        dropped.append(context);
+    }
+
     d->m_network_requests.clear();
+    d->m_journal.clear();
+
+    // Queue is empty when the handlers run
+    for (const QCloudMessagingRequestContext &context : qAsConst(dropped))
+        Q_EMIT networkMessageExpired(context.msg_id, context.req_id, context.info);
 }
 
 /*!
- * \brief QCloudMessagingRestApi::networkMsgTimerTriggered
- * Private slot for handling message timeouts and resending of the
- * messages.
+ * \brief QCloudMessagingRestApi::setJournalPath
+ * Enables the outbound message journal. Queued messages are written to
+ * append-only segment files in the \a path directory and messages which
+ * were not cleared with clearMessage are sent again after the restart.
+ * Replayed messages keep only their ids in memory, the request and data
+ * are read from the journal when the message is sent.
+ *
+ * Journal must be enabled before any messages are queued.
+ *
+ * \param path
+ * Journal directory. Empty path disables the journal.
+ *
+ * \param segmentSize
+ * Size in bytes after which the new segment file is started.
+ * Segment files are deleted when all of their messages are cleared.
+ *
+ * \return
+ * Returns true if journal was opened and replayed.
  */
-void QCloudMessagingRestApi::networkMsgTimerTriggered()
+bool QCloudMessagingRestApi::setJournalPath(const QString &path, qint64 segmentSize)
 {
-    // Do not send messages if we are not online or we are waiting
-    // for message to arrive
-    if (!d->m_online_state) {
-        d->m_msgTimer.start(d->m_server_message_timer);
-        return;
+    d->m_journal.close();
+
+    if (path.isEmpty())
+        return true;
+
+    if (d->m_network_requests.count() > 0)
+        return false;
+
+    if (!d->m_journal.open(path, segmentSize))
+        return false;
+
+    const QVector<QCloudMessagingJournalRecord> records = d->m_journal.takeReplayedRecords();
+    for (const QCloudMessagingJournalRecord &record : records) {
+        QCloudMessagingNetworkMessage msg;
+        msg.type = record.type;
+        msg.req_id = record.req_id;
+        msg.retry_count = record.retry_count;
+        QCloudMessagingOutboundEntry *entry = d->m_network_requests.restore(record.id, msg);
+        // Deadline is counted from the restart
+        if (entry && d->m_retry_policy.deadline > 0)
+            entry->deadline = d->m_clock.elapsed() + d->m_retry_policy.deadline;
+    }
+
+    if (!records.isEmpty()) {
+        if (!d->m_msgTimer.isActive()) d->m_msgTimer.start(d->m_server_message_timer);
+        dispatchNetworkRequests();
     }
 
-    if (d->m_wait_for_last_request_response) {
-        d->m_waiting_counter++;
+    return true;
+}
 
-        if (d->m_waiting_counter > d->m_server_wait_for_response_counter) {
-            d->m_wait_for_last_request_response = false;
-            d->m_waiting_counter = 0;
+/*!
+ * \brief QCloudMessagingRestApi::admitNetworkMessage
+ * Private function to check if the queued message can be sent now.
+ * Message replayed from the journal is loaded here. Message to a
+ * throttled endpoint is parked to the endpoint, and so are the messages
+ * queued after it until the older ones have been sent.
+ *
+ * \param entry
+ * Queued message entry.
+ *
+ * \param now
+ * Current time in milliseconds
+ *
+ * \return
+ * Returns true if message can be sent. False if it was parked or removed.
+ */
+bool QCloudMessagingRestApi::admitNetworkMessage(QCloudMessagingOutboundEntry *entry, qint64 now)
+{
+    // Message replayed from the journal is loaded on the first send
+    if (!entry->loaded) {
+        if (!d->m_journal.load(entry->id, &entry->msg)) {
+            d->removeMessage(entry);
+            return false;
         }
-        d->m_msgTimer.start(d->m_server_message_timer);
-        return;
+        entry->loaded = true;
     }
 
-    d->m_waiting_counter = 0;
+    QCloudMessagingEndpoint *endpoint =
+            d->m_rate_limiter.endpoint(entry->msg.request.url().host(), entry->msg.req_id);
 
-    // Send latest message.
-    if (d->m_network_requests.length() > 0) {
+    QCloudMessagingOutboundEntry *waiting = endpoint->parked.first();
+    if (waiting && waiting->id < entry->id) {
+        d->m_network_requests.park(entry, &endpoint->parked);
+        return false;
+    }
 
-        if (d->m_network_requests[0].type == POST_MSG) {
+    QCloudMessagingEndpoint *circuit = endpoint->circuit;
+    if (circuitAvailable(circuit, now) <= 0) {
+        if (d->m_circuit_policy.failFast && circuit->circuit_state == CircuitOpen)
+            expireMessage(entry, QStringLiteral("circuit of %1 is open").arg(circuit->host));
+        else
+            d->m_network_requests.park(entry, &endpoint->parked);
+        return false;
+    }
 
-            xmlHttpPostRequest(d->m_network_requests[0].request,
-                               d->m_network_requests[0].data,
-                               d->m_network_requests[0].req_id,
-                               d->m_network_requests[0].uuid,
-                               d->m_network_requests[0].info);
+    if (!d->m_rate_limiter.tryAcquire(endpoint, now)) {
+        d->m_network_requests.park(entry, &endpoint->parked);
+        return false;
+    }
 
-            d->m_network_requests[0].retry_count++;
-        }
+    if (circuit->circuit_state == CircuitHalfOpen)
+        circuit->probes_in_flight++;
 
-        if (d->m_network_requests[0].type == GET_MSG &&
-            d->m_network_requests[0].retry_count < d->m_server_message_retry_count) {
+    return true;
+}
 
-            xmlHttpGetRequest(d->m_network_requests[0].request,
-                              d->m_network_requests[0].req_id,
-                              d->m_network_requests[0].uuid,
-                              d->m_network_requests[0].info);
+/*!
+ * \brief QCloudMessagingRestApi::dispatchNetworkMessage
+ * Private function to send the queued message.
+ *
+ * \param entry
+ * Queued message entry.
+ *
+ * \return
+ * Returns true if the request was sent.
+ */
+bool QCloudMessagingRestApi::dispatchNetworkMessage(QCloudMessagingOutboundEntry *entry)
+{
+    QCloudMessagingNetworkMessage &msg = entry->msg;
+    QNetworkReply *reply = nullptr;
+
+    switch (msg.type) {
+    case POST_MSG:
+        reply = xmlHttpPostRequest(msg.request, msg.data, msg.req_id, msg.uuid, msg.info);
+        break;
+    case GET_MSG:
+        reply = xmlHttpGetRequest(msg.request, msg.req_id, msg.uuid, msg.info);
+        break;
+    case PUT_MSG:
+        reply = xmlHttpPutRequest(msg.request, msg.data, msg.req_id, msg.uuid, msg.info);
+        break;
+    case DELETE_MSG:
+        reply = xmlHttpDeleteRequest(msg.request, msg.req_id, msg.uuid, msg.info);
+        break;
+    default:
+        break;
+    }
 
-            d->m_network_requests[0].retry_count++;
-        }
+    if (!reply) {
+        // Unknown message type can never be sent
+        d->removeMessage(entry);
+        return false;
+    }
 
-        if (d->m_network_requests[0].type == PUT_MSG &&
-            d->m_network_requests[0].retry_count < d->m_server_message_retry_count) {
+    msg.retry_count++;
+    if (d->m_journal.isOpen())
+        d->m_journal.updateRetryCount(entry->id, msg.retry_count);
+    d->m_network_requests.markInFlight(entry);
 
-            xmlHttpPutRequest(d->m_network_requests[0].request,
-                              d->m_network_requests[0].data,
-                              d->m_network_requests[0].req_id,
-                              d->m_network_requests[0].uuid,
-                              d->m_network_requests[0].info);
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::dispatchNetworkRequests
+ * Private function to fill the in-flight window from the message queue.
+ * Messages are sent in queue order. Messages which have passed their
+ * deadline or used all the attempts are expired. Messages to throttled
+ * endpoints wait without blocking the messages to other endpoints.
+ */
+void QCloudMessagingRestApi::dispatchNetworkRequests()
+{
+    if (!d->m_online_state)
+        return;
 
-            d->m_network_requests[0].retry_count++;
+    const qint64 now = d->m_clock.elapsed();
+
+    releaseThrottledMessages(now);
+
+    while (d->m_replies.count() < d->m_max_in_flight_requests) {
+        QCloudMessagingOutboundEntry *entry = d->m_network_requests.nextPending();
+        if (!entry)
+            break;
+
+        if ((entry->deadline > 0 && now >= entry->deadline) ||
+            entry->msg.retry_count >= d->m_retry_policy.maxAttempts) {
+            expireMessage(entry, QStringLiteral("expired"));
+            continue;
         }
 
-        if (d->m_network_requests[0].type == DELETE_MSG &&
-            d->m_network_requests[0].retry_count < d->m_server_message_retry_count) {
+        if (admitNetworkMessage(entry, now))
+            dispatchNetworkMessage(entry);
+    }
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::networkReplyFinished
+ * Private function called once when the sent reply has finished.
+ * Retryable failure of a queued message is scheduled for the next
+ * attempt. Otherwise the reply with its request context is delivered to
+ * xmlHttpRequestReply and the message is removed from the queue.
+ * Finished reply frees the slot in the in-flight window and the next
+ * queued message is sent without waiting for the message timer.
+ *
+ * \param reply
+ * Finished QNetworkReply instance
+ */
+void QCloudMessagingRestApi::networkReplyFinished(QNetworkReply *reply)
+{
+    auto it = d->m_replies.find(reply);
+    if (it == d->m_replies.end())
+        return;
+
+    const QCloudMessagingRequestContext context = it.value();
+    d->m_replies.erase(it);
+
+    QCloudMessagingOutboundEntry *entry = d->m_network_requests.find(context.msg_id);
+    const bool throttled = entry && throttleMessage(entry, reply);
+
+    recordCircuitResult(reply, context, throttled);
+
+    if (throttled || (entry && scheduleRetry(entry, reply))) {
+        reply->deleteLater();
+        dispatchNetworkRequests();
+        return;
+    }
+
+    xmlHttpRequestReply(reply, context);
+    reply->deleteLater();
+
+    // Final outcome was delivered, even if the handler did not clear it
+    entry = d->m_network_requests.find(context.msg_id);
+    if (entry)
+        d->removeMessage(entry);
+
+    dispatchNetworkRequests();
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::scheduleRetry
+ * Private function to schedule the next attempt of the failed message.
+ * Network errors, timeouts and 408, 429 or 5xx responses are retried. Delay
+ * grows exponentially from QCloudMessagingRetryPolicy::initialBackoff and
+ * is randomized by QCloudMessagingRetryPolicy::jitter, so that clients do
+ * not retry in lockstep.
+ *
+ * \param entry
+ * Queued message entry.
+ *
+ * \param reply
+ * Finished QNetworkReply instance
+ *
+ * \return
+ * Returns true if message was scheduled. False if the outcome is final.
+ */
+bool QCloudMessagingRestApi::scheduleRetry(QCloudMessagingOutboundEntry *entry,
+                                           QNetworkReply *reply)
+{
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const bool retryable = status == 429 || isTransientFailure(reply);
+
+    const QCloudMessagingRetryPolicy &policy = d->m_retry_policy;
+    const int attempts = entry->msg.retry_count;
+    if (!retryable || attempts >= policy.maxAttempts)
+        return false;
+
+    qreal delay = policy.initialBackoff;
+    for (int i = 1; i < attempts && delay < policy.maxBackoff; i++)
+        delay *= policy.multiplier;
+    delay = qMin(delay, qreal(policy.maxBackoff));
+    delay -= delay * policy.jitter * QRandomGenerator::global()->generateDouble();
+
+    const qint64 due = d->m_clock.elapsed() + qint64(delay);
+    if (entry->deadline > 0 && due >= entry->deadline)
+        return false;
+
+    d->m_network_requests.schedule(entry, due);
+
+    if (!d->m_msgTimer.isActive()) d->m_msgTimer.start(d->m_server_message_timer);
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::isTransientFailure
+ * Private function to classify the finished reply.
+ *
+ * \param reply
+ * Finished QNetworkReply instance
+ *
+ * \return
+ * Returns true for network errors, timeouts and 408 or 5xx responses.
+ */
+bool QCloudMessagingRestApi::isTransientFailure(QNetworkReply *reply)
+{
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status)
+        return status >= 500 || status == 408;
+
+    switch (reply->error()) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::OperationCanceledError: // Aborted by the response timeout
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::ProxyConnectionRefusedError:
+    case QNetworkReply::ProxyConnectionClosedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::UnknownNetworkError:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::throttleMessage
+ * Private function to handle 429 and 503 responses with \c Retry-After
+ * header. Endpoint is blocked for the given time and the message is
+ * parked to the endpoint in its original place. Throttled send is not
+ * counted as an attempt.
+ *
+ * \param entry
+ * Queued message entry.
+ *
+ * \param reply
+ * Finished QNetworkReply instance
+ *
+ * \return
+ * Returns true if message was throttled.
+ */
+bool QCloudMessagingRestApi::throttleMessage(QCloudMessagingOutboundEntry *entry,
+                                             QNetworkReply *reply)
+{
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status != 429 && status != 503)
+        return false;
+
+    const qint64 delay = QCloudMessagingRateLimiter::parseRetryAfter(
+                reply->rawHeader(QByteArrayLiteral("Retry-After")),
+                QDateTime::currentDateTimeUtc());
+    if (delay < 0)
+        return false;
+
+    const qint64 now = d->m_clock.elapsed();
+    if (entry->deadline > 0 && now + delay >= entry->deadline)
+        return false;
+
+    QCloudMessagingEndpoint *endpoint =
+            d->m_rate_limiter.endpoint(entry->msg.request.url().host(), entry->msg.req_id);
+    d->m_rate_limiter.block(endpoint, now + delay);
 
-            xmlHttpDeleteRequest(d->m_network_requests[0].request,
-                                 d->m_network_requests[0].req_id,
-                                 d->m_network_requests[0].uuid,
-                                 d->m_network_requests[0].info);
+    entry->msg.retry_count--;
+    if (d->m_journal.isOpen())
+        d->m_journal.updateRetryCount(entry->id, entry->msg.retry_count);
 
-            d->m_network_requests[0].retry_count++;
+    d->m_network_requests.park(entry, &endpoint->parked);
+
+    if (!d->m_msgTimer.isActive()) d->m_msgTimer.start(d->m_server_message_timer);
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::releaseThrottledMessages
+ * Private function to move the parked messages of the endpoints which
+ * have tokens again back to the front of the queue. Messages of the
+ * half-open circuit are released only for the probe requests.
+ *
+ * \param now
+ * Current time in milliseconds
+ */
+void QCloudMessagingRestApi::releaseThrottledMessages(qint64 now)
+{
+    for (QCloudMessagingEndpoint *endpoint : d->m_rate_limiter.endpoints()) {
+        if (endpoint->parked.count() > 0) {
+            const int available = qMin(d->m_rate_limiter.available(endpoint, now),
+                                       circuitAvailable(endpoint->circuit, now));
+            d->m_network_requests.unpark(&endpoint->parked, available);
         }
+    }
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::circuitAvailable
+ * Private function to check how many requests the circuit lets through.
+ * Open circuit turns half-open when the open duration has passed.
+ *
+ * \param circuit
+ * Endpoint of the host
+ *
+ * \param now
+ * Current time in milliseconds
+ *
+ * \return
+ * Returns the amount of requests which can be sent now.
+ */
+int QCloudMessagingRestApi::circuitAvailable(QCloudMessagingEndpoint *circuit, qint64 now)
+{
+    const QCloudMessagingCircuitBreakerPolicy &policy = d->m_circuit_policy;
+
+    switch (circuit->circuit_state) {
+    case CircuitOpen:
+        if (now - circuit->circuit_opened < policy.openDuration)
+            return 0;
+        setCircuitState(circuit, CircuitHalfOpen, now);
+        Q_FALLTHROUGH();
+    case CircuitHalfOpen:
+        return qMax(0, policy.probeRequests - circuit->probes_in_flight);
+    default:
+        return INT_MAX;
+    }
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::recordCircuitResult
+ * Private function to update the circuit breaker of the host with the
+ * result of the finished reply. Throttled replies, 429 and the 503
+ * responses with \c Retry-After, are not counted. They only free the
+ * probe slot of the half-open circuit.
+ *
+ * \param reply
+ * Finished QNetworkReply instance
+ *
+ * \param context
+ * Request context of the reply
+ *
+ * \param throttled
+ * True if the message was parked by throttleMessage
+ */
+void QCloudMessagingRestApi::recordCircuitResult(QNetworkReply *reply,
+                                                 const QCloudMessagingRequestContext &context,
+                                                 bool throttled)
+{
+    const QCloudMessagingCircuitBreakerPolicy &policy = d->m_circuit_policy;
+    if (!policy.enabled)
+        return;
+
+    QCloudMessagingEndpoint *circuit =
+            d->m_rate_limiter.endpoint(reply->request().url().host(), context.req_id)->circuit;
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (throttled || status == 429) {
+        if (circuit->circuit_state == CircuitHalfOpen && circuit->probes_in_flight > 0)
+            circuit->probes_in_flight--;
+        return;
+    }
 
-        if (d->m_network_requests[0].retry_count < d->m_server_message_retry_count) {
-            d->m_network_requests.move(0, d->m_network_requests.length() - 1);
-        } else {
-            d->m_network_requests.removeAt(0);
+    const bool failure = isTransientFailure(reply);
+    const qint64 now = d->m_clock.elapsed();
+
+    switch (circuit->circuit_state) {
+    case CircuitHalfOpen:
+        if (circuit->probes_in_flight > 0)
+            circuit->probes_in_flight--;
+        if (failure)
+            setCircuitState(circuit, CircuitOpen, now);
+        else if (++circuit->probe_successes >= policy.probeRequests)
+            setCircuitState(circuit, CircuitClosed, now);
+        break;
+    case CircuitClosed:
+        if (now - circuit->window_start >= policy.window) {
+            circuit->window_start = now;
+            circuit->window_requests = 0;
+            circuit->window_failures = 0;
         }
+        circuit->window_requests++;
+        if (failure)
+            circuit->window_failures++;
+        if (circuit->window_requests >= policy.minimumRequests &&
+            circuit->window_failures >= policy.failureThreshold * circuit->window_requests)
+            setCircuitState(circuit, CircuitOpen, now);
+        break;
+    default:
+        // Replies sent before the circuit opened
+        break;
+    }
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::setCircuitState
+ * Private function to change the state of the circuit breaker and emit
+ * circuitStateChanged.
+ *
+ * \param circuit
+ * Endpoint of the host
+ *
+ * \param state
+ * New state
+ *
+ * \param now
+ * Current time in milliseconds
+ */
+void QCloudMessagingRestApi::setCircuitState(QCloudMessagingEndpoint *circuit,
+                                             CircuitState state, qint64 now)
+{
+    if (circuit->circuit_state == state)
+        return;
+
+    circuit->circuit_state = state;
+    circuit->circuit_opened = now;
+    circuit->window_start = now;
+    circuit->window_requests = 0;
+    circuit->window_failures = 0;
+    circuit->probes_in_flight = 0;
+    circuit->probe_successes = 0;
+
+    Q_EMIT circuitStateChanged(circuit->host, state);
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::expireMessage
+ * Private function to drop the message which has passed its deadline,
+ * used all the attempts or was sent to the open circuit.
+ *
+ * \param entry
+ * Queued message entry.
+ *
+ * \param reason
+ * Reason for the xmlHttpRequestError signal.
+ */
+void QCloudMessagingRestApi::expireMessage(QCloudMessagingOutboundEntry *entry,
+                                           const QString &reason)
+{
+    const quint64 msg_id = entry->id;
+    const int req_id = entry->msg.req_id;
+    const QString info = entry->msg.info;
+
+    d->removeMessage(entry);
+
+    Q_EMIT networkMessageExpired(msg_id, req_id, info);
+    Q_EMIT xmlHttpRequestError(QStringLiteral("Network message %1 dropped: %2")
+                               .arg(msg_id).arg(reason));
+}
 
-        if (d->m_network_requests.length() > 0)
-            d->m_msgTimer.start(d->m_server_message_timer);
+/*!
+ * \brief QCloudMessagingRestApi::networkMsgTimerTriggered
+ * Private slot for handling message timeouts and resending of the
+ * messages.
+ */
+void QCloudMessagingRestApi::networkMsgTimerTriggered()
+{
+    // Messages which have waited for their backoff are sent again
+    d->m_network_requests.advance(d->m_clock.elapsed());
+
+    // Do not send messages if we are not online
+    if (!d->m_online_state) {
+        d->m_msgTimer.start(d->m_server_message_timer);
+        return;
     }
+
+    // Abort requests which have waited for the response too long.
+    // Aborted reply finishes and frees its slot in the in-flight window.
+    const qint64 timeout = qint64(d->m_server_message_timer) *
+                           d->m_server_wait_for_response_counter;
+    const qint64 now = d->m_clock.elapsed();
+
+    QList<QNetworkReply *> expired;
+    for (auto it = d->m_replies.cbegin(); it != d->m_replies.cend(); ++it) {
+        if (now - it.value().started > timeout)
+            expired.append(it.key());
+    }
+    for (QNetworkReply *reply : qAsConst(expired))
+        reply->abort();
+
+    dispatchNetworkRequests();
+
+    if (d->m_network_requests.count() > 0)
+        d->m_msgTimer.start(d->m_server_message_timer);
 }
 
 /*!
@@ -538,12 +1184,15 @@ void QCloudMessagingRestApi::networkMsgTimerTriggered()
 void QCloudMessagingRestApi::onlineStateChanged(bool online)
 {
     d->m_online_state = online;
+
+    if (online)
+        dispatchNetworkRequests();
 }
 
 /*!
  * \brief QCloudMessagingRestApi::getNetworkRequestCount
  * Returns the count of network messages in the queue waiting
- * to be sent.
+ * to be sent or waiting for the response.
  *
  * \return
  * Returns amount of network messages in queue.
@@ -553,6 +1202,192 @@ int QCloudMessagingRestApi::getNetworkRequestCount()
     return d->m_network_requests.count();
 }
 
+/*!
+ * \brief QCloudMessagingRestApi::getPendingRequestCount
+ * Returns the count of network messages in the queue waiting
+ * to be sent. Messages waiting for the response are not counted.
+ *
+ * \return
+ * Returns queue depth.
+ */
+int QCloudMessagingRestApi::getPendingRequestCount()
+{
+    return d->m_network_requests.pendingCount();
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::getInFlightRequestCount
+ * Returns the count of sent network messages waiting for the response.
+ *
+ * \return
+ * Returns amount of outstanding network replies.
+ */
+int QCloudMessagingRestApi::getInFlightRequestCount()
+{
+    return d->m_replies.count();
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::setMaxInFlightRequests
+ * Sets the size of the in-flight window. Up to \a count messages are
+ * sent without waiting for the previous responses. When a reply finishes,
+ * next queued message is sent immediately.
+ *
+ * \param count
+ * Maximum amount of outstanding network replies. Default is 6.
+ */
+void QCloudMessagingRestApi::setMaxInFlightRequests(int count)
+{
+    d->m_max_in_flight_requests = qMax(1, count);
+    dispatchNetworkRequests();
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::maxInFlightRequests
+ * Gets the size of the in-flight window.
+ *
+ * \return
+ * Returns maximum amount of outstanding network replies.
+ */
+int QCloudMessagingRestApi::maxInFlightRequests()
+{
+    return d->m_max_in_flight_requests;
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::setRetryPolicy
+ * Sets the retry policy of the queued messages. Deadline applies to
+ * the messages queued after the call.
+ *
+ * \param policy
+ * Retry policy
+ */
+void QCloudMessagingRestApi::setRetryPolicy(const QCloudMessagingRetryPolicy &policy)
+{
+    d->m_retry_policy = policy;
+    d->m_retry_policy.maxAttempts = qMax(1, policy.maxAttempts);
+    d->m_retry_policy.multiplier = qMax(qreal(1.0), policy.multiplier);
+    d->m_retry_policy.jitter = qBound(qreal(0.0), policy.jitter, qreal(1.0));
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::retryPolicy
+ * Gets the retry policy of the queued messages.
+ *
+ * \return
+ * Returns the retry policy.
+ */
+QCloudMessagingRetryPolicy QCloudMessagingRestApi::retryPolicy()
+{
+    return d->m_retry_policy;
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::getScheduledRequestCount
+ * Returns the count of failed network messages waiting for the
+ * next attempt.
+ *
+ * \return
+ * Returns amount of messages in the backoff.
+ */
+int QCloudMessagingRestApi::getScheduledRequestCount()
+{
+    return d->m_network_requests.scheduledCount();
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::setRateLimit
+ * Sets the token bucket rate limit of the host. Queued messages to the
+ * host are sent at most \a requestsPerSecond on average, with bursts of
+ * \a burst messages. Messages over the limit wait in their place
+ * without blocking the messages to other hosts. By default hosts are
+ * not limited, but \c Retry-After of 429 and 503 responses is always
+ * honored.
+ *
+ * \param host
+ * Host of the request url, for example "fcm.googleapis.com"
+ *
+ * \param requestsPerSecond
+ * Sustained rate. Zero removes the limit.
+ *
+ * \param burst
+ * Size of the bucket.
+ *
+ * \param req_id
+ * If not -1, limit applies only to the messages with this request id,
+ * which get their own bucket.
+ */
+void QCloudMessagingRestApi::setRateLimit(const QString &host, qreal requestsPerSecond,
+                                          int burst, int req_id)
+{
+    d->m_rate_limiter.setLimit(host, req_id, requestsPerSecond, burst);
+    dispatchNetworkRequests();
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::getThrottledRequestCount
+ * Returns the count of network messages waiting for the rate limit
+ * or \c Retry-After of their endpoint.
+ *
+ * \return
+ * Returns amount of throttled messages.
+ */
+int QCloudMessagingRestApi::getThrottledRequestCount()
+{
+    return d->m_network_requests.parkedCount();
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::setCircuitBreakerPolicy
+ * Sets the circuit breaker policy of the hosts.
+ *
+ * \param policy
+ * Circuit breaker policy
+ */
+void QCloudMessagingRestApi::setCircuitBreakerPolicy(const QCloudMessagingCircuitBreakerPolicy &policy)
+{
+    d->m_circuit_policy = policy;
+    d->m_circuit_policy.probeRequests = qMax(1, policy.probeRequests);
+    d->m_circuit_policy.minimumRequests = qMax(1, policy.minimumRequests);
+
+    // Disabled circuit breaker lets the waiting messages through
+    if (!policy.enabled) {
+        const qint64 now = d->m_clock.elapsed();
+        for (QCloudMessagingEndpoint *endpoint : d->m_rate_limiter.endpoints())
+            setCircuitState(endpoint->circuit, CircuitClosed, now);
+        dispatchNetworkRequests();
+    }
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::circuitBreakerPolicy
+ * Gets the circuit breaker policy of the hosts.
+ *
+ * \return
+ * Returns the circuit breaker policy.
+ */
+QCloudMessagingCircuitBreakerPolicy QCloudMessagingRestApi::circuitBreakerPolicy()
+{
+    return d->m_circuit_policy;
+}
+
+/*!
+ * \brief QCloudMessagingRestApi::circuitState
+ * Gets the circuit breaker state of the host.
+ *
+ * \param host
+ * Host of the request url
+ *
+ * \return
+ * Returns the state of the circuit.
+ */
+QCloudMessagingRestApi::CircuitState QCloudMessagingRestApi::circuitState(const QString &host)
+{
+    // Unused host is not added to the rate limiter
+    const QCloudMessagingEndpoint *endpoint = d->m_rate_limiter.findEndpoint(host);
+    return endpoint ? CircuitState(endpoint->circuit->circuit_state) : CircuitClosed;
+}
+
 /*!
  * \brief QCloudMessagingRestApi::getOnlineState
  * Get the current online state info from the class.
@@ -589,20 +1424,18 @@ QNetworkAccessManager *QCloudMessagingRestApi::getNetworkManager()
 
 // Public slots documentation
 /*!
-  \fn virtual void QCloudMessagingRestApi:: xmlHttpRequestReply(QNetworkReply *reply)
+  \fn virtual void QCloudMessagingRestApi::xmlHttpRequestReply(QNetworkReply *reply, const QCloudMessagingRequestContext &context)
 
-  This slot is executed when \c QNetworkReply is received for the client request.
+  This function is executed once when \c QNetworkReply is received for the client request.
   This is virtual function which needs to be implemented the by inheriting class.
+  Default implementation calls the deprecated xmlHttpRequestReply(QNetworkReply *).
+  Reply is deleted by QCloudMessagingRestApi after this function returns.
 
   Example implementation:
   \code
-    void QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply(QNetworkReply *reply)
+    void QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply(QNetworkReply *reply,
+                                                               const QCloudMessagingRequestContext &context)
     {
-        getNetworkManager()->disconnect(SIGNAL(finished(QNetworkReply *)));
-
-        QString m_msg_uuid = reply->property("uuid").toString();
-        int req_id = reply->property("req_id").toInt();
-
         if (reply->error()) {
             Q_EMIT xmlHttpRequestError(reply->errorString());
         }
@@ -611,22 +1444,21 @@ QNetworkAccessManager *QCloudMessagingRestApi::getNetworkManager()
         QByteArray data(reply->readAll());
 
         // Make decisions about req_id
-        switch (req_id) {
+        switch (context.req_id) {
             case REQ_GET_ALL_DEVICES: {
                 emit remoteClientsReceived(QString::fromUtf8(data));
             }
         }
 
-        reply->deleteLater();
-
-        clearMessage(m_msg_uuid);
-
+        clearMessage(context.msg_id);
     }
   \endcode
   \param reply
   provides QNetworkReply for reading data from the network response.
 
-
+  \param context
+  provides the request id, message uuid and id, info and start time given
+  when the request was sent.
 */
 
 /*!
@@ -41,6 +41,8 @@ QT_BEGIN_NAMESPACE
 class QNetworkAccessManager;
 class QAuthenticator;
 class QNetworkReply;
+class QCloudMessagingOutboundEntry;
+class QCloudMessagingEndpoint;
 
 
 class QCloudMessagingNetworkMessage
@@ -57,6 +59,61 @@ public:
 
 };
 
+class QCloudMessagingRequestContext
+{
+public:
+    int type;
+    int req_id;
+    QString uuid;
+    quint64 msg_id;
+    QString info;
+    qint64 started;
+};
+
+class QCloudMessagingRetryPolicy
+{
+public:
+    QCloudMessagingRetryPolicy()
+        : maxAttempts(1),
+          initialBackoff(1000),
+          maxBackoff(60000),
+          multiplier(2.0),
+          jitter(0.2),
+          deadline(0)
+    {
+    }
+
+    int maxAttempts;
+    int initialBackoff;
+    int maxBackoff;
+    qreal multiplier;
+    qreal jitter;
+    int deadline;
+};
+
+class QCloudMessagingCircuitBreakerPolicy
+{
+public:
+    QCloudMessagingCircuitBreakerPolicy()
+        : enabled(true),
+          failureThreshold(0.5),
+          minimumRequests(10),
+          window(30000),
+          openDuration(30000),
+          probeRequests(1),
+          failFast(false)
+    {
+    }
+
+    bool enabled;
+    qreal failureThreshold;
+    int minimumRequests;
+    int window;
+    int openDuration;
+    int probeRequests;
+    bool failFast;
+};
+
 class QCloudMessagingRestApiPrivate;
 
 class Q_CLOUDMESSAGING_EXPORT QCloudMessagingRestApi : public QObject
@@ -74,6 +131,13 @@ public:
     };
     Q_ENUM(MessageType)
 
+    enum CircuitState {
+        CircuitClosed = 0,
+        CircuitOpen,
+        CircuitHalfOpen
+    };
+    Q_ENUM(CircuitState)
+
     explicit QCloudMessagingRestApi(QObject *parent = nullptr);
 
     ~QCloudMessagingRestApi();
@@ -90,6 +154,33 @@ public:
 
     int getNetworkRequestCount();
 
+    int getPendingRequestCount();
+
+    int getInFlightRequestCount();
+
+    void setMaxInFlightRequests(int count);
+
+    bool setJournalPath(const QString &path, qint64 segmentSize = 4 * 1024 * 1024);
+
+    void setRetryPolicy(const QCloudMessagingRetryPolicy &policy);
+
+    QCloudMessagingRetryPolicy retryPolicy();
+
+    int getScheduledRequestCount();
+
+    void setRateLimit(const QString &host, qreal requestsPerSecond, int burst = 1,
+                      int req_id = -1);
+
+    int getThrottledRequestCount();
+
+    void setCircuitBreakerPolicy(const QCloudMessagingCircuitBreakerPolicy &policy);
+
+    QCloudMessagingCircuitBreakerPolicy circuitBreakerPolicy();
+
+    CircuitState circuitState(const QString &host);
+
+    int maxInFlightRequests();
+
     bool getOnlineState();
 
     QNetworkAccessManager *getNetworkManager();
@@ -100,6 +191,8 @@ public:
 
     void clearMessage(const QString &msg_uuid);
 
+    void clearMessage(quint64 msg_id);
+
     QNetworkReply *xmlHttpPostRequest(QNetworkRequest request,
                                       QByteArray data,
                                       int req_id,
@@ -123,17 +216,40 @@ public:
                                         const QString &info);
 Q_SIGNALS:
     void xmlHttpRequestError(const QString &errorString);
+    void networkMessageExpired(quint64 msg_id, int req_id, const QString &info);
+    void circuitStateChanged(const QString &host, QCloudMessagingRestApi::CircuitState state);
 
 public Q_SLOTS:
-    virtual void xmlHttpRequestReply(QNetworkReply *reply) = 0;
     virtual void provideAuthentication(QNetworkReply *reply, QAuthenticator *authenticator);
 
+    // Deprecated, reimplement the overload with the request context
+    virtual void xmlHttpRequestReply(QNetworkReply *reply);
+
+protected:
+    virtual void xmlHttpRequestReply(QNetworkReply *reply,
+                                     const QCloudMessagingRequestContext &context);
+
 private Q_SLOTS:
     void networkMsgTimerTriggered();
     void onlineStateChanged(bool online);
 
 private:
     void append_network_request(int req_id, const QString &param, QVariant data);
+    void trackReply(QNetworkReply *reply, MessageType type, int req_id,
+                    const QString &uuid, const QString &info);
+    void dispatchNetworkRequests();
+    bool dispatchNetworkMessage(QCloudMessagingOutboundEntry *entry);
+    bool scheduleRetry(QCloudMessagingOutboundEntry *entry, QNetworkReply *reply);
+    bool admitNetworkMessage(QCloudMessagingOutboundEntry *entry, qint64 now);
+    bool throttleMessage(QCloudMessagingOutboundEntry *entry, QNetworkReply *reply);
+    void releaseThrottledMessages(qint64 now);
+    void expireMessage(QCloudMessagingOutboundEntry *entry, const QString &reason);
+    int circuitAvailable(QCloudMessagingEndpoint *circuit, qint64 now);
+    void recordCircuitResult(QNetworkReply *reply, const QCloudMessagingRequestContext &context,
+                             bool throttled);
+    void setCircuitState(QCloudMessagingEndpoint *circuit, CircuitState state, qint64 now);
+    static bool isTransientFailure(QNetworkReply *reply);
+    void networkReplyFinished(QNetworkReply *reply);
 
     QScopedPointer<QCloudMessagingRestApiPrivate> d;
 
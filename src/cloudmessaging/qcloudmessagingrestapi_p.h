@@ -39,9 +39,13 @@
 // We mean it.
 //
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
-#include <QList>
+#include <QtCloudMessaging/private/qcloudmessagingoutboundqueue_p.h>
+#include <QtCloudMessaging/private/qcloudmessagingrestjournal_p.h>
+#include <QtCloudMessaging/private/qcloudmessagingratelimiter_p.h>
+#include <QHash>
 #include <QNetworkReply>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 
 #ifndef QT_NO_BEARERMANAGEMENT
@@ -51,6 +55,7 @@
 QT_BEGIN_NAMESPACE
 
 class QCloudMessagingNetworkMessage;
+class QCloudMessagingRequestContext;
 
 class QCloudMessagingRestApiPrivate
 {
@@ -60,7 +65,9 @@ public:
         m_online_state = false;
         m_server_message_timer = 800;
         m_server_wait_for_response_counter = 10;
-        m_server_message_retry_count = 1;
+        // QNetworkAccessManager opens at most six connections per host,
+        // a larger window would only queue inside the manager.
+        m_max_in_flight_requests = 6;
     }
 
     ~QCloudMessagingRestApiPrivate() = default;
@@ -69,21 +76,34 @@ public:
     {
         m_server_message_timer = messageTimer;
         m_server_wait_for_response_counter = waitForResponseCounter;
-        m_server_message_retry_count = messageRetryCount;
+        m_retry_policy.maxAttempts = qMax(1, messageRetryCount);
+    }
+
+    void removeMessage(QCloudMessagingOutboundEntry *entry)
+    {
+        if (m_journal.isOpen())
+            m_journal.remove(entry->id);
+        m_network_requests.remove(entry);
     }
 
     QNetworkAccessManager m_manager;
-    bool m_wait_for_last_request_response;
     QTimer m_msgTimer;
+    QElapsedTimer m_clock;
     bool m_online_state;
-    QList <QCloudMessagingNetworkMessage> m_network_requests;
+    // Endpoints own the lists of the parked messages, so the rate limiter
+    // is declared before the queue and destroyed after it.
+    QCloudMessagingRateLimiter m_rate_limiter;
+    QCloudMessagingOutboundQueue m_network_requests;
+    QHash<QNetworkReply *, QCloudMessagingRequestContext> m_replies;
+    QCloudMessagingRestJournal m_journal;
 #ifndef QT_NO_BEARERMANAGEMENT
     QNetworkConfigurationManager m_network_info;
 #endif
-    int m_waiting_counter;
     int m_server_message_timer;
     int m_server_wait_for_response_counter;
-    int m_server_message_retry_count;
+    QCloudMessagingRetryPolicy m_retry_policy;
+    QCloudMessagingCircuitBreakerPolicy m_circuit_policy;
+    int m_max_in_flight_requests;
 
 };
 
@@ -0,0 +1,734 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qcloudmessagingrestjournal_p.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QtEndian>
+
+#include <algorithm>
+
+/*!
+    \class QCloudMessagingRestJournal
+    \inmodule QtCloudMessaging
+    \internal
+
+    \brief The QCloudMessagingRestJournal class persists the outbound
+    network messages of QCloudMessagingRestApi.
+
+    Journal is a directory of append-only segment files. Every queued
+    message is written as an enqueue record, retries and acknowledgements
+    are appended as small update records. New segment is started when the
+    active segment grows over the segment size and the oldest segments are
+    deleted when all of their messages have been acknowledged. Messages
+    which are still waiting in a mostly acknowledged oldest segment are
+    copied to the active segment, so that one long-lived message does not
+    keep the later segments on disk.
+
+    On startup the segments are memory-mapped and only the record headers
+    are read. Request and body of the message are loaded from the journal
+    when the message is sent.
+*/
+
+QT_BEGIN_NAMESPACE
+
+// Record header: magic, operation and reserved bytes, message id, payload size
+static const quint32 JournalMagic = 0x4a4d4351; // "QCMJ"
+static const int JournalHeaderSize = 20;
+// Enqueue payload starts with type, req_id and retry_count
+static const int JournalEnqueuePrefixSize = 12;
+static const int JournalRetryCountOffset = 8;
+// Oldest segment is rewritten when at most 1/4 of its messages are live
+static const int JournalRelocateRatio = 4;
+
+/*!
+ * \brief QCloudMessagingRestJournal::QCloudMessagingRestJournal
+ * Constructor
+ */
+QCloudMessagingRestJournal::QCloudMessagingRestJournal()
+    : m_segment_size(0),
+      m_active_segment(-1),
+      m_reader_segment(-1),
+      m_compacting(false)
+{
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::~QCloudMessagingRestJournal
+ * Destructor
+ */
+QCloudMessagingRestJournal::~QCloudMessagingRestJournal()
+{
+    close();
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::open
+ * Opens the journal directory and replays the existing segments.
+ * Replayed messages are available with takeReplayedRecords().
+ *
+ * \param path
+ * Journal directory. Directory is created if it does not exist.
+ *
+ * \param segmentSize
+ * Size in bytes after which the new segment file is started.
+ *
+ * \return
+ * Returns true if journal was opened.
+ */
+bool QCloudMessagingRestJournal::open(const QString &path, qint64 segmentSize)
+{
+    close();
+
+    if (!QDir().mkpath(path))
+        return false;
+
+    m_path = path;
+    m_segment_size = segmentSize;
+
+    const QStringList files = QDir(path).entryList(
+                QStringList() << QStringLiteral("outbound-*.journal"),
+                QDir::Files, QDir::Name);
+
+    QVector<int> segments;
+    for (const QString &file : files) {
+        bool ok = false;
+        // "outbound-" prefix and ".journal" suffix
+        const int segment = file.mid(9, file.length() - 17).toInt(&ok);
+        if (ok)
+            segments.append(segment);
+    }
+    std::sort(segments.begin(), segments.end());
+
+    QHash<quint64, int> index;
+    for (int segment : qAsConst(segments)) {
+        m_segment_live_count.insert(segment, 0);
+        m_segment_record_count.insert(segment, 0);
+        if (!replaySegment(segment, &m_replayed, &index)) {
+            close();
+            return false;
+        }
+    }
+
+    // Drop the acknowledged messages
+    int live = 0;
+    for (int i = 0; i < m_replayed.count(); i++) {
+        if (m_replayed.at(i).id != 0)
+            m_replayed[live++] = m_replayed.at(i);
+    }
+    m_replayed.resize(live);
+
+    // Relocated messages are later in the journal than the newer ones,
+    // message ids keep the queue order.
+    std::sort(m_replayed.begin(), m_replayed.end(),
+              [](const QCloudMessagingJournalRecord &a, const QCloudMessagingJournalRecord &b) {
+                  return a.id < b.id;
+              });
+
+    compact();
+
+    if (!openSegment(segments.isEmpty() ? 1 : segments.last() + 1)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::close
+ * Closes the journal. Segment files are kept.
+ */
+void QCloudMessagingRestJournal::close()
+{
+    m_active.close();
+    m_reader.close();
+    m_active_segment = -1;
+    m_reader_segment = -1;
+    m_replayed.clear();
+    m_live.clear();
+    m_segment_live_count.clear();
+    m_segment_record_count.clear();
+    m_path.clear();
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::isOpen
+ * \return
+ * Returns true if journal is open.
+ */
+bool QCloudMessagingRestJournal::isOpen() const
+{
+    return m_active.isOpen();
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::takeReplayedRecords
+ * Gets the messages which were not acknowledged when the journal was
+ * opened. Messages are in the original queue order.
+ *
+ * \return
+ * Returns replayed message records.
+ */
+QVector<QCloudMessagingJournalRecord> QCloudMessagingRestJournal::takeReplayedRecords()
+{
+    QVector<QCloudMessagingJournalRecord> records;
+    records.swap(m_replayed);
+    return records;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::append
+ * Persists the queued message.
+ *
+ * \param id
+ * Message id
+ *
+ * \param msg
+ * Network message
+ *
+ * \return
+ * Returns true if message was written.
+ */
+bool QCloudMessagingRestJournal::append(quint64 id, const QCloudMessagingNetworkMessage &msg)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    const QList<QByteArray> headers = msg.request.rawHeaderList();
+
+    stream << qint32(msg.type) << qint32(msg.req_id) << qint32(msg.retry_count)
+           << msg.info << msg.related_uuid << msg.request.url()
+           << quint32(headers.count());
+    for (const QByteArray &header : headers)
+        stream << header << msg.request.rawHeader(header);
+    stream << msg.data;
+
+    qint64 offset = 0;
+    if (!writeRecord(EnqueueRecord, id, payload, &offset))
+        return false;
+
+    QCloudMessagingJournalLocation location;
+    location.segment = m_active_segment;
+    location.offset = offset;
+    location.retry_count = msg.retry_count;
+    m_live.insert(id, location);
+    m_segment_live_count[m_active_segment]++;
+    m_segment_record_count[m_active_segment]++;
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::updateRetryCount
+ * Persists the new retry count of the message.
+ *
+ * \param id
+ * Message id
+ *
+ * \param retry_count
+ * New retry count
+ *
+ * \return
+ * Returns true if update was written.
+ */
+bool QCloudMessagingRestJournal::updateRetryCount(quint64 id, int retry_count)
+{
+    auto it = m_live.find(id);
+    if (it == m_live.end())
+        return false;
+
+    // Kept for the relocation of the enqueue record
+    it.value().retry_count = retry_count;
+
+    QByteArray payload(sizeof(qint32), Qt::Uninitialized);
+    qToLittleEndian<qint32>(retry_count, reinterpret_cast<uchar *>(payload.data()));
+
+    return writeRecord(RetryRecord, id, payload);
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::remove
+ * Acknowledges the message. Segments which have no messages left are
+ * deleted.
+ *
+ * \param id
+ * Message id
+ *
+ * \return
+ * Returns true if message was found.
+ */
+bool QCloudMessagingRestJournal::remove(quint64 id)
+{
+    auto it = m_live.find(id);
+    if (it == m_live.end())
+        return false;
+
+    const int segment = it.value().segment;
+    m_live.erase(it);
+
+    writeRecord(AckRecord, id, QByteArray());
+
+    m_segment_live_count[segment]--;
+    compact();
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::load
+ * Reads the request, info and data of the message from the journal.
+ *
+ * \param id
+ * Message id
+ *
+ * \param msg
+ * Network message to fill. Retry count is not changed.
+ *
+ * \return
+ * Returns true if message was read.
+ */
+bool QCloudMessagingRestJournal::load(quint64 id, QCloudMessagingNetworkMessage *msg)
+{
+    auto it = m_live.constFind(id);
+    if (it == m_live.constEnd())
+        return false;
+
+    if (m_reader_segment != it.value().segment) {
+        m_reader.close();
+        m_reader.setFileName(segmentFileName(it.value().segment));
+        if (!m_reader.open(QIODevice::ReadOnly)) {
+            m_reader_segment = -1;
+            return false;
+        }
+        m_reader_segment = it.value().segment;
+    }
+
+    if (!m_reader.seek(it.value().offset))
+        return false;
+
+    const QByteArray header = m_reader.read(JournalHeaderSize);
+    if (header.size() != JournalHeaderSize)
+        return false;
+
+    const uchar *headerData = reinterpret_cast<const uchar *>(header.constData());
+    if (qFromLittleEndian<quint32>(headerData) != JournalMagic ||
+        qFromLittleEndian<quint64>(headerData + 8) != id)
+        return false;
+
+    const quint32 payloadSize = qFromLittleEndian<quint32>(headerData + 16);
+    const QByteArray payload = m_reader.read(payloadSize);
+    if (quint32(payload.size()) != payloadSize)
+        return false;
+
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    qint32 type;
+    qint32 req_id;
+    qint32 retry_count;
+    QString info;
+    QString related_uuid;
+    QUrl url;
+    quint32 headerCount;
+    stream >> type >> req_id >> retry_count >> info >> related_uuid >> url >> headerCount;
+
+    QNetworkRequest request(url);
+    for (quint32 i = 0; i < headerCount && stream.status() == QDataStream::Ok; i++) {
+        QByteArray name;
+        QByteArray value;
+        stream >> name >> value;
+        request.setRawHeader(name, value);
+    }
+
+    QByteArray data;
+    stream >> data;
+
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    msg->type = type;
+    msg->req_id = req_id;
+    msg->info = info;
+    msg->related_uuid = related_uuid;
+    msg->request = request;
+    msg->data = data;
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::clear
+ * Removes all messages and segment files.
+ */
+void QCloudMessagingRestJournal::clear()
+{
+    if (!isOpen())
+        return;
+
+    m_active.close();
+    m_reader.close();
+    m_reader_segment = -1;
+
+    for (auto it = m_segment_live_count.cbegin(); it != m_segment_live_count.cend(); ++it)
+        QFile::remove(segmentFileName(it.key()));
+
+    m_live.clear();
+    m_segment_live_count.clear();
+    m_segment_record_count.clear();
+
+    openSegment(m_active_segment + 1);
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::segmentCount
+ * \return
+ * Returns the amount of segment files in use.
+ */
+int QCloudMessagingRestJournal::segmentCount() const
+{
+    return m_segment_live_count.count();
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::segmentFileName
+ * \param segment
+ * Segment number
+ *
+ * \return
+ * Returns the file name of the segment.
+ */
+QString QCloudMessagingRestJournal::segmentFileName(int segment) const
+{
+    return m_path + QStringLiteral("/outbound-") +
+           QStringLiteral("%1").arg(segment, 8, 10, QLatin1Char('0')) +
+           QStringLiteral(".journal");
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::replaySegment
+ * Reads the record headers of the memory-mapped segment. Incomplete
+ * record at the end of the segment is truncated.
+ *
+ * \param segment
+ * Segment number
+ *
+ * \param records
+ * Replayed records in queue order. Acknowledged records get id 0.
+ *
+ * \param index
+ * Index of the replayed records by the message id.
+ *
+ * \return
+ * Returns true if segment was read.
+ */
+bool QCloudMessagingRestJournal::replaySegment(int segment,
+                                               QVector<QCloudMessagingJournalRecord> *records,
+                                               QHash<quint64, int> *index)
+{
+    QFile file(segmentFileName(segment));
+    if (!file.open(QIODevice::ReadWrite))
+        return false;
+
+    const qint64 size = file.size();
+    if (size == 0)
+        return true;
+
+    uchar *data = file.map(0, size);
+    if (!data)
+        return false;
+
+    qint64 offset = 0;
+    while (offset + JournalHeaderSize <= size) {
+        const uchar *header = data + offset;
+        if (qFromLittleEndian<quint32>(header) != JournalMagic)
+            break;
+
+        const int op = header[4];
+        const quint64 id = qFromLittleEndian<quint64>(header + 8);
+        const quint32 payloadSize = qFromLittleEndian<quint32>(header + 16);
+        const qint64 next = offset + JournalHeaderSize + payloadSize;
+        if (next > size)
+            break;
+
+        const uchar *payload = header + JournalHeaderSize;
+
+        switch (op) {
+        case EnqueueRecord:
+            if (payloadSize >= quint32(JournalEnqueuePrefixSize)) {
+                QCloudMessagingJournalRecord record;
+                record.id = id;
+                record.type = qFromLittleEndian<qint32>(payload);
+                record.req_id = qFromLittleEndian<qint32>(payload + 4);
+                record.retry_count = qFromLittleEndian<qint32>(payload + 8);
+
+                // Relocated copy replaces the original record, which is
+                // still found if the relocation was interrupted
+                auto live = m_live.find(id);
+                if (live != m_live.end())
+                    m_segment_live_count[live.value().segment]--;
+
+                const int i = index->value(id, -1);
+                if (i >= 0) {
+                    (*records)[i] = record;
+                } else {
+                    index->insert(id, records->count());
+                    records->append(record);
+                }
+
+                QCloudMessagingJournalLocation location;
+                location.segment = segment;
+                location.offset = offset;
+                location.retry_count = record.retry_count;
+                m_live.insert(id, location);
+                m_segment_live_count[segment]++;
+                m_segment_record_count[segment]++;
+            }
+            break;
+        case RetryRecord:
+            if (payloadSize >= sizeof(qint32)) {
+                const int i = index->value(id, -1);
+                if (i >= 0)
+                    (*records)[i].retry_count = qFromLittleEndian<qint32>(payload);
+                auto live = m_live.find(id);
+                if (live != m_live.end())
+                    live.value().retry_count = qFromLittleEndian<qint32>(payload);
+            }
+            break;
+        case AckRecord: {
+            auto live = m_live.find(id);
+            if (live != m_live.end()) {
+                m_segment_live_count[live.value().segment]--;
+                m_live.erase(live);
+            }
+            const int i = index->value(id, -1);
+            if (i >= 0) {
+                (*records)[i].id = 0;
+                index->remove(id);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        offset = next;
+    }
+
+    file.unmap(data);
+
+    // Process was stopped in the middle of a write
+    if (offset < size)
+        file.resize(offset);
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::openSegment
+ * Starts new active segment.
+ *
+ * \param segment
+ * Segment number
+ *
+ * \return
+ * Returns true if segment was opened.
+ */
+bool QCloudMessagingRestJournal::openSegment(int segment)
+{
+    m_active.close();
+    m_active.setFileName(segmentFileName(segment));
+    if (!m_active.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+
+    m_active_segment = segment;
+    if (!m_segment_live_count.contains(segment)) {
+        m_segment_live_count.insert(segment, 0);
+        m_segment_record_count.insert(segment, 0);
+    }
+
+    compact();
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::writeRecord
+ * Appends the record to the active segment. New segment is started
+ * when the active one is full.
+ *
+ * \param op
+ * Record operation
+ *
+ * \param id
+ * Message id
+ *
+ * \param payload
+ * Record payload
+ *
+ * \param offset
+ * If not nullptr, set to the offset of the record in the active segment.
+ *
+ * \return
+ * Returns true if record was written.
+ */
+bool QCloudMessagingRestJournal::writeRecord(RecordOperation op, quint64 id,
+                                             const QByteArray &payload, qint64 *offset)
+{
+    if (!m_active.isOpen())
+        return false;
+
+    if (m_active.size() >= m_segment_size && !openSegment(m_active_segment + 1))
+        return false;
+
+    QByteArray record(JournalHeaderSize, Qt::Uninitialized);
+    record.reserve(JournalHeaderSize + payload.size());
+
+    uchar *header = reinterpret_cast<uchar *>(record.data());
+    qToLittleEndian<quint32>(JournalMagic, header);
+    header[4] = uchar(op);
+    header[5] = 0;
+    header[6] = 0;
+    header[7] = 0;
+    qToLittleEndian<quint64>(id, header + 8);
+    qToLittleEndian<quint32>(quint32(payload.size()), header + 16);
+    record.append(payload);
+
+    if (offset)
+        *offset = m_active.size();
+
+    if (m_active.write(record) != record.size())
+        return false;
+
+    // Flush to the operating system, so the record survives the process restart
+    return m_active.flush();
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::compact
+ * Deletes the oldest segments which have no messages left. Only the
+ * oldest segments can be deleted, because newer segments contain the
+ * acknowledgements for messages in the older segments. Live messages of
+ * the mostly acknowledged oldest segment are copied to the active segment
+ * first.
+ */
+void QCloudMessagingRestJournal::compact()
+{
+    // Relocation writes to the active segment, which may start a new one
+    if (m_compacting)
+        return;
+    m_compacting = true;
+
+    while (!m_segment_live_count.isEmpty()) {
+        auto it = m_segment_live_count.begin();
+        const int segment = it.key();
+        if (segment == m_active_segment)
+            break;
+
+        if (it.value() > 0) {
+            if (!m_active.isOpen() ||
+                it.value() * JournalRelocateRatio > m_segment_record_count.value(segment) ||
+                !relocateSegment(segment))
+                break;
+        }
+
+        if (m_reader_segment == segment) {
+            m_reader.close();
+            m_reader_segment = -1;
+        }
+
+        QFile::remove(segmentFileName(segment));
+        m_segment_live_count.remove(segment);
+        m_segment_record_count.remove(segment);
+    }
+
+    m_compacting = false;
+}
+
+/*!
+ * \brief QCloudMessagingRestJournal::relocateSegment
+ * Copies the enqueue records of the live messages in the segment to the
+ * active segment with their current retry counts. Copy replaces the
+ * original when the journal is replayed.
+ *
+ * \param segment
+ * Segment number
+ *
+ * \return
+ * Returns true if all live messages were copied.
+ */
+bool QCloudMessagingRestJournal::relocateSegment(int segment)
+{
+    QFile file(segmentFileName(segment));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QVector<quint64> ids;
+    for (auto it = m_live.cbegin(); it != m_live.cend(); ++it) {
+        if (it.value().segment == segment)
+            ids.append(it.key());
+    }
+
+    for (quint64 id : qAsConst(ids)) {
+        QCloudMessagingJournalLocation &location = m_live[id];
+
+        if (!file.seek(location.offset))
+            return false;
+
+        const QByteArray header = file.read(JournalHeaderSize);
+        if (header.size() != JournalHeaderSize)
+            return false;
+
+        const quint32 payloadSize = qFromLittleEndian<quint32>(
+                    reinterpret_cast<const uchar *>(header.constData()) + 16);
+        QByteArray payload = file.read(payloadSize);
+        if (quint32(payload.size()) != payloadSize ||
+            payloadSize < quint32(JournalEnqueuePrefixSize))
+            return false;
+
+        qToLittleEndian<qint32>(location.retry_count,
+                                reinterpret_cast<uchar *>(payload.data()) + JournalRetryCountOffset);
+
+        qint64 offset = 0;
+        if (!writeRecord(EnqueueRecord, id, payload, &offset))
+            return false;
+
+        m_segment_live_count[segment]--;
+        location.segment = m_active_segment;
+        location.offset = offset;
+        m_segment_live_count[m_active_segment]++;
+        m_segment_record_count[m_active_segment]++;
+    }
+
+    return true;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,128 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGRESTJOURNAL_P_H
+#define QCLOUDMESSAGINGRESTJOURNAL_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/qcloudmessagingrestapi.h>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingJournalRecord
+{
+public:
+    quint64 id;
+    int type;
+    int req_id;
+    int retry_count;
+};
+
+class QCloudMessagingJournalLocation
+{
+public:
+    int segment;
+    qint64 offset;
+    int retry_count;
+};
+
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingRestJournal
+{
+public:
+    QCloudMessagingRestJournal();
+    ~QCloudMessagingRestJournal();
+
+    bool open(const QString &path, qint64 segmentSize);
+
+    void close();
+
+    bool isOpen() const;
+
+    QVector<QCloudMessagingJournalRecord> takeReplayedRecords();
+
+    bool append(quint64 id, const QCloudMessagingNetworkMessage &msg);
+
+    bool updateRetryCount(quint64 id, int retry_count);
+
+    bool remove(quint64 id);
+
+    bool load(quint64 id, QCloudMessagingNetworkMessage *msg);
+
+    void clear();
+
+    int segmentCount() const;
+
+private:
+    Q_DISABLE_COPY(QCloudMessagingRestJournal)
+
+    enum RecordOperation {
+        EnqueueRecord = 1,
+        RetryRecord,
+        AckRecord
+    };
+
+    QString segmentFileName(int segment) const;
+    bool replaySegment(int segment, QVector<QCloudMessagingJournalRecord> *records,
+                       QHash<quint64, int> *index);
+    bool openSegment(int segment);
+    bool writeRecord(RecordOperation op, quint64 id, const QByteArray &payload,
+                     qint64 *offset = nullptr);
+    void compact();
+    bool relocateSegment(int segment);
+
+    QString m_path;
+    qint64 m_segment_size;
+    QFile m_active;
+    int m_active_segment;
+    QFile m_reader;
+    int m_reader_segment;
+
+    QVector<QCloudMessagingJournalRecord> m_replayed;
+    QHash<quint64, QCloudMessagingJournalLocation> m_live;
+    QMap<int, int> m_segment_live_count;
+    QMap<int, int> m_segment_record_count;
+    bool m_compacting;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGRESTJOURNAL_P_H
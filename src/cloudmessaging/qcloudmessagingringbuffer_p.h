@@ -0,0 +1,162 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGRINGBUFFER_P_H
+#define QCLOUDMESSAGINGRINGBUFFER_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QAtomicInteger>
+#include <QScopedArrayPointer>
+#include <QThread>
+
+QT_BEGIN_NAMESPACE
+
+/*
+ * Bounded lock-free queue of preallocated slots, safe for many producers and
+ * one consumer. Producers fill a slot in place and the consumer reads it in
+ * place before handing it back, so passing a message allocates nothing once
+ * the slots have grown to the payload size. Based on the sequence-numbered
+ * array queue by Dmitry Vyukov.
+ */
+template <typename T>
+class QCloudMessagingRingBuffer
+{
+public:
+    enum OverflowPolicy {
+        DropNewest,
+        Block
+    };
+
+    explicit QCloudMessagingRingBuffer(int capacity = 1024,
+                                       OverflowPolicy policy = DropNewest)
+        : m_policy(policy)
+    {
+        int size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        m_mask = quintptr(size - 1);
+        m_cells.reset(new Cell[size]);
+        for (int i = 0; i < size; i++)
+            m_cells[i].sequence.store(quintptr(i));
+    }
+
+    int capacity() const { return int(m_mask + 1); }
+
+    OverflowPolicy overflowPolicy() const { return m_policy; }
+    void setOverflowPolicy(OverflowPolicy policy) { m_policy = policy; }
+
+    // Calls fill(T &) on a free slot. With DropNewest a full buffer drops the
+    // message and counts it, with Block the producer waits for the consumer.
+    template <typename F>
+    bool push(F fill)
+    {
+        Cell *cell;
+        quintptr pos = m_enqueue.load();
+        forever {
+            cell = &m_cells[int(pos & m_mask)];
+            const qintptr diff = qintptr(cell->sequence.loadAcquire()) - qintptr(pos);
+            if (diff == 0) {
+                if (m_enqueue.testAndSetRelaxed(pos, pos + 1, pos))
+                    break;
+            } else if (diff < 0) {
+                if (m_policy == DropNewest) {
+                    m_dropped.fetchAndAddRelaxed(1);
+                    return false;
+                }
+                QThread::yieldCurrentThread();
+                pos = m_enqueue.load();
+            } else {
+                pos = m_enqueue.load();
+            }
+        }
+
+        fill(cell->value);
+        cell->sequence.storeRelease(pos + 1);
+        return true;
+    }
+
+    // Calls consume(T &) for up to max queued slots in FIFO order.
+    template <typename F>
+    int drain(F consume, int max = -1)
+    {
+        int drained = 0;
+        while (max < 0 || drained < max) {
+            const quintptr pos = m_dequeue.load();
+            Cell *cell = &m_cells[int(pos & m_mask)];
+            if (qintptr(cell->sequence.loadAcquire()) - qintptr(pos + 1) < 0)
+                break;
+
+            m_dequeue.store(pos + 1);
+            consume(cell->value);
+            cell->sequence.storeRelease(pos + m_mask + 1);
+            drained++;
+        }
+        return drained;
+    }
+
+    int count() const
+    {
+        return int(m_enqueue.load() - m_dequeue.load());
+    }
+
+    bool isEmpty() const { return count() <= 0; }
+
+    quint32 droppedCount() const { return m_dropped.load(); }
+
+private:
+    struct Cell {
+        QAtomicInteger<quintptr> sequence;
+        T value;
+    };
+
+    // Producers and the consumer update different counters; keep them on
+    // separate cache lines.
+    alignas(64) QAtomicInteger<quintptr> m_enqueue;
+    alignas(64) QAtomicInteger<quintptr> m_dequeue;
+    QAtomicInteger<quint32> m_dropped;
+    QScopedArrayPointer<Cell> m_cells;
+    quintptr m_mask;
+    OverflowPolicy m_policy;
+
+    Q_DISABLE_COPY(QCloudMessagingRingBuffer)
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGRINGBUFFER_P_H
@@ -0,0 +1,285 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qcloudmessagingtokenstore.h"
+#include "qcloudmessagingtokenstore_p.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+/*!
+    \class QCloudMessagingTokenStore
+    \inmodule QtCloudMessaging
+    \since 5.11
+
+    \brief The QCloudMessagingTokenStore class keeps the client tokens of the
+    cloud messaging backends in memory and writes them behind to QSettings.
+
+    Tokens are loaded once when the store is created. Setting a token only
+    updates the memory copy; the settings are written after writeDelay()
+    milliseconds, on flush() or when the application quits, and only for
+    the tokens whose value differs from the stored one. This keeps repeated
+    token updates from rewriting flash backed storage.
+
+    Tokens are stored under the \c clients group of the settings, so a key
+    like \c {<address>/rid} maps to \c {clients/<address>/rid}.
+
+    All functions are thread-safe.
+*/
+
+QT_BEGIN_NAMESPACE
+
+Q_GLOBAL_STATIC(QCloudMessagingTokenStore, defaultTokenStore)
+
+static const char tokenStoreGroup[] = "clients";
+
+/*!
+ * \brief QCloudMessagingTokenStore::QCloudMessagingTokenStore
+ * Creates the store on the default application QSettings.
+ *
+ * \param parent
+ * QObject parent
+ */
+QCloudMessagingTokenStore::QCloudMessagingTokenStore(QObject *parent) :
+    QObject(parent),
+    d(new QCloudMessagingTokenStorePrivate)
+{
+    d->m_settings.reset(new QSettings);
+    d->m_writeTimer.setParent(this);
+    connect(&d->m_writeTimer, &QTimer::timeout, this, &QCloudMessagingTokenStore::flush);
+    d->load();
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::QCloudMessagingTokenStore
+ * Creates the store on an INI file.
+ *
+ * \param fileName
+ * Settings file path
+ *
+ * \param parent
+ * QObject parent
+ */
+QCloudMessagingTokenStore::QCloudMessagingTokenStore(const QString &fileName, QObject *parent) :
+    QObject(parent),
+    d(new QCloudMessagingTokenStorePrivate)
+{
+    d->m_settings.reset(new QSettings(fileName, QSettings::IniFormat));
+    d->m_writeTimer.setParent(this);
+    connect(&d->m_writeTimer, &QTimer::timeout, this, &QCloudMessagingTokenStore::flush);
+    d->load();
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::~QCloudMessagingTokenStore
+ * Writes pending changes.
+ */
+QCloudMessagingTokenStore::~QCloudMessagingTokenStore()
+{
+    flush();
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::defaultStore
+ * Gets the store shared by the cloud messaging backends. The store lives in
+ * the application thread and flushes when the application is about to quit.
+ *
+ * \return
+ * Default store, nullptr during application shutdown.
+ */
+QCloudMessagingTokenStore *QCloudMessagingTokenStore::defaultStore()
+{
+    static QBasicMutex setupLock;
+    QMutexLocker locker(&setupLock);
+
+    const bool created = !defaultTokenStore.exists();
+    QCloudMessagingTokenStore *store = defaultTokenStore();
+    if (created && store) {
+        if (QCoreApplication *app = QCoreApplication::instance()) {
+            if (store->thread() != app->thread())
+                store->moveToThread(app->thread());
+            connect(app, &QCoreApplication::aboutToQuit,
+                    store, &QCloudMessagingTokenStore::flush);
+        }
+    }
+    return store;
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::token
+ * \param key
+ * Token key, e.g. client address and token name
+ *
+ * \return
+ * Token value, or empty string if not known.
+ */
+QString QCloudMessagingTokenStore::token(const QString &key) const
+{
+    QMutexLocker locker(&d->m_lock);
+    return d->m_tokens.value(key);
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::setToken
+ * Updates the token in memory and schedules a write if it changed.
+ *
+ * \param key
+ * Token key
+ *
+ * \param token
+ * Token value, empty value removes the token.
+ *
+ * \return
+ * true if the value changed.
+ */
+bool QCloudMessagingTokenStore::setToken(const QString &key, const QString &token)
+{
+    {
+        QMutexLocker locker(&d->m_lock);
+        auto it = d->m_tokens.find(key);
+        if (token.isEmpty()) {
+            if (it == d->m_tokens.end())
+                return false;
+            d->m_tokens.erase(it);
+        } else {
+            if (it != d->m_tokens.end() && it.value() == token)
+                return false;
+            d->m_tokens.insert(key, token);
+        }
+    }
+
+    if (thread() == QThread::currentThread())
+        scheduleWrite();
+    else
+        QMetaObject::invokeMethod(this, "scheduleWrite", Qt::QueuedConnection);
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::removeToken
+ * \param key
+ * Token key
+ */
+void QCloudMessagingTokenStore::removeToken(const QString &key)
+{
+    setToken(key, QString());
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::setWriteDelay
+ * \param msecs
+ * Delay from the first change to the write in milliseconds. Changes made in
+ * between are written together.
+ */
+void QCloudMessagingTokenStore::setWriteDelay(int msecs)
+{
+    d->m_writeTimer.setInterval(msecs);
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::writeDelay
+ * \return
+ */
+int QCloudMessagingTokenStore::writeDelay() const
+{
+    return d->m_writeTimer.interval();
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::isDirty
+ * \return
+ * true if some token differs from the stored value.
+ */
+bool QCloudMessagingTokenStore::isDirty() const
+{
+    QMutexLocker locker(&d->m_lock);
+    return d->m_tokens != d->m_persisted;
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::flush
+ * Writes the changed tokens to the settings.
+ */
+void QCloudMessagingTokenStore::flush()
+{
+    QMutexLocker locker(&d->m_lock);
+
+    if (thread() == QThread::currentThread())
+        d->m_writeTimer.stop();
+
+    if (d->m_tokens == d->m_persisted)
+        return;
+
+    d->m_settings->beginGroup(QLatin1String(tokenStoreGroup));
+    for (auto it = d->m_persisted.constBegin(); it != d->m_persisted.constEnd(); ++it) {
+        if (!d->m_tokens.contains(it.key()))
+            d->m_settings->remove(it.key());
+    }
+    for (auto it = d->m_tokens.constBegin(); it != d->m_tokens.constEnd(); ++it) {
+        auto persisted = d->m_persisted.constFind(it.key());
+        if (persisted == d->m_persisted.constEnd() || persisted.value() != it.value())
+            d->m_settings->setValue(it.key(), it.value());
+    }
+    d->m_settings->endGroup();
+    d->m_settings->sync();
+
+    d->m_persisted = d->m_tokens;
+}
+
+/*!
+ * \brief QCloudMessagingTokenStore::scheduleWrite
+ */
+void QCloudMessagingTokenStore::scheduleWrite()
+{
+    if (!d->m_writeTimer.isActive())
+        d->m_writeTimer.start();
+}
+
+/*!
+ * \brief QCloudMessagingTokenStorePrivate::load
+ * Reads all tokens once when the store is created.
+ */
+void QCloudMessagingTokenStorePrivate::load()
+{
+    QMutexLocker locker(&m_lock);
+
+    m_settings->beginGroup(QLatin1String(tokenStoreGroup));
+    const QStringList keys = m_settings->allKeys();
+    for (const QString &key : keys) {
+        const QString value = m_settings->value(key).toString();
+        if (!value.isEmpty())
+            m_tokens.insert(key, value);
+    }
+    m_settings->endGroup();
+
+    m_persisted = m_tokens;
+}
+
+QT_END_NAMESPACE
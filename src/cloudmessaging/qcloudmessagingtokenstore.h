@@ -0,0 +1,80 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGTOKENSTORE_H
+#define QCLOUDMESSAGINGTOKENSTORE_H
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+
+#include <QObject>
+#include <QString>
+#include <QScopedPointer>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingTokenStorePrivate;
+
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingTokenStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QCloudMessagingTokenStore(QObject *parent = nullptr);
+
+    explicit QCloudMessagingTokenStore(const QString &fileName, QObject *parent = nullptr);
+
+    ~QCloudMessagingTokenStore();
+
+    static QCloudMessagingTokenStore *defaultStore();
+
+    QString token(const QString &key) const;
+
+    bool setToken(const QString &key, const QString &token);
+
+    void removeToken(const QString &key);
+
+    void setWriteDelay(int msecs);
+
+    int writeDelay() const;
+
+    bool isDirty() const;
+
+public Q_SLOTS:
+    void flush();
+
+private Q_SLOTS:
+    void scheduleWrite();
+
+private:
+    QScopedPointer<QCloudMessagingTokenStorePrivate> d;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGTOKENSTORE_H
@@ -1,5 +1,5 @@
 TARGET = QtCloudMessagingEmbeddedKaltiot
-QT = core cloudmessaging
+QT = core cloudmessaging cloudmessaging-private
 
 # Check for KALTIOT_SDK environment
 ENV_KALTIOT_SDK = $$(KALTIOT_SDK)
@@ -21,11 +21,19 @@ HEADERS += \
     qcloudmessagingembeddedkaltiotprovider.h \
     qcloudmessagingembeddedkaltiotclient_p.h \
     qcloudmessagingembeddedkaltiotprovider_p.h \
+    qcloudmessagingembeddedkaltiotloop_p.h \
+    qcloudmessagingembeddedkaltiotdispatcher_p.h \
+    qcloudmessagingembeddedkaltiotexecutor_p.h \
+    qcloudmessagingembeddedkaltiotregistry_p.h \
     qcloudmessagingembeddedkaltiotrest.h
 
 SOURCES += \
     qcloudmessagingembeddedkaltiotclient.cpp \
     qcloudmessagingembeddedkaltiotprovider.cpp \
+    qcloudmessagingembeddedkaltiotloop.cpp \
+    qcloudmessagingembeddedkaltiotdispatcher.cpp \
+    qcloudmessagingembeddedkaltiotexecutor.cpp \
+    qcloudmessagingembeddedkaltiotregistry.cpp \
     qcloudmessagingembeddedkaltiotrest.cpp
 
 android {
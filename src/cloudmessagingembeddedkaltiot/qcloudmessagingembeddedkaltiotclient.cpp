@@ -28,8 +28,15 @@
 
 #include "qcloudmessagingembeddedkaltiotclient.h"
 #include <qcloudmessagingembeddedkaltiotclient_p.h>
+#include "qcloudmessagingembeddedkaltiotdispatcher_p.h"
 
+#include <QtCloudMessaging/qcloudmessagingtokenstore.h>
+
+#include <QMutex>
 #include <QStringList>
+#include <QVector>
+
+#include <cstring>
 
 #ifdef ANDROID_OS
 #include <QtAndroid>
@@ -46,6 +53,9 @@ QCloudMessagingEmbeddedKaltiotClient::QCloudMessagingEmbeddedKaltiotClient(QObje
     QCloudMessagingClient(parent),
     d(new QCloudMessagingEmbeddedKaltiotClientPrivate)
 {
+    connect(&d->m_registrationTimer, &QTimer::timeout, [ = ] {
+        register_kaltiot_channels();
+    });
 }
 
 /*!
@@ -54,12 +64,10 @@ QCloudMessagingEmbeddedKaltiotClient::QCloudMessagingEmbeddedKaltiotClient(QObje
  */
 QCloudMessagingEmbeddedKaltiotClient::~QCloudMessagingEmbeddedKaltiotClient()
 {
-    // if thread is running, ask for exit it first and then terminate thread
-    if (d->m_running && d->m_clientThread.isRunning()) {
-        d->m_running = false;
-        d->m_clientThread.quit();
-        d->m_clientThread.terminate();
-    }
+    d->m_running = false;
+    d->m_registrationTimer.stop();
+    d->m_loop->stop();
+    QCloudMessagingEmbeddedKaltiotDispatcher::instance()->unregisterClient(this);
 }
 
 /*!
@@ -83,6 +91,21 @@ QString QCloudMessagingEmbeddedKaltiotClient::connectClient(const QString &clien
 
     channels = params.value(QStringLiteral("channels")).toStringList();
 
+    // Inbound queue can be resized only while no callbacks are routed here.
+    const int queueSize = params.value(QStringLiteral("inbound_queue_size"),
+                                       int(QCloudMessagingEmbeddedKaltiotClientPrivate::InboundQueueSize)).toInt();
+    const QCloudMessagingEmbeddedKaltiotInboundQueue::OverflowPolicy policy =
+            params.value(QStringLiteral("inbound_overflow")).toString() == QLatin1String("block")
+            ? QCloudMessagingEmbeddedKaltiotInboundQueue::Block
+            : QCloudMessagingEmbeddedKaltiotInboundQueue::DropNewest;
+    if (QCloudMessagingEmbeddedKaltiotDispatcher::instance()->clientForInstance(
+                &d->m_kaltiot_client_instance) != this
+            && queueSize > d->m_inbound->capacity()) {
+        d->m_inbound.reset(new QCloudMessagingEmbeddedKaltiotInboundQueue(queueSize, policy));
+    } else {
+        d->m_inbound->setOverflowPolicy(policy);
+    }
+
     for (int i = 0; i < channels.count(); i++) {
         bool new_channel = true;
         for (int j = 0; j < d->m_channels.count(); j++) {
@@ -96,6 +119,10 @@ QString QCloudMessagingEmbeddedKaltiotClient::connectClient(const QString &clien
 
     setClientToken(clientId);
 
+    // Callbacks may arrive already while registering.
+    QCloudMessagingEmbeddedKaltiotDispatcher::instance()->registerClient(
+                this, d->m_address, &d->m_kaltiot_client_instance);
+
     if (!make_kaltiot_client_registration())
         return QString();
 
@@ -108,21 +135,13 @@ QString QCloudMessagingEmbeddedKaltiotClient::connectClient(const QString &clien
  */
 void QCloudMessagingEmbeddedKaltiotClient::runBackgroundThread()
 {
-    this->moveToThread(&d->m_clientThread);
-    d->m_clientThread.start();
-
-    // Run service task in the thread.
-    connect(&(d->m_threadTimer), &QTimer::timeout, [ = ] {
-
-        if (!d->m_running) d->m_running = true;
+    // Service task runs on a shared executor worker whenever the daemon
+    // socket has data; restarting an already running loop picks up the
+    // socket of the new connection.
+    d->m_running = true;
 #ifdef EMBEDDED_AND_DESKTOP_OS
-        ks_gw_client_task(&d->m_kaltiot_client_instance);
+    d->m_loop->start();
 #endif
-        d->m_threadTimer.start();
-    });
-
-    d->m_threadTimer.setInterval(1);
-    d->m_threadTimer.start();
 }
 
 /*!
@@ -132,15 +151,7 @@ bool QCloudMessagingEmbeddedKaltiotClient::make_kaltiot_client_registration()
 {
 #ifdef EMBEDDED_AND_DESKTOP_OS
 
-    char const *channels[d->m_channels.count()];
-    QList<QByteArray> constChannels;
-
-    for (int i = 0; i < d->m_channels.count(); i++) {
-        constChannels.append(d->m_channels[i].toLatin1());
-        channels[i] = constChannels[constChannels.count()-1].constData();
-    }
-
-    uint16_t num_channels = d->m_channels.count();
+    QMutexLocker locker(d->m_loop->taskLock());
 
     ks_gw_client_init(&d->m_kaltiot_client_instance);
 
@@ -153,7 +164,8 @@ bool QCloudMessagingEmbeddedKaltiotClient::make_kaltiot_client_registration()
         return false; // Failed to connect!;
 
     if (d->m_rid.isEmpty()) {
-        d->m_rid = d->m_client_settings.value("clients/" + d->m_address + "/rid").toString();
+        d->m_rid = QCloudMessagingTokenStore::defaultStore()->token(
+                    d->m_address + QStringLiteral("/rid"));
     }
 
     if (!d->m_rid.isEmpty())
@@ -164,16 +176,11 @@ bool QCloudMessagingEmbeddedKaltiotClient::make_kaltiot_client_registration()
     ks_gw_client_set_network_available(&d->m_kaltiot_client_instance,
                                        NETWORK_STATE_MOBILE_2G, "123","45");
 
-    ks_gw_client_register_iot(&d->m_kaltiot_client_instance,
-                              d->m_address.toLatin1().constData(),
-                              d->m_version.toLatin1().constData(),
-                              d->m_customer_id.toLatin1().constData(),
-                              channels, num_channels);
+    d->m_registered = true;
+    register_kaltiot_channels();
 
     ks_gw_client_request_rid(&d->m_kaltiot_client_instance);
 
-    constChannels.clear();
-
 #endif
 
 #ifdef ANDROID_OS
@@ -182,7 +189,8 @@ bool QCloudMessagingEmbeddedKaltiotClient::make_kaltiot_client_registration()
 
     d->m_rid = j_rid.toString();
     if (d->m_rid.isEmpty()) {
-        d->m_rid = d->m_client_settings.value("clients/" + d->m_address + "/rid").toString();
+        d->m_rid = QCloudMessagingTokenStore::defaultStore()->token(
+                    d->m_address + QStringLiteral("/rid"));
 
     }
     if (!d->m_rid.isEmpty())
@@ -192,6 +200,49 @@ bool QCloudMessagingEmbeddedKaltiotClient::make_kaltiot_client_registration()
     return true;
 }
 
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotClient::register_kaltiot_channels
+ * Registers the IoT address with the current channel list. Registering again
+ * replaces the channels of the address, so no reconnect is needed.
+ */
+void QCloudMessagingEmbeddedKaltiotClient::register_kaltiot_channels()
+{
+    d->m_registrationTimer.stop();
+    if (!d->m_registered)
+        return;
+
+#ifdef EMBEDDED_AND_DESKTOP_OS
+    QMutexLocker locker(d->m_loop->taskLock());
+
+    QVector<QByteArray> constChannels;
+    QVector<const char *> channels;
+    constChannels.reserve(d->m_channels.count());
+    channels.reserve(d->m_channels.count());
+
+    for (const QString &channel : qAsConst(d->m_channels)) {
+        constChannels.append(channel.toLatin1());
+        channels.append(constChannels.last().constData());
+    }
+
+    ks_gw_client_register_iot(&d->m_kaltiot_client_instance,
+                              d->m_address.toLatin1().constData(),
+                              d->m_version.toLatin1().constData(),
+                              d->m_customer_id.toLatin1().constData(),
+                              channels.data(), uint16_t(channels.count()));
+    d->m_loop->wake();
+#endif
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotClient::scheduleChannelRegistration
+ * Coalesces channel changes made in a burst into one registration.
+ */
+void QCloudMessagingEmbeddedKaltiotClient::scheduleChannelRegistration()
+{
+    if (d->m_registered && !d->m_registrationTimer.isActive())
+        d->m_registrationTimer.start();
+}
+
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotClient::sendMessage
  * \param msg
@@ -211,11 +262,13 @@ bool QCloudMessagingEmbeddedKaltiotClient::sendMessage(const QByteArray &msg,
 
 #ifdef EMBEDDED_AND_DESKTOP_OS
     // TAG NOT USED ATM.
+    QMutexLocker locker(d->m_loop->taskLock());
     ks_gw_client_publish_message(&d->m_kaltiot_client_instance,
                                  (const uint8_t *)msg.constData(),
                                  msg.size(),
                                  KS_GW_CLIENT_PAYLOAD_STRING,
                                  nullptr);
+    d->m_loop->wake();
 #endif
 
     return true;
@@ -230,12 +283,17 @@ void QCloudMessagingEmbeddedKaltiotClient::disconnectClient()
     QCloudMessagingClient::disconnectClient();
 
     d->m_running = false;
+    d->m_registered = false;
+    d->m_registrationTimer.stop();
+    d->m_loop->stop();
 #ifdef EMBEDDED_AND_DESKTOP_OS
+    QMutexLocker locker(d->m_loop->taskLock());
     ks_gw_client_unregister_iot(&d->m_kaltiot_client_instance, d->m_address.toLatin1(),
                                 d->m_version.toLatin1(), clientToken().toLatin1());
     ks_gw_client_disconnect(&d->m_kaltiot_client_instance);
     ks_gw_client_set_engine_enabled(&d->m_kaltiot_client_instance, false);
 #endif
+    QCloudMessagingEmbeddedKaltiotDispatcher::instance()->unregisterClient(this);
 }
 
 /*!
@@ -246,7 +304,70 @@ void QCloudMessagingEmbeddedKaltiotClient::disconnectClient()
 void  QCloudMessagingEmbeddedKaltiotClient::cloudMessageReceived(const QString &client,
                                                                  const QByteArray &message)
 {
-    emit messageReceived(client, message);
+    deliverMessage(client, message);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotClient::postCloudMessage
+ * Queues a notification from the Kaltiot callback thread. The payload is
+ * copied into a preallocated slot and the client thread is woken once per
+ * batch to deliver the queued notifications.
+ *
+ * \param address
+ * \param payload
+ * \param length
+ * \return
+ * false if the inbound queue was full and the notification was dropped.
+ */
+bool QCloudMessagingEmbeddedKaltiotClient::postCloudMessage(const char *address,
+                                                            const char *payload,
+                                                            int length)
+{
+    const bool queued = d->m_inbound->push([ = ](QCloudMessagingEmbeddedKaltiotInbound &slot) {
+        slot.address.resize(0);
+        slot.address.append(address);
+        slot.payload.resize(length);
+        if (length > 0)
+            memcpy(slot.payload.data(), payload, size_t(length));
+    });
+
+#ifdef EMBEDDED_AND_DESKTOP_OS
+    d->m_loop->wake();
+#endif
+
+    if (queued && d->m_inboundWakeup.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drainInboundMessages", Qt::QueuedConnection);
+
+    return queued;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotClient::drainInboundMessages
+ * Delivers queued notifications in order. A long burst is delivered in
+ * batches of one queue size to keep the event loop responsive.
+ */
+void QCloudMessagingEmbeddedKaltiotClient::drainInboundMessages()
+{
+    // Clear first, a notification queued after this wakes us again.
+    d->m_inboundWakeup.store(0);
+
+    d->m_inbound->drain([this](QCloudMessagingEmbeddedKaltiotInbound &slot) {
+        cloudMessageReceived(QString::fromLatin1(slot.address),
+                             QByteArray(slot.payload.constData(), slot.payload.size()));
+    }, d->m_inbound->capacity());
+
+    if (!d->m_inbound->isEmpty() && d->m_inboundWakeup.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drainInboundMessages", Qt::QueuedConnection);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotClient::droppedMessageCount
+ * \return
+ * Amount of notifications dropped because the inbound queue was full.
+ */
+quint32 QCloudMessagingEmbeddedKaltiotClient::droppedMessageCount() const
+{
+    return d->m_inbound->droppedCount();
 }
 
 /*!
@@ -256,8 +377,11 @@ void  QCloudMessagingEmbeddedKaltiotClient::cloudMessageReceived(const QString &
 void QCloudMessagingEmbeddedKaltiotClient::setClientToken(const QString &token)
 {
     d->m_rid = token;
+
+    // Written behind and only if the rid really changed.
     if (!d->m_rid.isEmpty())
-        d->m_client_settings.setValue("clients/" + d->m_address + "/rid", d->m_rid);
+        QCloudMessagingTokenStore::defaultStore()->setToken(d->m_address + QStringLiteral("/rid"),
+                                                            d->m_rid);
 
     emit clientTokenReceived(d->m_rid);
 }
@@ -282,65 +406,69 @@ ks_gw_client_instance_t *QCloudMessagingEmbeddedKaltiotClient::getKaltiotEngineI
 
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotClient::subscribeToChannel
- *  * Unsubscribes client from the channel
+ * Subscribes client to the channel. Changes are registered to the daemon
+ * shortly after, together with other changes made at the same time.
  *
  * \param channel
- * * Channel name QString
+ * Channel name QString
  *
  * \return
- * false if channel not found, true if found and updated
+ * false if already subscribed, true if channel was added
  */
 bool QCloudMessagingEmbeddedKaltiotClient::subscribeToChannel(const QString &channel)
 {
+    if (d->m_channels.contains(channel))
+        return false; // Already subscribed
 
-    for (int i = 0; i < d->m_channels.count(); i++) {
-        if (channel == d->m_channels[i])
-            return false; // Already subscribed
-    }
-
-    // Not found, lets add new channel and restart client.
     d->m_channels.append(channel);
-
-    disconnectClient();
-    connectClient(clientToken(), clientParameters());
+    scheduleChannelRegistration();
 
     return true;
 }
 
 /*!
- * \brief QCloudMessagingEmbeddedKaltiotClient::unsubscribeFromChannel
- * Unsubscribes client from the channel
+ * \brief QCloudMessagingEmbeddedKaltiotClient::subscribeToChannels
+ * Subscribes client to several channels with one daemon registration.
  *
- * \param channel
- * Channel name QString
+ * \param channels
+ * Channel names QStringList
  *
  * \return
- * false if channel not found, true if found and updated
+ * Amount of channels added
  */
-bool QCloudMessagingEmbeddedKaltiotClient::unsubscribeFromChannel(const QString &channel)
+int QCloudMessagingEmbeddedKaltiotClient::subscribeToChannels(const QStringList &channels)
 {
-
-    for (int i = 0; i < d->m_channels.count(); i++) {
-        if (channel == d->m_channels[i]) {
-            d->m_channels.removeAt(i);
-
-            disconnectClient();
-            connectClient(clientToken(), clientParameters());
-
-            return true;
+    int subscribed = 0;
+    for (const QString &channel : channels) {
+        if (!d->m_channels.contains(channel)) {
+            d->m_channels.append(channel);
+            subscribed++;
         }
     }
-    return false; // Not found
 
+    if (subscribed)
+        register_kaltiot_channels();
 
+    return subscribed;
 }
 
 /*!
- * \brief QCloudMessagingEmbeddedKaltiotClient::flushMessageQueue
+ * \brief QCloudMessagingEmbeddedKaltiotClient::unsubscribeFromChannel
+ * Unsubscribes client from the channel
+ *
+ * \param channel
+ * Channel name QString
+ *
  * \return
+ * false if channel not found, true if found and updated
  */
-bool QCloudMessagingEmbeddedKaltiotClient::flushMessageQueue()
+bool QCloudMessagingEmbeddedKaltiotClient::unsubscribeFromChannel(const QString &channel)
 {
+    if (!d->m_channels.removeOne(channel))
+        return false; // Not found
+
+    scheduleChannelRegistration();
+
     return true;
 }
 
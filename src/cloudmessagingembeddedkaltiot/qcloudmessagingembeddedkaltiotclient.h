@@ -72,18 +72,27 @@ public:
                              const QString &channel = QString()) override;
 
 
-    virtual bool flushMessageQueue() override;
-
     virtual bool subscribeToChannel(const QString &channel) override;
 
     virtual bool unsubscribeFromChannel(const QString &channel) override;
 
+    virtual int subscribeToChannels(const QStringList &channels) override;
+
     void kaltiotMessageReceived(const QString &client, const QString &message);
 
+    bool postCloudMessage(const char *address, const char *payload, int length);
+
+    quint32 droppedMessageCount() const;
+
     ks_gw_client_instance_t *getKaltiotEngineInstance();
 
+private Q_SLOTS:
+    void drainInboundMessages();
+
 private:
     bool make_kaltiot_client_registration();
+    void register_kaltiot_channels();
+    void scheduleChannelRegistration();
     void runBackgroundThread();
 
     QScopedPointer<QCloudMessagingEmbeddedKaltiotClientPrivate> d;
@@ -40,11 +40,13 @@
 //
 
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessaging/private/qcloudmessagingringbuffer_p.h>
 #include <QStringList>
-#include <QSettings>
-#include <QThread>
+#include <QScopedPointer>
 #include <QTimer>
 
+#include "qcloudmessagingembeddedkaltiotloop_p.h"
+
 #ifndef ANDROID_OS
 #include "ks_gw_client.h"
 #else
@@ -56,27 +58,59 @@ QT_BEGIN_NAMESPACE
 class QCloudMessaging;
 class QCloudMessagingEmbeddedKaltiotClient;
 
+// Notification slot of the inbound ring, buffers keep their capacity.
+class QCloudMessagingEmbeddedKaltiotInbound
+{
+public:
+    enum { PayloadReserve = 256 };
+
+    QCloudMessagingEmbeddedKaltiotInbound()
+    {
+        address.reserve(64);
+        payload.reserve(PayloadReserve);
+    }
+
+    QByteArray address;
+    QByteArray payload;
+};
+
+typedef QCloudMessagingRingBuffer<QCloudMessagingEmbeddedKaltiotInbound>
+        QCloudMessagingEmbeddedKaltiotInboundQueue;
+
 class QCloudMessagingEmbeddedKaltiotClientPrivate
 {
 public:
     QCloudMessagingEmbeddedKaltiotClientPrivate()
     {
         m_running = false;
+        m_registered = false;
+        m_registrationTimer.setSingleShot(true);
+        m_registrationTimer.setInterval(ChannelRegistrationDelay);
+        m_loop.reset(new QCloudMessagingEmbeddedKaltiotLoop(&m_kaltiot_client_instance));
+        m_inbound.reset(new QCloudMessagingEmbeddedKaltiotInboundQueue(InboundQueueSize));
     }
 
     ~QCloudMessagingEmbeddedKaltiotClientPrivate() = default;
 
+    // Channel changes within this many milliseconds share one registration.
+    enum { ChannelRegistrationDelay = 50 };
+
+    // Default amount of notifications buffered between drains.
+    enum { InboundQueueSize = 1024 };
+
     bool m_running;
+    bool m_registered;
     QString m_uuid;
     QString m_address;
     QString m_version;
     QString m_customer_id;
     QStringList m_channels;
     QString m_rid;
-    QSettings m_client_settings;
-    QThread m_clientThread;
-    QTimer m_threadTimer;
     ks_gw_client_instance_t m_kaltiot_client_instance;
+    QScopedPointer<QCloudMessagingEmbeddedKaltiotLoop> m_loop;
+    QTimer m_registrationTimer;
+    QScopedPointer<QCloudMessagingEmbeddedKaltiotInboundQueue> m_inbound;
+    QAtomicInt m_inboundWakeup;
     QString daemonIpcPath;
 };
 
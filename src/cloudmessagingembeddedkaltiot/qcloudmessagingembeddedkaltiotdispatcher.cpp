@@ -0,0 +1,171 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qcloudmessagingembeddedkaltiotdispatcher_p.h"
+
+QT_BEGIN_NAMESPACE
+
+Q_GLOBAL_STATIC(QCloudMessagingEmbeddedKaltiotDispatcher, kaltiotDispatcher)
+
+// Instance whose task is running on this thread, for address-less callbacks.
+static thread_local const ks_gw_client_instance_t *kaltiotCurrentInstance = nullptr;
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::TaskScope::TaskScope
+ * Marks \a instance as the one running ks_gw_client_task() on this thread.
+ */
+QCloudMessagingEmbeddedKaltiotDispatcher::TaskScope::TaskScope(
+        const ks_gw_client_instance_t *instance) :
+    m_previous(kaltiotCurrentInstance)
+{
+    kaltiotCurrentInstance = instance;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::TaskScope::~TaskScope
+ */
+QCloudMessagingEmbeddedKaltiotDispatcher::TaskScope::~TaskScope()
+{
+    kaltiotCurrentInstance = m_previous;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::instance
+ * \return
+ * Process wide dispatcher shared by all Kaltiot clients.
+ */
+QCloudMessagingEmbeddedKaltiotDispatcher *QCloudMessagingEmbeddedKaltiotDispatcher::instance()
+{
+    return kaltiotDispatcher();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::registerClient
+ * Registers or re-registers \a client with its IoT address and instance.
+ */
+void QCloudMessagingEmbeddedKaltiotDispatcher::registerClient(
+        QCloudMessagingEmbeddedKaltiotClient *client,
+        const QString &address,
+        const ks_gw_client_instance_t *instance)
+{
+    QWriteLocker locker(&m_lock);
+
+    auto previous = m_clients.find(client);
+    if (previous != m_clients.end()) {
+        auto it = m_addresses.find(previous.value());
+        if (it != m_addresses.end() && it.value() == client)
+            m_addresses.erase(it);
+        previous.value() = address;
+    } else {
+        m_clients.insert(client, address);
+    }
+
+    m_addresses.insert(address, client);
+    m_instances.insert(instance, client);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::unregisterClient
+ */
+void QCloudMessagingEmbeddedKaltiotDispatcher::unregisterClient(
+        QCloudMessagingEmbeddedKaltiotClient *client)
+{
+    QWriteLocker locker(&m_lock);
+
+    auto previous = m_clients.find(client);
+    if (previous == m_clients.end())
+        return;
+
+    auto it = m_addresses.find(previous.value());
+    if (it != m_addresses.end() && it.value() == client)
+        m_addresses.erase(it);
+    m_clients.erase(previous);
+
+    for (auto instance = m_instances.begin(); instance != m_instances.end(); ) {
+        if (instance.value() == client)
+            instance = m_instances.erase(instance);
+        else
+            ++instance;
+    }
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::clientForAddress
+ * \param address
+ * \return
+ * Client registered for the IoT address, nullptr if not found.
+ */
+QCloudMessagingEmbeddedKaltiotClient *QCloudMessagingEmbeddedKaltiotDispatcher::clientForAddress(
+        const QString &address) const
+{
+    QReadLocker locker(&m_lock);
+    return m_addresses.value(address);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::clientForInstance
+ * \param instance
+ * \return
+ * Client owning the Kaltiot instance, nullptr if not found.
+ */
+QCloudMessagingEmbeddedKaltiotClient *QCloudMessagingEmbeddedKaltiotDispatcher::clientForInstance(
+        const ks_gw_client_instance_t *instance) const
+{
+    QReadLocker locker(&m_lock);
+    return m_instances.value(instance);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::currentClient
+ * \return
+ * Client whose task is running on the calling thread. Outside of a task, as
+ * with the Android daemon callbacks, the only registered client if there is
+ * exactly one; nullptr otherwise.
+ */
+QCloudMessagingEmbeddedKaltiotClient *QCloudMessagingEmbeddedKaltiotDispatcher::currentClient() const
+{
+    QReadLocker locker(&m_lock);
+    if (kaltiotCurrentInstance)
+        return m_instances.value(kaltiotCurrentInstance);
+
+    return m_clients.count() == 1 ? m_clients.constBegin().key() : nullptr;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDispatcher::count
+ * \return
+ * Amount of registered clients.
+ */
+int QCloudMessagingEmbeddedKaltiotDispatcher::count() const
+{
+    QReadLocker locker(&m_lock);
+    return m_clients.count();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,99 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGEMBEDDEDKALTIOTDISPATCHER_P_H
+#define QCLOUDMESSAGINGEMBEDDEDKALTIOTDISPATCHER_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QHash>
+#include <QString>
+#include <QReadWriteLock>
+
+#ifndef ANDROID_OS
+#include "ks_gw_client.h"
+#else
+#include "ks_gw_client_android.h"
+#endif
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingEmbeddedKaltiotClient;
+
+/*
+ * Routes the Kaltiot C callbacks to the client they belong to. Clients are
+ * found by IoT address, or for callbacks without an address by the instance
+ * whose ks_gw_client_task() is running on the calling thread.
+ */
+class QCloudMessagingEmbeddedKaltiotDispatcher
+{
+public:
+    class TaskScope
+    {
+    public:
+        explicit TaskScope(const ks_gw_client_instance_t *instance);
+        ~TaskScope();
+
+    private:
+        const ks_gw_client_instance_t *m_previous;
+    };
+
+    static QCloudMessagingEmbeddedKaltiotDispatcher *instance();
+
+    void registerClient(QCloudMessagingEmbeddedKaltiotClient *client,
+                        const QString &address,
+                        const ks_gw_client_instance_t *instance);
+    void unregisterClient(QCloudMessagingEmbeddedKaltiotClient *client);
+
+    QCloudMessagingEmbeddedKaltiotClient *clientForAddress(const QString &address) const;
+    QCloudMessagingEmbeddedKaltiotClient *clientForInstance(
+            const ks_gw_client_instance_t *instance) const;
+    QCloudMessagingEmbeddedKaltiotClient *currentClient() const;
+
+    int count() const;
+
+private:
+    mutable QReadWriteLock m_lock;
+    QHash<QString, QCloudMessagingEmbeddedKaltiotClient *> m_addresses;
+    QHash<const ks_gw_client_instance_t *, QCloudMessagingEmbeddedKaltiotClient *> m_instances;
+    QHash<QCloudMessagingEmbeddedKaltiotClient *, QString> m_clients;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGEMBEDDEDKALTIOTDISPATCHER_P_H
@@ -0,0 +1,157 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qcloudmessagingembeddedkaltiotexecutor_p.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+QT_BEGIN_NAMESPACE
+
+Q_GLOBAL_STATIC(QCloudMessagingEmbeddedKaltiotExecutor, kaltiotExecutor)
+
+/*
+ * Workers are stopped while QCoreApplication is destroyed. The global static
+ * itself is destroyed only after the application and its event dispatchers
+ * are gone.
+ */
+static void shutdownKaltiotExecutor()
+{
+    if (kaltiotExecutor.exists())
+        kaltiotExecutor()->shutdown();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotExecutor::QCloudMessagingEmbeddedKaltiotExecutor
+ */
+QCloudMessagingEmbeddedKaltiotExecutor::QCloudMessagingEmbeddedKaltiotExecutor() :
+    m_maxWorkers(qMax(1, QThread::idealThreadCount()))
+{
+    qAddPostRoutine(shutdownKaltiotExecutor);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotExecutor::~QCloudMessagingEmbeddedKaltiotExecutor
+ */
+QCloudMessagingEmbeddedKaltiotExecutor::~QCloudMessagingEmbeddedKaltiotExecutor()
+{
+    shutdown();
+    for (const Worker &worker : qAsConst(m_workers))
+        delete worker.thread;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotExecutor::instance
+ * \return
+ * Process wide executor shared by all Kaltiot clients.
+ */
+QCloudMessagingEmbeddedKaltiotExecutor *QCloudMessagingEmbeddedKaltiotExecutor::instance()
+{
+    return kaltiotExecutor();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotExecutor::acquire
+ * Reserves a worker thread for one loop. A new worker is started while the
+ * pool is below its size and every worker already serves a loop.
+ *
+ * \return
+ * Running worker thread the loop should be moved to.
+ */
+QThread *QCloudMessagingEmbeddedKaltiotExecutor::acquire()
+{
+    QMutexLocker locker(&m_lock);
+
+    Worker *least = nullptr;
+    for (Worker &worker : m_workers) {
+        if (!least || worker.loops < least->loops)
+            least = &worker;
+    }
+
+    if (!least || (least->loops > 0 && m_workers.count() < m_maxWorkers)) {
+        QThread *thread = new QThread;
+        thread->setObjectName(QStringLiteral("QtCloudMessagingKaltiot%1")
+                              .arg(m_workers.count()));
+        thread->start();
+        m_workers.append({thread, 0});
+        least = &m_workers.last();
+    }
+
+    if (!least->thread->isRunning())
+        least->thread->start();
+
+    least->loops++;
+    return least->thread;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotExecutor::release
+ * Returns the reservation made with acquire. Workers stay running for the
+ * next loop until shutdown.
+ */
+void QCloudMessagingEmbeddedKaltiotExecutor::release(QThread *worker)
+{
+    QMutexLocker locker(&m_lock);
+
+    for (Worker &w : m_workers) {
+        if (w.thread == worker) {
+            w.loops--;
+            return;
+        }
+    }
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotExecutor::workerCount
+ * \return
+ */
+int QCloudMessagingEmbeddedKaltiotExecutor::workerCount() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_workers.count();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotExecutor::shutdown
+ * Stops the workers and waits for them to finish their current task. Loops
+ * still attached stop serving their instance; a later acquire restarts the
+ * worker. Called when QCoreApplication is destroyed.
+ */
+void QCloudMessagingEmbeddedKaltiotExecutor::shutdown()
+{
+    QMutexLocker locker(&m_lock);
+
+    for (const Worker &worker : qAsConst(m_workers))
+        worker.thread->quit();
+
+    for (const Worker &worker : qAsConst(m_workers))
+        worker.thread->wait();
+}
+
+QT_END_NAMESPACE
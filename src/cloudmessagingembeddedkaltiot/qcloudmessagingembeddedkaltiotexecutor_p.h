@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGEMBEDDEDKALTIOTEXECUTOR_P_H
+#define QCLOUDMESSAGINGEMBEDDEDKALTIOTEXECUTOR_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QMutex>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QThread;
+class QCloudMessagingEmbeddedKaltiotLoop;
+
+/*
+ * Fixed pool of worker threads shared by all Kaltiot client loops. The pool
+ * grows up to QThread::idealThreadCount() workers and a loop is always
+ * placed on the worker serving the fewest loops, so the thread count
+ * follows the cores instead of the clients.
+ */
+class QCloudMessagingEmbeddedKaltiotExecutor
+{
+public:
+    QCloudMessagingEmbeddedKaltiotExecutor();
+    ~QCloudMessagingEmbeddedKaltiotExecutor();
+
+    static QCloudMessagingEmbeddedKaltiotExecutor *instance();
+
+    QThread *acquire();
+    void release(QThread *worker);
+
+    int workerCount() const;
+    void shutdown();
+
+private:
+    struct Worker {
+        QThread *thread;
+        int loops;
+    };
+
+    mutable QMutex m_lock;
+    QVector<Worker> m_workers;
+    int m_maxWorkers;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGEMBEDDEDKALTIOTEXECUTOR_P_H
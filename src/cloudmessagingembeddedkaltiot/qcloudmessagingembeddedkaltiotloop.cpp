@@ -0,0 +1,288 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qcloudmessagingembeddedkaltiotloop_p.h"
+#include "qcloudmessagingembeddedkaltiotdispatcher_p.h"
+#include "qcloudmessagingembeddedkaltiotexecutor_p.h"
+
+#include <QSocketNotifier>
+#include <QThread>
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::QCloudMessagingEmbeddedKaltiotLoop
+ * \param instance
+ * Kaltiot client instance served by this loop.
+ * \param parent
+ */
+QCloudMessagingEmbeddedKaltiotLoop::QCloudMessagingEmbeddedKaltiotLoop(
+        ks_gw_client_instance_t *instance, QObject *parent) :
+    QObject(parent),
+    m_instance(instance),
+    m_worker(nullptr),
+    m_taskLock(QMutex::Recursive),
+    m_notifier(nullptr),
+    m_pollTimer(this),
+    m_pollInterval(MinPollInterval),
+    m_running(false),
+    m_activity(false)
+{
+    m_pollTimer.setSingleShot(true);
+    connect(&m_pollTimer, &QTimer::timeout,
+            this, &QCloudMessagingEmbeddedKaltiotLoop::runTask);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::~QCloudMessagingEmbeddedKaltiotLoop
+ */
+QCloudMessagingEmbeddedKaltiotLoop::~QCloudMessagingEmbeddedKaltiotLoop()
+{
+    stop();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::start
+ * Moves the loop to a worker thread of the shared executor and starts
+ * serving the instance. Calling start on a running loop re-reads the daemon
+ * socket, which is needed after the instance has reconnected.
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::start()
+{
+    if (!m_worker) {
+        m_worker = QCloudMessagingEmbeddedKaltiotExecutor::instance()->acquire();
+        moveToThread(m_worker);
+    }
+
+    QMetaObject::invokeMethod(this, "doStart", Qt::QueuedConnection);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::stop
+ * Stops the loop and returns it to the calling thread. Returns once the
+ * worker has finished any task in progress.
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::stop()
+{
+    if (!m_worker)
+        return;
+
+    QCloudMessagingEmbeddedKaltiotExecutor *executor =
+            QCloudMessagingEmbeddedKaltiotExecutor::instance();
+    if (!executor) {
+        // Executor destroyed at exit along with its workers.
+        m_running = false;
+        m_worker = nullptr;
+        return;
+    }
+
+    QThread *current = QThread::currentThread();
+    if (current == m_worker) {
+        doStop(current);
+    } else if (m_worker->isRunning()) {
+        QMetaObject::invokeMethod(this, "doStop", Qt::BlockingQueuedConnection,
+                                  Q_ARG(QThread *, current));
+    } else {
+        // Executor already shut down, nothing can run the task any more.
+        m_running = false;
+        m_notifier = nullptr;
+    }
+
+    executor->release(m_worker);
+    m_worker = nullptr;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::wake
+ * Marks the loop as active: outgoing data or incoming callbacks mean the
+ * library has work to do, so polling restarts from the shortest interval.
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::wake()
+{
+    if (thread() == QThread::currentThread())
+        doWake();
+    else
+        QMetaObject::invokeMethod(this, "doWake", Qt::QueuedConnection);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::isRunning
+ * \return
+ */
+bool QCloudMessagingEmbeddedKaltiotLoop::isRunning() const
+{
+    return m_running;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::pollInterval
+ * \return
+ * Current fallback poll interval in milliseconds.
+ */
+int QCloudMessagingEmbeddedKaltiotLoop::pollInterval() const
+{
+    return m_pollInterval;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::isEventDriven
+ * \return
+ * true if the loop waits on the daemon socket instead of polling.
+ */
+bool QCloudMessagingEmbeddedKaltiotLoop::isEventDriven() const
+{
+    return m_notifier != nullptr;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::taskLock
+ * \return
+ * Recursive lock held while the task runs. Callbacks may call back into the
+ * client on the same thread.
+ */
+QMutex *QCloudMessagingEmbeddedKaltiotLoop::taskLock()
+{
+    return &m_taskLock;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::doStart
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::doStart()
+{
+    m_running = true;
+    m_activity = false;
+    m_pollInterval = MinPollInterval;
+    updateNotifier();
+    m_pollTimer.start(MinPollInterval);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::doStop
+ * \param target
+ * Thread the loop is handed back to.
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::doStop(QThread *target)
+{
+    m_running = false;
+    m_pollTimer.stop();
+    delete m_notifier;
+    m_notifier = nullptr;
+    moveToThread(target);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::doWake
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::doWake()
+{
+    m_activity = true;
+    if (!m_running)
+        return;
+
+    if (m_pollInterval > MinPollInterval || m_notifier) {
+        m_pollInterval = MinPollInterval;
+        m_pollTimer.start(MinPollInterval);
+    }
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::runTask
+ * Runs one task pass. Loops sharing a worker take turns through the
+ * worker's event queue, so a busy instance cannot starve the others.
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::runTask()
+{
+    if (!m_running)
+        return;
+
+#ifdef EMBEDDED_AND_DESKTOP_OS
+    {
+        QMutexLocker locker(&m_taskLock);
+        QCloudMessagingEmbeddedKaltiotDispatcher::TaskScope scope(m_instance);
+        ks_gw_client_task(m_instance);
+    }
+#endif
+
+    // The task may have reconnected to the daemon on a new socket.
+    if (m_running) {
+        updateNotifier();
+        scheduleNext();
+    }
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::updateNotifier
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::updateNotifier()
+{
+#ifdef EMBEDDED_AND_DESKTOP_OS
+    m_taskLock.lock();
+    const qintptr fd = m_instance->socket_fd;
+    m_taskLock.unlock();
+#else
+    const qintptr fd = -1;
+#endif
+
+    if (m_notifier && m_notifier->socket() == fd)
+        return;
+
+    delete m_notifier;
+    m_notifier = nullptr;
+
+    if (fd < 0)
+        return;
+
+    m_notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, [this] {
+        m_activity = true;
+        runTask();
+    });
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotLoop::scheduleNext
+ */
+void QCloudMessagingEmbeddedKaltiotLoop::scheduleNext()
+{
+    if (m_activity) {
+        m_pollInterval = MinPollInterval;
+    } else if (m_notifier) {
+        m_pollInterval = HousekeepingInterval;
+    } else {
+        m_pollInterval = qMin(m_pollInterval * 2, int(MaxPollInterval));
+    }
+    m_activity = false;
+
+    // After activity run one quick follow-up pass so replies queued by the
+    // callbacks are flushed; otherwise wait for the socket or the timer.
+    m_pollTimer.start(m_pollInterval);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,114 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGEMBEDDEDKALTIOTLOOP_P_H
+#define QCLOUDMESSAGINGEMBEDDEDKALTIOTLOOP_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+
+#ifndef ANDROID_OS
+#include "ks_gw_client.h"
+#else
+#include "ks_gw_client_android.h"
+#endif
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+class QThread;
+
+/*
+ * Drives ks_gw_client_task() for one client instance. When the daemon IPC
+ * socket is known the task runs only when the socket becomes readable, with
+ * a slow housekeeping poll for the library's own timers. Without a socket
+ * the loop polls, backing off exponentially while nothing happens.
+ *
+ * A started loop lives on a worker of the shared executor. start, stop and
+ * wake may be called from the client's thread; other calls into the
+ * Kaltiot instance must hold taskLock().
+ */
+class QCloudMessagingEmbeddedKaltiotLoop : public QObject
+{
+    Q_OBJECT
+public:
+    enum {
+        MinPollInterval = 1,
+        MaxPollInterval = 250,
+        HousekeepingInterval = 1000
+    };
+
+    explicit QCloudMessagingEmbeddedKaltiotLoop(ks_gw_client_instance_t *instance,
+                                                QObject *parent = nullptr);
+    ~QCloudMessagingEmbeddedKaltiotLoop();
+
+    bool isRunning() const;
+    int pollInterval() const;
+    bool isEventDriven() const;
+    QMutex *taskLock();
+
+    void start();
+    void stop();
+    void wake();
+
+private Q_SLOTS:
+    void doStart();
+    void doStop(QThread *target);
+    void doWake();
+    void runTask();
+
+private:
+    void updateNotifier();
+    void scheduleNext();
+
+    ks_gw_client_instance_t *m_instance;
+    QThread *m_worker;
+    QMutex m_taskLock;
+    QSocketNotifier *m_notifier;
+    QTimer m_pollTimer;
+    int m_pollInterval;
+    bool m_running;
+    bool m_activity;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGEMBEDDEDKALTIOTLOOP_P_H
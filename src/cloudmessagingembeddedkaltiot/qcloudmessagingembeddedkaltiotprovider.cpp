@@ -28,6 +28,12 @@
 
 #include "qcloudmessagingembeddedkaltiotprovider.h"
 #include "qcloudmessagingembeddedkaltiotprovider_p.h"
+#include "qcloudmessagingembeddedkaltiotdispatcher_p.h"
+
+#include <QtCloudMessaging/qcloudmessagingtokenstore.h>
+
+#include <QDateTime>
+#include <QThread>
 
 #ifdef ANDROID_OS
 #include <QtAndroid>
@@ -36,12 +42,8 @@
 
 QT_BEGIN_NAMESPACE
 
-/**
- * @brief QCloudMessagingProvider
- * @abstract Make the smart iot class accessible outside of the class for callback msgs.
- */
-
-static QCloudMessagingEmbeddedKaltiotProvider *m_KaltiotServiceProvider;
+// Margin for the clock difference between the server and this device
+static const qint64 SyncOverlap = 5 * 60 * 1000;
 
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotProvider::QCloudMessagingEmbeddedKaltiotProvider
@@ -50,9 +52,51 @@ QCloudMessagingEmbeddedKaltiotProvider::QCloudMessagingEmbeddedKaltiotProvider(Q
     QCloudMessagingProvider(parent),
     d(new QCloudMessagingEmbeddedKaltiotProviderPrivate)
 {
-    m_KaltiotServiceProvider = this;
+    d->m_restInterface.setParent(this);
+
     connect(&d->m_restInterface, &QCloudMessagingEmbeddedKaltiotRest::remoteClientsReceived,
             this, &QCloudMessagingEmbeddedKaltiotProvider::remoteClientsReceived);
+    connect(&d->m_restInterface, &QCloudMessagingEmbeddedKaltiotRest::remoteDevicesReceived,
+            this, &QCloudMessagingEmbeddedKaltiotProvider::remoteDevicesReceived);
+    connect(&d->m_restInterface, &QCloudMessagingEmbeddedKaltiotRest::remoteDevicesListed,
+            this, &QCloudMessagingEmbeddedKaltiotProvider::remoteDevicesListed);
+    connect(&d->m_restInterface, &QCloudMessagingEmbeddedKaltiotRest::presenceReceived,
+            this, &QCloudMessagingEmbeddedKaltiotProvider::remoteDevicePresenceReceived);
+
+    // Device registry sync, only the changes are emitted
+    connect(&d->m_restInterface, &QCloudMessagingEmbeddedKaltiotRest::remoteDevicesReceived,
+            this, [this](const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices) {
+        if (!d->m_devices.isFullSyncRunning())
+            return;
+        const QVector<QCloudMessagingEmbeddedKaltiotIdentity> added = d->m_devices.merge(devices);
+        if (!added.isEmpty())
+            emit remoteDevicesChanged(added, QStringList());
+    });
+    connect(&d->m_restInterface, &QCloudMessagingEmbeddedKaltiotRest::remoteDevicesListed,
+            this, [this](int, bool complete) {
+        if (!d->m_devices.isFullSyncRunning())
+            return;
+        const QStringList removed = d->m_devices.endFullSync(complete);
+        if (complete)
+            d->m_devices.advanceWatermark(d->m_syncStarted);
+        if (!removed.isEmpty())
+            emit remoteDevicesChanged(QVector<QCloudMessagingEmbeddedKaltiotIdentity>(), removed);
+        emit remoteDevicesSynced(complete);
+    });
+    connect(&d->m_restInterface, &QCloudMessagingEmbeddedKaltiotRest::remoteDevicesCreated,
+            this, [this](const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices,
+                         qint64, qint64, bool ok) {
+        if (!d->m_incrementalSync)
+            return;
+        d->m_incrementalSync = false;
+        if (ok) {
+            const QVector<QCloudMessagingEmbeddedKaltiotIdentity> added = d->m_devices.merge(devices);
+            d->m_devices.advanceWatermark(d->m_syncStarted);
+            if (!added.isEmpty())
+                emit remoteDevicesChanged(added, QStringList());
+        }
+        emit remoteDevicesSynced(ok);
+    });
 }
 
 /*!
@@ -155,9 +199,10 @@ bool QCloudMessagingEmbeddedKaltiotProvider::sendMessage(const QByteArray &msg,
 
         if (!clientToken.isEmpty() && channel.isEmpty()) {
 
-            // Publish message to server via kaltiot SDK
-            QCloudMessagingEmbeddedKaltiotClient *tempClient =
-                    (QCloudMessagingEmbeddedKaltiotClient *) clients()->first();
+            // Publish message to server via kaltiot SDK, any connected client will do
+            QCloudMessagingEmbeddedKaltiotClient *tempClient = clients()->isEmpty()
+                    ? nullptr
+                    : (QCloudMessagingEmbeddedKaltiotClient *) clients()->constBegin().value();
 
             if (tempClient)
                 return tempClient->sendMessage(msg, clientToken, QString());
@@ -192,7 +237,7 @@ void QCloudMessagingEmbeddedKaltiotProvider::disconnectClient(
  * \brief QCloudMessagingEmbeddedKaltiotProvider::clients
  * \return
  */
-QMap <QString, QCloudMessagingClient*> *QCloudMessagingEmbeddedKaltiotProvider::clients()
+QHash<QString, QCloudMessagingClient *> *QCloudMessagingEmbeddedKaltiotProvider::clients()
 {
     return QCloudMessagingProvider::clients();
 }
@@ -207,6 +252,115 @@ bool QCloudMessagingEmbeddedKaltiotProvider::remoteClients()
     return d->m_restInterface.getAllDevices();
 }
 
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::remoteDevices
+ * Lists the remote devices with several pages in flight. Unlike remoteClients
+ * the identities are delivered page by page with remoteDevicesReceived.
+ * \param pageSize
+ * \param parallelPages
+ * \return
+ */
+bool QCloudMessagingEmbeddedKaltiotProvider::remoteDevices(int pageSize, int parallelPages)
+{
+    return d->m_restInterface.listDevices(pageSize, parallelPages);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::syncRemoteDevices
+ * Brings the local device registry up to date and emits the differences with
+ * remoteDevicesChanged. The first sync, or one with \a fullSync, lists all the
+ * devices and also finds the removed ones. Later syncs only fetch the devices
+ * created since the previous sync, so their cost follows the churn of the
+ * fleet instead of its size. Timestamps are milliseconds since epoch.
+ *
+ * The sync continues from the newest server timestamp seen so far, and the
+ * requested time range overlaps the previous one by a margin, so devices are
+ * not missed when the clocks of the server and this device differ.
+ *
+ * \param fullSync
+ * \return
+ * False if a sync is already running.
+ */
+bool QCloudMessagingEmbeddedKaltiotProvider::syncRemoteDevices(bool fullSync)
+{
+    if (d->m_incrementalSync || d->m_devices.isFullSyncRunning())
+        return false;
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (fullSync || d->m_devices.watermark() == 0) {
+        if (d->m_restInterface.isListingDevices())
+            return false;
+        // Devices created while listing are picked up by the next sync
+        d->m_syncStarted = now;
+        d->m_devices.beginFullSync();
+        return d->m_restInterface.listDevices();
+    }
+
+    // Devices seen again in the overlap are merged without changes
+    d->m_syncStarted = now;
+    d->m_incrementalSync = true;
+    d->m_restInterface.getDevicesCreated(d->m_devices.watermark() - SyncOverlap,
+                                         now + SyncOverlap);
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::remoteDevice
+ * \param rid
+ * \return
+ * Device identity from the local registry.
+ */
+QCloudMessagingEmbeddedKaltiotIdentity QCloudMessagingEmbeddedKaltiotProvider::remoteDevice(
+        const QString &rid) const
+{
+    return d->m_devices.device(rid);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::remoteDeviceIds
+ * \return
+ * Rids in the local registry.
+ */
+QStringList QCloudMessagingEmbeddedKaltiotProvider::remoteDeviceIds() const
+{
+    return d->m_devices.rids();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::remoteDevicePresence
+ * Cached presence of the device, for choosing between direct send and
+ * store-and-forward. Unknown presence is looked up and reported with
+ * remoteDevicePresenceReceived.
+ * \param rid
+ * \return
+ */
+QCloudMessagingEmbeddedKaltiotRest::PresenceState QCloudMessagingEmbeddedKaltiotProvider::remoteDevicePresence(
+        const QString &rid)
+{
+    return d->m_restInterface.presence(rid);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::requestRemoteDevicePresence
+ * \param rids
+ * \return
+ * Number of new lookups started.
+ */
+int QCloudMessagingEmbeddedKaltiotProvider::requestRemoteDevicePresence(const QStringList &rids)
+{
+    return d->m_restInterface.requestPresence(rids);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::setRemoteDevicePresenceTtl
+ * \param msecs
+ */
+void QCloudMessagingEmbeddedKaltiotProvider::setRemoteDevicePresenceTtl(int msecs)
+{
+    d->m_restInterface.setPresenceTtl(msecs);
+}
+
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotProvider::setClientToken
  * \param client
@@ -218,6 +372,62 @@ void QCloudMessagingEmbeddedKaltiotProvider::setClientToken(const QString  &clie
     getKaltiotClient(client)->setClientToken(uuid);
 }
 
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::openDataStream
+ * Opens a persistent data stream from all devices of the customer \a cn, or
+ * from the single device \a rid. Received data is emitted with
+ * messageReceived using the cn or rid as client id. The session id is
+ * stored so a restarted provider resumes the same session.
+ *
+ * \param cn
+ * \param rid
+ * \return
+ * false if the stream source was not given.
+ */
+bool QCloudMessagingEmbeddedKaltiotProvider::openDataStream(const QString &cn,
+                                                            const QString &rid)
+{
+    const QString source = rid.isEmpty() ? cn : rid;
+    if (source.isEmpty())
+        return false;
+
+    QCloudMessagingDataStream *&stream = d->m_dataStreams[source];
+    if (!stream) {
+        stream = rid.isEmpty() ? d->m_restInterface.createChannelDataStream(cn)
+                               : d->m_restInterface.createDeviceDataStream(rid);
+
+        const QString sessionKey = source + QStringLiteral("/data_stream_session");
+        stream->setSessionId(QCloudMessagingTokenStore::defaultStore()->token(sessionKey));
+
+        connect(stream, &QCloudMessagingDataStream::sessionCreated,
+                this, [sessionKey](const QString &sessionId) {
+            QCloudMessagingTokenStore::defaultStore()->setToken(sessionKey, sessionId);
+        });
+        connect(stream, &QCloudMessagingDataStream::messageReceived,
+                this, [this, source](const QByteArray &message) {
+            emit messageReceived(providerId(), source, message);
+        });
+    }
+
+    stream->open();
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::closeDataStream
+ * \param cn
+ * \param rid
+ */
+void QCloudMessagingEmbeddedKaltiotProvider::closeDataStream(const QString &cn,
+                                                             const QString &rid)
+{
+    QCloudMessagingDataStream *stream = d->m_dataStreams.take(rid.isEmpty() ? cn : rid);
+    if (stream) {
+        stream->close();
+        stream->deleteLater();
+    }
+}
+
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotProvider::cloudMessageReceived
  * \param client
@@ -261,6 +471,21 @@ bool QCloudMessagingEmbeddedKaltiotProvider::unsubscribeFromChannel(
     return false;
 }
 
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotProvider::subscribeToChannels
+ * \param channels
+ * \param clientId
+ * \return
+ */
+int QCloudMessagingEmbeddedKaltiotProvider::subscribeToChannels(const QStringList &channels,
+                                                                const QString &clientId)
+{
+    if (getKaltiotClient(clientId)) {
+        return getKaltiotClient(clientId)->subscribeToChannels(channels);
+    }
+    return 0;
+}
+
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotProvider::getKaltiotClient
  * \param clientId
@@ -294,13 +519,16 @@ void ks_gw_client_notification_cb(const char *address, const char *payload,
     Q_UNUSED(msg_id);
     Q_UNUSED(msg_id_length);
 
-    QString client = address != nullptr ? QString::fromLatin1(address) : QString();
-    QByteArray b_payload = payload != nullptr ? QByteArray(payload,
-                                                        payload_length) : QString().toLatin1();
-    //QString msg =   QString::fromLatin1(b_payload);
+    if (address == nullptr || *address == '\0')
+        return;
 
-    if (!client.isEmpty())
-        m_KaltiotServiceProvider->cloudMessageReceived(client, b_payload);
+    // Runs on the task thread: queue the payload for the client thread
+    // instead of copying it into a cross-thread event.
+    QCloudMessagingEmbeddedKaltiotClient *kaltiotClient =
+            QCloudMessagingEmbeddedKaltiotDispatcher::instance()->clientForAddress(
+                QString::fromLatin1(address));
+    if (kaltiotClient)
+        kaltiotClient->postCloudMessage(address, payload, payload != nullptr ? payload_length : 0);
 }
 
 /*!
@@ -314,9 +542,12 @@ void ks_gw_client_state_changed_cb(KaltiotSmartState state, KaltiotSmartError er
 {
     Q_UNUSED(error);
 
-    // State related to client - assuming first client
-    QCloudMessagingEmbeddedKaltiotClient *firstClient = (QCloudMessagingEmbeddedKaltiotClient *)m_KaltiotServiceProvider->clients()->first();
-    emit firstClient->clientStateChanged(firstClient->clientId(), state);
+    // State callback has no address, it belongs to the instance whose task
+    // is running on this thread.
+    QCloudMessagingEmbeddedKaltiotClient *kaltiotClient =
+            QCloudMessagingEmbeddedKaltiotDispatcher::instance()->currentClient();
+    if (kaltiotClient)
+        emit kaltiotClient->clientStateChanged(kaltiotClient->clientId(), state);
 
 }
 
@@ -335,7 +566,21 @@ void ks_gw_client_rid_cb(const char *address, const char *rid,
     if (!rid) rid = "nullptr";
     if (!secret) secret = "nullptr";
 
-    m_KaltiotServiceProvider->setClientToken(QString::fromLatin1(address), QString::fromLatin1(rid));
+    QCloudMessagingEmbeddedKaltiotClient *kaltiotClient =
+            QCloudMessagingEmbeddedKaltiotDispatcher::instance()->clientForAddress(
+                QString::fromLatin1(address));
+    if (!kaltiotClient)
+        return;
+
+    // Client state belongs to the client thread, which is the provider's
+    // worker thread when the provider runs threaded.
+    const QString token = QString::fromLatin1(rid);
+    if (kaltiotClient->thread() == QThread::currentThread())
+        kaltiotClient->setClientToken(token);
+    else
+        QMetaObject::invokeMethod(kaltiotClient, [kaltiotClient, token] {
+            kaltiotClient->setClientToken(token);
+        }, Qt::QueuedConnection);
 
 }
 
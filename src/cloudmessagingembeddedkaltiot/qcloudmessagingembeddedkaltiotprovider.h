@@ -33,6 +33,7 @@
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
 #include <QtCloudMessaging/qcloudmessagingrestapi.h>
 #include <QtCloudMessagingEmbeddedKaltiot/qcloudmessagingembeddedkaltiotclient.h>
+#include <QtCloudMessagingEmbeddedKaltiot/qcloudmessagingembeddedkaltiotrest.h>
 
 #include <QObject>
 #include <QVariantMap>
@@ -69,7 +70,7 @@ public:
     virtual QCloudMessagingProvider::CloudMessagingProviderState setServiceState(
             QCloudMessagingProvider::CloudMessagingProviderState state)  override;
 
-    virtual QMap <QString, QCloudMessagingClient *> *clients() override;
+    virtual QHash<QString, QCloudMessagingClient *> *clients() override;
 
     virtual bool subscribeToChannel(const QString &channel,
                                    const QString &clientId = QString())  override;
@@ -77,14 +78,44 @@ public:
     virtual bool unsubscribeFromChannel(const QString &channel,
                                        const QString &clientId = QString()) override;
 
+    virtual int subscribeToChannels(const QStringList &channels,
+                                    const QString &clientId = QString()) override;
+
     virtual bool remoteClients() override;
 
+    bool remoteDevices(int pageSize = 500, int parallelPages = 4);
+
+    bool syncRemoteDevices(bool fullSync = false);
+
+    QCloudMessagingEmbeddedKaltiotIdentity remoteDevice(const QString &rid) const;
+
+    QStringList remoteDeviceIds() const;
+
+    QCloudMessagingEmbeddedKaltiotRest::PresenceState remoteDevicePresence(const QString &rid);
+
+    int requestRemoteDevicePresence(const QStringList &rids);
+
+    void setRemoteDevicePresenceTtl(int msecs);
+
     /* KALTIOT SPECIFIC FUNCTIONS */
     void cloudMessageReceived(const QString &client, const QByteArray &message);
     QCloudMessagingEmbeddedKaltiotClient *getKaltiotClient(const QString &clientId);
 
     void setClientToken(const QString &client, const QString &uuid);
 
+    bool openDataStream(const QString &cn, const QString &rid = QString());
+
+    void closeDataStream(const QString &cn, const QString &rid = QString());
+
+Q_SIGNALS:
+    void remoteDevicesReceived(const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices);
+    void remoteDevicesListed(int count, bool complete);
+    void remoteDevicesChanged(const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &added,
+                              const QStringList &removed);
+    void remoteDevicesSynced(bool ok);
+    void remoteDevicePresenceReceived(const QString &rid,
+                                      QCloudMessagingEmbeddedKaltiotRest::PresenceState state);
+
 private:
     QScopedPointer<QCloudMessagingEmbeddedKaltiotProviderPrivate> d;
 
@@ -41,7 +41,9 @@
 //
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
 #include <QtCloudMessagingEmbeddedKaltiot/QCloudMessagingEmbeddedKaltiotRest>
+#include "qcloudmessagingembeddedkaltiotregistry_p.h"
 
+#include <QHash>
 #include <QStringList>
 
 #ifndef ANDROID_OS
@@ -58,6 +60,8 @@ class QCloudMessagingEmbeddedKaltiotProviderPrivate
 {
 public:
     QCloudMessagingEmbeddedKaltiotProviderPrivate()
+        : m_syncStarted(0),
+          m_incrementalSync(false)
     {
     }
 
@@ -68,6 +72,10 @@ public:
     QString m_key;
 
     QCloudMessagingEmbeddedKaltiotRest m_restInterface;
+    QHash<QString, QCloudMessagingDataStream *> m_dataStreams;
+    QCloudMessagingEmbeddedKaltiotDeviceRegistry m_devices;
+    qint64 m_syncStarted;
+    bool m_incrementalSync;
     ks_gw_client_instance_t *m_kaltiot_engine_instance;
 
 };
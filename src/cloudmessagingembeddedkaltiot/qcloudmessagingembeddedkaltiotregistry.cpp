@@ -0,0 +1,217 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qcloudmessagingembeddedkaltiotregistry_p.h"
+
+QT_BEGIN_NAMESPACE
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::QCloudMessagingEmbeddedKaltiotDeviceRegistry
+ */
+QCloudMessagingEmbeddedKaltiotDeviceRegistry::QCloudMessagingEmbeddedKaltiotDeviceRegistry() :
+    m_full_sync(false),
+    m_watermark(0),
+    m_newest_timestamp(0)
+{
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::beginFullSync
+ * Starts tracking which devices are listed by the full sync.
+ */
+void QCloudMessagingEmbeddedKaltiotDeviceRegistry::beginFullSync()
+{
+    m_seen.clear();
+    m_seen.reserve(m_devices.size());
+    m_full_sync = true;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::merge
+ * Adds the \a identities to the registry. Known devices are updated in place.
+ * \param identities
+ * \return
+ * Identities which were not in the registry before.
+ */
+QVector<QCloudMessagingEmbeddedKaltiotIdentity> QCloudMessagingEmbeddedKaltiotDeviceRegistry::merge(
+        const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &identities)
+{
+    QVector<QCloudMessagingEmbeddedKaltiotIdentity> added;
+
+    for (const QCloudMessagingEmbeddedKaltiotIdentity &identity : identities) {
+        if (identity.rid.isEmpty())
+            continue;
+
+        if (m_full_sync)
+            m_seen.insert(identity.rid);
+
+        m_newest_timestamp = qMax(m_newest_timestamp, identity.timestamp);
+
+        auto it = m_devices.find(identity.rid);
+        if (it == m_devices.end()) {
+            m_devices.insert(identity.rid, identity);
+            added.append(identity);
+        } else {
+            it.value() = identity;
+        }
+    }
+
+    return added;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::endFullSync
+ * Ends the full sync. Devices which were not listed are removed, unless the
+ * listing was incomplete.
+ * \param complete
+ * \return
+ * Removed rids.
+ */
+QStringList QCloudMessagingEmbeddedKaltiotDeviceRegistry::endFullSync(bool complete)
+{
+    QStringList removed;
+
+    if (m_full_sync && complete) {
+        for (auto it = m_devices.begin(); it != m_devices.end();) {
+            if (!m_seen.contains(it.key())) {
+                removed.append(it.key());
+                it = m_devices.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    m_seen.clear();
+    m_full_sync = false;
+    return removed;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::isFullSyncRunning
+ * \return
+ */
+bool QCloudMessagingEmbeddedKaltiotDeviceRegistry::isFullSyncRunning() const
+{
+    return m_full_sync;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::contains
+ * \param rid
+ * \return
+ */
+bool QCloudMessagingEmbeddedKaltiotDeviceRegistry::contains(const QString &rid) const
+{
+    return m_devices.contains(rid);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::device
+ * \param rid
+ * \return
+ */
+QCloudMessagingEmbeddedKaltiotIdentity QCloudMessagingEmbeddedKaltiotDeviceRegistry::device(
+        const QString &rid) const
+{
+    return m_devices.value(rid);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::rids
+ * \return
+ */
+QStringList QCloudMessagingEmbeddedKaltiotDeviceRegistry::rids() const
+{
+    return m_devices.keys();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::count
+ * \return
+ */
+int QCloudMessagingEmbeddedKaltiotDeviceRegistry::count() const
+{
+    return m_devices.size();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::watermark
+ * \return
+ * Creation time up to which the registry is in sync, 0 before the first sync.
+ */
+qint64 QCloudMessagingEmbeddedKaltiotDeviceRegistry::watermark() const
+{
+    return m_watermark;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::setWatermark
+ * \param watermark
+ */
+void QCloudMessagingEmbeddedKaltiotDeviceRegistry::setWatermark(qint64 watermark)
+{
+    m_watermark = watermark;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::advanceWatermark
+ * Moves the watermark to the newest server timestamp of the merged devices.
+ * Local time is used only when the server did not send any timestamps.
+ * Watermark never moves backwards.
+ * \param localTime
+ * Local time when the sync was started.
+ */
+void QCloudMessagingEmbeddedKaltiotDeviceRegistry::advanceWatermark(qint64 localTime)
+{
+    m_watermark = qMax(m_watermark, m_newest_timestamp > 0 ? m_newest_timestamp : localTime);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::newestTimestamp
+ * \return
+ * Newest server timestamp of the merged devices, 0 if none had a timestamp.
+ */
+qint64 QCloudMessagingEmbeddedKaltiotDeviceRegistry::newestTimestamp() const
+{
+    return m_newest_timestamp;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotDeviceRegistry::clear
+ */
+void QCloudMessagingEmbeddedKaltiotDeviceRegistry::clear()
+{
+    m_devices.clear();
+    m_seen.clear();
+    m_full_sync = false;
+    m_watermark = 0;
+    m_newest_timestamp = 0;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,101 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGEMBEDDEDKALTIOTREGISTRY_P_H
+#define QCLOUDMESSAGINGEMBEDDEDKALTIOTREGISTRY_P_H
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QtCloudMessagingEmbeddedKaltiot/qcloudmessagingembeddedkaltiotrest.h>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+
+/*
+ * Local copy of the remote device identities, indexed by rid. A full sync
+ * marks every listed device as seen and removes the ones which were not,
+ * incremental syncs only add the devices created after the watermark.
+ * Watermark follows the server timestamps of the devices, so that the
+ * clock of this device does not affect the sync.
+ */
+class Q_CLOUDMESSAGING_EXPORT QCloudMessagingEmbeddedKaltiotDeviceRegistry
+{
+public:
+    QCloudMessagingEmbeddedKaltiotDeviceRegistry();
+
+    void beginFullSync();
+
+    QVector<QCloudMessagingEmbeddedKaltiotIdentity> merge(
+            const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &identities);
+
+    QStringList endFullSync(bool complete);
+
+    bool isFullSyncRunning() const;
+
+    bool contains(const QString &rid) const;
+
+    QCloudMessagingEmbeddedKaltiotIdentity device(const QString &rid) const;
+
+    QStringList rids() const;
+
+    int count() const;
+
+    qint64 watermark() const;
+
+    void setWatermark(qint64 watermark);
+
+    void advanceWatermark(qint64 localTime);
+
+    qint64 newestTimestamp() const;
+
+    void clear();
+
+private:
+    QHash<QString, QCloudMessagingEmbeddedKaltiotIdentity> m_devices;
+    QSet<QString> m_seen;
+    bool m_full_sync;
+    qint64 m_watermark;
+    qint64 m_newest_timestamp;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGEMBEDDEDKALTIOTREGISTRY_P_H
@@ -31,12 +31,44 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QNetworkReply>
 
 QT_BEGIN_NAMESPACE
 
 /* REST API INTERFACE */
 const QString SERVER_ADDRESS = QStringLiteral("https://restapi.torqhub.io");
 
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::QCloudMessagingEmbeddedKaltiotRest
+ * \param parent
+ */
+QCloudMessagingEmbeddedKaltiotRest::QCloudMessagingEmbeddedKaltiotRest(QObject *parent)
+    : QCloudMessagingRestApi(parent),
+      m_listing_page_size(0),
+      m_listing_next(0),
+      m_listing_end(-1),
+      m_listing_in_flight(0),
+      m_listing_count(0),
+      m_listing_failed(false),
+      m_presence_ttl(30000),
+      m_presence_prune_at(1024)
+{
+    m_presence_clock.start();
+
+    // A page which ran out of retries ends the listing as incomplete
+    connect(this, &QCloudMessagingRestApi::networkMessageExpired,
+            this, [this](quint64, int req_id, const QString &info) {
+        if (req_id == REQ_GET_DEVICES_PAGE)
+            devicePageFinished(info.toInt(), 0, false);
+        else if (req_id == REQ_GET_DEVICE_INFO)
+            presenceFinished(info, PresenceUnknown, false);
+        else if (req_id == REQ_GET_DEVICES_BY_TIME)
+            devicesCreatedFinished(info, QVector<QCloudMessagingEmbeddedKaltiotIdentity>(), false);
+    });
+}
+
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotRest::getAllDevices
  * \return
@@ -52,6 +84,346 @@ bool QCloudMessagingEmbeddedKaltiotRest::getAllDevices()
     return sendMessage(GET_MSG, REQ_GET_ALL_DEVICES, request, "", true, "");
 }
 
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::listDevices
+ * Lists device identities page by page. Pages are requested in order with
+ * parallelPages of them in flight, so only a bounded amount of the fleet is
+ * held in memory at once. The first page shorter than pageSize marks the end
+ * of the list.
+ * \param pageSize
+ * \param parallelPages
+ * \return
+ * False if a listing is already running.
+ */
+bool QCloudMessagingEmbeddedKaltiotRest::listDevices(int pageSize, int parallelPages)
+{
+    if (isListingDevices() || pageSize <= 0)
+        return false;
+
+    m_listing_page_size = pageSize;
+    m_listing_next = 0;
+    m_listing_end = -1;
+    m_listing_count = 0;
+    m_listing_failed = false;
+
+    for (int i = 0; i < qMax(1, parallelPages); i++)
+        requestDevicePage();
+
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::isListingDevices
+ * \return
+ */
+bool QCloudMessagingEmbeddedKaltiotRest::isListingDevices() const
+{
+    return m_listing_in_flight > 0;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::getDevicesCreated
+ * Requests the device identities created between the timestamps. The result
+ * is delivered with remoteDevicesCreated.
+ * \param timeFrom
+ * \param timeTo
+ * \return
+ */
+bool QCloudMessagingEmbeddedKaltiotRest::getDevicesCreated(qint64 timeFrom, qint64 timeTo)
+{
+    QString url = SERVER_ADDRESS + "/rids/identities/timeFrom/" + QString::number(timeFrom)
+            + "/timeTo/" + QString::number(timeTo) + "?ApiKey=" + m_auth_key;
+    QUrl uri(url);
+    QNetworkRequest request(uri);
+
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "text/plain; charset=ISO-8859-1");
+
+    return sendMessage(GET_MSG, REQ_GET_DEVICES_BY_TIME, request, "", true,
+                       QString::number(timeFrom) + QLatin1Char(':') + QString::number(timeTo));
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::presence
+ * Returns the cached presence of the device. If there is no fresh result the
+ * lookup is started and PresenceUnknown returned, the result follows with
+ * presenceReceived.
+ * \param rid
+ * \return
+ */
+QCloudMessagingEmbeddedKaltiotRest::PresenceState QCloudMessagingEmbeddedKaltiotRest::presence(
+        const QString &rid)
+{
+    auto it = m_presence.constFind(rid);
+    if (it != m_presence.constEnd() && it->expires > m_presence_clock.elapsed())
+        return it->state;
+
+    requestDevicePresence(rid);
+    return PresenceUnknown;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::requestPresence
+ * Looks up the presence of several devices. Lookups are pipelined through
+ * the REST interface queue, rids with a fresh cached result are reported
+ * with presenceReceived before returning and rids already being looked up
+ * are not requested again.
+ * \param rids
+ * \return
+ * Number of new lookups started.
+ */
+int QCloudMessagingEmbeddedKaltiotRest::requestPresence(const QStringList &rids)
+{
+    const qint64 now = m_presence_clock.elapsed();
+    int started = 0;
+
+    for (const QString &rid : rids) {
+        auto it = m_presence.constFind(rid);
+        if (it != m_presence.constEnd() && it->expires > now)
+            Q_EMIT presenceReceived(rid, it->state);
+        else if (requestDevicePresence(rid))
+            started++;
+    }
+
+    return started;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::setPresenceTtl
+ * \param msecs
+ * Time a presence result is used before it is requested again.
+ */
+void QCloudMessagingEmbeddedKaltiotRest::setPresenceTtl(int msecs)
+{
+    m_presence_ttl = qMax(0, msecs);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::presenceTtl
+ * \return
+ */
+int QCloudMessagingEmbeddedKaltiotRest::presenceTtl() const
+{
+    return m_presence_ttl;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::clearPresenceCache
+ */
+void QCloudMessagingEmbeddedKaltiotRest::clearPresenceCache()
+{
+    m_presence.clear();
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::requestDevicePresence
+ * Private function to send the presence request, unless one is pending.
+ * \param rid
+ * \return
+ * False if the lookup was already pending.
+ */
+bool QCloudMessagingEmbeddedKaltiotRest::requestDevicePresence(const QString &rid)
+{
+    if (rid.isEmpty() || m_presence_pending.contains(rid))
+        return false;
+
+    m_presence_pending.insert(rid);
+
+    QString url = SERVER_ADDRESS + "/rids/" + rid + "/presence" + "?ApiKey=" + m_auth_key;
+    QUrl uri(url);
+    QNetworkRequest request(uri);
+
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "text/plain; charset=ISO-8859-1");
+
+    sendMessage(GET_MSG, REQ_GET_DEVICE_INFO, request, "", true, rid);
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::presenceFinished
+ * Private function to cache and deliver the presence result.
+ * \param rid
+ * \param state
+ * \param cache
+ * False for failed lookups, they are not cached.
+ */
+void QCloudMessagingEmbeddedKaltiotRest::presenceFinished(const QString &rid,
+                                                          PresenceState state, bool cache)
+{
+    if (!m_presence_pending.remove(rid))
+        return;
+
+    if (cache && m_presence_ttl > 0) {
+        const qint64 now = m_presence_clock.elapsed();
+
+        // Expired entries are dropped when the cache has doubled since last time
+        if (m_presence.size() >= m_presence_prune_at) {
+            for (auto it = m_presence.begin(); it != m_presence.end();) {
+                if (it->expires <= now)
+                    it = m_presence.erase(it);
+                else
+                    ++it;
+            }
+            m_presence_prune_at = qMax(1024, m_presence.size() * 2);
+        }
+
+        PresenceEntry &entry = m_presence[rid];
+        entry.state = state;
+        entry.expires = now + m_presence_ttl;
+    }
+
+    Q_EMIT presenceReceived(rid, state);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::parsePresence
+ * Private function to read the presence reply. The \c presence field is
+ * either a boolean or one of "online", "connected", "offline" and
+ * "disconnected". A rid which is not found is not connected, so it is
+ * reported offline. Any other reply is PresenceUnknown, which is not
+ * cached.
+ * \param reply
+ * \param data
+ * \return
+ */
+QCloudMessagingEmbeddedKaltiotRest::PresenceState QCloudMessagingEmbeddedKaltiotRest::parsePresence(
+        QNetworkReply *reply, const QByteArray &data)
+{
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 404)
+        return PresenceOffline;
+    if (reply->error())
+        return PresenceUnknown;
+
+    const QJsonValue value = QJsonDocument::fromJson(data).object().value(QLatin1String("presence"));
+    if (value.isBool())
+        return value.toBool() ? PresenceOnline : PresenceOffline;
+
+    const QString text = value.toString();
+    if (text.compare(QLatin1String("online"), Qt::CaseInsensitive) == 0
+            || text.compare(QLatin1String("connected"), Qt::CaseInsensitive) == 0)
+        return PresenceOnline;
+    if (text.compare(QLatin1String("offline"), Qt::CaseInsensitive) == 0
+            || text.compare(QLatin1String("disconnected"), Qt::CaseInsensitive) == 0)
+        return PresenceOffline;
+
+    return PresenceUnknown;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::devicesCreatedFinished
+ * Private function to deliver the result of getDevicesCreated.
+ * \param info
+ * Time range of the request as "timeFrom:timeTo".
+ * \param devices
+ * \param ok
+ */
+void QCloudMessagingEmbeddedKaltiotRest::devicesCreatedFinished(
+        const QString &info, const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices, bool ok)
+{
+    const int separator = info.indexOf(QLatin1Char(':'));
+    const qint64 timeFrom = info.leftRef(separator).toLongLong();
+    const qint64 timeTo = info.midRef(separator + 1).toLongLong();
+
+    Q_EMIT remoteDevicesCreated(devices, timeFrom, timeTo, ok);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::requestDevicePage
+ * Private function to request the next page of the running listing.
+ * \return
+ */
+bool QCloudMessagingEmbeddedKaltiotRest::requestDevicePage()
+{
+    if (m_listing_end >= 0 && m_listing_next >= m_listing_end)
+        return false;
+
+    const int page = m_listing_next;
+    QString url = SERVER_ADDRESS + "/rids/identities/paginStart/"
+            + QString::number(page * m_listing_page_size)
+            + "/paginCount/" + QString::number(m_listing_page_size)
+            + "?ApiKey=" + m_auth_key;
+    QUrl uri(url);
+    QNetworkRequest request(uri);
+
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "text/plain; charset=ISO-8859-1");
+
+    // Counted before sending, an open circuit may expire the page right away
+    m_listing_next++;
+    m_listing_in_flight++;
+
+    // Page beyond the in-flight window of the REST interface is queued, not lost
+    sendMessage(GET_MSG, REQ_GET_DEVICES_PAGE, request, "", true, QString::number(page));
+    return true;
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::devicePageFinished
+ * Private function to keep the page window full and to finish the listing
+ * when the last page in flight has been handled.
+ * \param page
+ * \param count
+ * Number of identities in the page.
+ * \param ok
+ */
+void QCloudMessagingEmbeddedKaltiotRest::devicePageFinished(int page, int count, bool ok)
+{
+    if (m_listing_in_flight == 0)
+        return;
+
+    m_listing_in_flight--;
+    m_listing_count += count;
+
+    if (!ok)
+        m_listing_failed = true;
+
+    if (!ok || count < m_listing_page_size) {
+        if (m_listing_end < 0 || page < m_listing_end)
+            m_listing_end = page;
+    } else {
+        requestDevicePage();
+    }
+
+    if (m_listing_in_flight == 0)
+        Q_EMIT remoteDevicesListed(m_listing_count, !m_listing_failed);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::parseIdentities
+ * Private function to parse one page of identities. The page is parsed from
+ * the UTF-8 reply data directly.
+ * \param data
+ * \param ok
+ * \return
+ */
+QVector<QCloudMessagingEmbeddedKaltiotIdentity> QCloudMessagingEmbeddedKaltiotRest::parseIdentities(
+        const QByteArray &data, bool *ok)
+{
+    QVector<QCloudMessagingEmbeddedKaltiotIdentity> identities;
+
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(data, &error);
+    *ok = error.error == QJsonParseError::NoError && document.isArray();
+    if (!*ok)
+        return identities;
+
+    const QJsonArray array = document.array();
+    identities.reserve(array.size());
+    for (const QJsonValue &value : array) {
+        QCloudMessagingEmbeddedKaltiotIdentity identity;
+        if (value.isString()) {
+            identity.rid = value.toString();
+        } else {
+            identity.data = value.toObject();
+            identity.rid = identity.data.value(QLatin1String("rid")).toString();
+            identity.customerId = identity.data.value(QLatin1String("customer_id")).toString();
+            identity.timestamp = qint64(identity.data.value(QLatin1String("timestamp")).toDouble());
+        }
+        identities.append(identity);
+    }
+
+    return identities;
+}
+
 /*!
  * \brief QCloudMessagingEmbeddedKaltiotRest::sendDataToDevice
  * \param rid
@@ -89,16 +461,64 @@ bool QCloudMessagingEmbeddedKaltiotRest::sendBroadcast(const QString &channel, c
 }
 
 /*!
- * \brief QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply
- * \param reply
+ * \brief QCloudMessagingEmbeddedKaltiotRest::createChannelDataStream
+ * \param cn
+ * \param persistent
+ * \return
+ * Stream owned by the REST interface, not yet opened.
+ */
+QCloudMessagingDataStream *QCloudMessagingEmbeddedKaltiotRest::createChannelDataStream(
+        const QString &cn, bool persistent)
+{
+    return createDataStream("/cn/" + cn + "/data_stream", persistent);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::createDeviceDataStream
+ * \param rid
+ * \param persistent
+ * \return
+ * Stream owned by the REST interface, not yet opened.
+ */
+QCloudMessagingDataStream *QCloudMessagingEmbeddedKaltiotRest::createDeviceDataStream(
+        const QString &rid, bool persistent)
+{
+    return createDataStream("/rids/" + rid + "/data_stream", persistent);
+}
+
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::createDataStream
+ * Persistent session is created over HTTPS, data is streamed over WSS.
+ * \param path
+ * \param persistent
+ * \return
  */
-void QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply(QNetworkReply *reply)
+QCloudMessagingDataStream *QCloudMessagingEmbeddedKaltiotRest::createDataStream(
+        const QString &path, bool persistent)
 {
+    QCloudMessagingDataStream *stream = new QCloudMessagingDataStream(this);
 
-    getNetworkManager()->disconnect(SIGNAL(finished(QNetworkReply *)));
-    QString m_msg_uuid = reply->property("uuid").toString();
-    int req_id = reply->property("req_id").toInt();
+    QUrl uri(SERVER_ADDRESS + path + "?ApiKey=" + m_auth_key);
+    if (persistent) {
+        QNetworkRequest request(uri);
+        request.setHeader(QNetworkRequest::ContentTypeHeader, "text/plain; charset=ISO-8859-1");
+        stream->setSessionRequest(request);
+    }
+
+    uri.setScheme(QStringLiteral("wss"));
+    stream->setStreamUrl(uri);
+
+    return stream;
+}
 
+/*!
+ * \brief QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply
+ * \param reply
+ * \param context
+ */
+void QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply(QNetworkReply *reply,
+                                                             const QCloudMessagingRequestContext &context)
+{
     if (reply->error()) {
         emit xmlHttpRequestError(reply->errorString());
 
@@ -108,7 +528,7 @@ void QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply(QNetworkReply *repl
 
     QByteArray data(reply->readAll());
 
-    switch (req_id) {
+    switch (context.req_id) {
     case REQ_GET_DEVICES_BY_CUSTOMER_ID:
 
         break;
@@ -122,13 +542,32 @@ void QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply(QNetworkReply *repl
     case REQ_SEND_BROADCAST_DATA_TO_CHANNEL:
 
         break;
-    case REQ_GET_DEVICE_INFO:
-
-        break;
+    case REQ_GET_DEVICE_INFO: {
+        const PresenceState state = parsePresence(reply, data);
+        presenceFinished(context.info, state, state != PresenceUnknown);
+    }
+    break;
+    case REQ_GET_DEVICES_PAGE: {
+        bool ok = !reply->error();
+        QVector<QCloudMessagingEmbeddedKaltiotIdentity> identities;
+        if (ok)
+            identities = parseIdentities(data, &ok);
+        if (!identities.isEmpty())
+            Q_EMIT remoteDevicesReceived(identities);
+        devicePageFinished(context.info.toInt(), identities.size(), ok);
+    }
+    break;
+    case REQ_GET_DEVICES_BY_TIME: {
+        bool ok = !reply->error();
+        QVector<QCloudMessagingEmbeddedKaltiotIdentity> identities;
+        if (ok)
+            identities = parseIdentities(data, &ok);
+        devicesCreatedFinished(context.info, identities, ok);
+    }
+    break;
     }
 
-    reply->deleteLater();
-    clearMessage(m_msg_uuid);
+    clearMessage(context.msg_id);
 
 }
 
@@ -142,4 +581,50 @@ void QCloudMessagingEmbeddedKaltiotRest::xmlHttpRequestReply(QNetworkReply *repl
     Response data is based on the service and can be e.g. a list
     of client tokens in QString format.
 */
+
+/*!
+    \fn QCloudMessagingEmbeddedKaltiotRest::remoteDevicesReceived(const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices)
+    This signal is triggered for each page of device identities received
+    by listDevices.
+
+    \param devices
+    Parsed device identities of the page.
+*/
+
+/*!
+    \fn QCloudMessagingEmbeddedKaltiotRest::remoteDevicesListed(int count, bool complete)
+    This signal is triggered when the last page of listDevices has been
+    handled.
+
+    \param count
+    Number of device identities received.
+
+    \param complete
+    False if a page failed and the listing ended early.
+*/
+
+/*!
+    \fn QCloudMessagingEmbeddedKaltiotRest::presenceReceived(const QString &rid, QCloudMessagingEmbeddedKaltiotRest::PresenceState state)
+    This signal is triggered when the presence of the device is known,
+    or the lookup failed with PresenceUnknown.
+
+    \param rid
+    \param state
+*/
+
+/*!
+    \fn QCloudMessagingEmbeddedKaltiotRest::remoteDevicesCreated(const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices, qint64 timeFrom, qint64 timeTo, bool ok)
+    This signal is triggered when the reply for getDevicesCreated is
+    received.
+
+    \param devices
+    Device identities created within the time range.
+
+    \param timeFrom
+    \param timeTo
+    Time range of the request.
+
+    \param ok
+    False if the request failed.
+*/
 QT_END_NAMESPACE
@@ -31,11 +31,30 @@
 #include <QtCloudMessaging/QtCloudMessaging>
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
 #include <QtCloudMessaging/qcloudmessagingrestapi.h>
-#include <QtCloudMessagingEmbeddedKaltiot/qcloudmessagingembeddedkaltiotclient.h>
+#include <QtCloudMessaging/qcloudmessagingdatastream.h>
 #include <QObject>
+#include <QVector>
+#include <QJsonObject>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
 
 QT_BEGIN_NAMESPACE
 
+class QCloudMessagingEmbeddedKaltiotIdentity
+{
+public:
+    QCloudMessagingEmbeddedKaltiotIdentity()
+        : timestamp(0)
+    {
+    }
+
+    QString rid;
+    QString customerId;
+    qint64 timestamp;
+    QJsonObject data;
+};
+
 class QCloudMessagingEmbeddedKaltiotRest : public QCloudMessagingRestApi
 {
     Q_OBJECT
@@ -46,10 +65,21 @@ public:
         REQ_GET_ALL_DEVICES,
         REQ_SEND_DATA_TO_DEVICE,
         REQ_SEND_BROADCAST_DATA_TO_CHANNEL,
-        REQ_GET_DEVICE_INFO
+        REQ_GET_DEVICE_INFO,
+        REQ_GET_DEVICES_PAGE,
+        REQ_GET_DEVICES_BY_TIME
     };
     Q_ENUM(KaltiotRESTRequests)
 
+    enum PresenceState {
+        PresenceUnknown,
+        PresenceOffline,
+        PresenceOnline
+    };
+    Q_ENUM(PresenceState)
+
+    explicit QCloudMessagingEmbeddedKaltiotRest(QObject *parent = nullptr);
+
     void setAuthKey(QString key)
     {
         m_auth_key = key;
@@ -88,6 +118,37 @@ public:
     */
     bool getAllDevices();
 
+    /* listDevices implements
+     * GET /rids/identities/paginStart/:paginStart/paginCount/:paginCount - Your devices identities with pagination
+     *
+     * Keeps parallelPages pages in flight, parsed identities are emitted page by
+     * page with remoteDevicesReceived and the end with remoteDevicesListed.
+    */
+    bool listDevices(int pageSize = 500, int parallelPages = 4);
+
+    bool isListingDevices() const;
+
+    /* getDevicesCreated implements
+     * GET /rids/identities/timeFrom/:timeFrom/timeTo/:timeTo - Your device identities by creation timestamps
+    */
+    bool getDevicesCreated(qint64 timeFrom, qint64 timeTo);
+
+    /* Implements
+     * GET /rids/:rid/presence - Get your device presence information
+     *
+     * Results are cached for presenceTtl milliseconds and concurrent lookups for
+     * the same rid share one request.
+    */
+    PresenceState presence(const QString &rid);
+
+    int requestPresence(const QStringList &rids);
+
+    void setPresenceTtl(int msecs);
+
+    int presenceTtl() const;
+
+    void clearPresenceCache();
+
     /* Implements
      * POST /rids/:rid - Send data to single device
     */
@@ -98,6 +159,20 @@ public:
     */
     bool sendBroadcast(const QString &channel, const QByteArray &data);
 
+    /* Implements
+     * POST /cn/:cn/data_stream - Create persistent web socket session to all your devices
+     * GET /cn/:cn/data_stream/sessionId/:sessionId - Use persistent web socket to all your devices
+     * GET /cn/:cn/data_stream - Use non persistent web socket to all your devices
+    */
+    QCloudMessagingDataStream *createChannelDataStream(const QString &cn, bool persistent = true);
+
+    /* Implements
+     * POST /rids/:rid/data_stream - Create persistent web socket session to single device
+     * GET /rids/:rid/data_stream/sessionId/:sessionId - Use Persistent web socket to single device
+     * GET /rids/:rid/data_stream - Use non persistent web socket to single device
+    */
+    QCloudMessagingDataStream *createDeviceDataStream(const QString &rid, bool persistent = true);
+
     /* Error codes for requests */
     /**
      * {"result": "<Error Message>"}
@@ -113,15 +188,58 @@ public:
      * 10 - UnAuthorized        Apikey which was used was not accepted
      */
 
-    void xmlHttpRequestReply(QNetworkReply *reply);
+    void xmlHttpRequestReply(QNetworkReply *reply,
+                             const QCloudMessagingRequestContext &context) override;
 
 Q_SIGNALS:
     void remoteClientsReceived(const QString &clients);
+    void remoteDevicesReceived(const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices);
+    void remoteDevicesListed(int count, bool complete);
+    void presenceReceived(const QString &rid,
+                          QCloudMessagingEmbeddedKaltiotRest::PresenceState state);
+    void remoteDevicesCreated(const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices,
+                              qint64 timeFrom, qint64 timeTo, bool ok);
 
 private:
+    bool requestDevicePage();
+    void devicePageFinished(int page, int count, bool ok);
+    void devicesCreatedFinished(const QString &info,
+                                const QVector<QCloudMessagingEmbeddedKaltiotIdentity> &devices,
+                                bool ok);
+    bool requestDevicePresence(const QString &rid);
+    void presenceFinished(const QString &rid, PresenceState state, bool cache);
+    static PresenceState parsePresence(QNetworkReply *reply, const QByteArray &data);
+    static QVector<QCloudMessagingEmbeddedKaltiotIdentity> parseIdentities(const QByteArray &data,
+                                                                          bool *ok);
+
+    QCloudMessagingDataStream *createDataStream(const QString &path, bool persistent);
+
     QString m_auth_key;
+
+    // Device listing state, pages at or after m_listing_end are known to be empty
+    int m_listing_page_size;
+    int m_listing_next;
+    int m_listing_end;
+    int m_listing_in_flight;
+    int m_listing_count;
+    bool m_listing_failed;
+
+    struct PresenceEntry {
+        PresenceState state;
+        qint64 expires;
+    };
+
+    QHash<QString, PresenceEntry> m_presence;
+    QSet<QString> m_presence_pending;
+    QElapsedTimer m_presence_clock;
+    int m_presence_ttl;
+    int m_presence_prune_at;
 };
 
+Q_DECLARE_TYPEINFO(QCloudMessagingEmbeddedKaltiotIdentity, Q_MOVABLE_TYPE);
+
 QT_END_NAMESPACE
 
+Q_DECLARE_METATYPE(QCloudMessagingEmbeddedKaltiotIdentity)
+
 #endif // QCLOUDMESSAGINGEMBEDDEDKALTIOTREST_H
@@ -6,11 +6,14 @@ HEADERS += \
     qcloudmessagingfirebaseprovider.h \
     qcloudmessagingfirebaseclient_p.h \
     qcloudmessagingfirebaseprovider_p.h \
+    qcloudmessagingfirebasemessage.h \
+    qcloudmessagingfirebasejson_p.h \
     qcloudmessagingfirebaserest.h
 
 SOURCES += \
     $$PWD/qcloudmessagingfirebaseclient.cpp \
     $$PWD/qcloudmessagingfirebaseprovider.cpp \
+    qcloudmessagingfirebasemessage.cpp \
     qcloudmessagingfirebaserest.cpp
 
 # Check for GOOGLE_FIREBASE_SDK environment variable
@@ -29,6 +29,9 @@
 #include "qcloudmessagingfirebaseclient.h"
 #include "qcloudmessagingfirebaseclient_p.h"
 
+#include <QtCloudMessaging/qcloudmessagingtokenstore.h>
+
+
 #if defined(Q_OS_ANDROID)
 #include <QtAndroid>
 #include <QtAndroidExtras>
@@ -42,7 +45,6 @@ extern "C" {
 QT_BEGIN_NAMESPACE
 
 extern void LogMessage(const char *format, ...);
-static QCloudMessagingFirebaseClient *m_client_pointer;
 
 /*!
  * \brief QCloudMessagingFirebaseClient::QCloudMessagingFirebaseClient
@@ -62,6 +64,10 @@ QCloudMessagingFirebaseClient::~QCloudMessagingFirebaseClient()
 
 /*!
  * \brief QCloudMessagingFirebaseClient::connectClient
+ * Starts Firebase Messaging initialization and returns without waiting for
+ * it. clientStateChanged is emitted when initialization has completed,
+ * messages and channel changes requested before that are queued and run
+ * once the client is online.
  * \param clientId
  * \param parameters
  * \return
@@ -72,6 +78,11 @@ QString QCloudMessagingFirebaseClient::connectClient(const QString &clientId,
     QCloudMessagingClient::connectClient(clientId, parameters);
     // Call parent function to setup service ids and states.
 
+    // Last known token is usable until Firebase delivers a fresh one.
+    if (d->m_token.isEmpty())
+        d->m_token = QCloudMessagingTokenStore::defaultStore()->token(
+                    clientId + QStringLiteral("/token"));
+
     // Setup Firebase app for the client.
 #if defined(__ANDROID__)
     d->m_firebaseApp = ::firebase::App::Create(::firebase::AppOptions(), QAndroidJniEnvironment(),
@@ -82,21 +93,37 @@ QString QCloudMessagingFirebaseClient::connectClient(const QString &clientId,
     d->m_firebaseApp = ::firebase::App::Create(::firebase::AppOptions());
 
 #endif  // defined(__ANDROID__)
-    m_client_pointer = this;
+    d->m_ready = false;
+    d->m_failed = false;
+    setClientState(QtCloudMessagingClientConnecting);
 
     d->m_firebase_initializer.Initialize(d->m_firebaseApp,
-                                         nullptr, [](::firebase::App * fapp, void *) {
+                                         this, [](::firebase::App * fapp, void *client) {
         LogMessage("Try to initialize Firebase Messaging");
         return ::firebase::messaging::Initialize(
                     *fapp,
-                    (::firebase::messaging::Listener *)m_client_pointer);
+                    static_cast<::firebase::messaging::Listener *>(
+                        static_cast<QCloudMessagingFirebaseClient *>(client)));
     });
 
-    while (d->m_firebase_initializer.InitializeLastResult().status() !=
-            firebase::kFutureStatusComplete) {
-
-        LogMessage("Firebase: InitializeLastResult wait...");
-    }
+    // Initialization is finished on the completion callback, which may run in
+    // a Firebase thread. The result is posted to a context object created in
+    // the client's thread, the guard is only touched there.
+    QCloudMessagingFirebaseInitGuard *guard = new QCloudMessagingFirebaseInitGuard;
+    guard->client = this;
+    guard->context = new QObject;
+    d->m_firebase_initializer.InitializeLastResult().OnCompletion(
+                [](const ::firebase::FutureBase &result, void *data) {
+        QCloudMessagingFirebaseInitGuard *guard =
+                static_cast<QCloudMessagingFirebaseInitGuard *>(data);
+        const int error = result.error();
+        QMetaObject::invokeMethod(guard->context, [guard, error]() {
+            if (guard->client)
+                guard->client->initializationCompleted(error);
+            guard->context->deleteLater();
+            delete guard;
+        }, Qt::QueuedConnection);
+    }, guard);
 
     setClientId(clientId);
     return clientId;
@@ -112,8 +139,115 @@ QString QCloudMessagingFirebaseClient::connectClient(const QString &clientId,
 bool QCloudMessagingFirebaseClient::sendMessage(const QByteArray &msg,  const QString &clientToken,
                                                 const QString &channel)
 {
-    Q_UNUSED(channel)
+    if (!d->m_ready) {
+        if (d->m_failed)
+            return false;
+        queueRequest(QCloudMessagingFirebasePendingRequest::SendMessage, msg, clientToken, channel);
+        return true;
+    }
+
+    return sendFirebaseMessage(msg, clientToken);
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseClient::initializationCompleted
+ * Private function called in the client's thread when Firebase
+ * Messaging initialization has completed. On failure the queued requests
+ * are dropped and reported with queuedRequestFailed, later requests fail
+ * until the client is connected again.
+ * \param error
+ * Firebase initialization result, 0 when successful.
+ */
+void QCloudMessagingFirebaseClient::initializationCompleted(int error)
+{
+    if (clientState() == QtCloudMessagingClientDisconnecting)
+        return;
+
+    if (error != 0) {
+        LogMessage("Firebase: Messaging initialization failed: %d", error);
+        d->m_failed = true;
+        setClientState(QtCloudMessagingClientOffline);
+        emit clientStateChanged(clientId(), QtCloudMessagingClientOffline);
+        failPendingRequests();
+        return;
+    }
+
+    d->m_ready = true;
+    setClientState(QtCloudMessagingClientOnline);
+    emit clientStateChanged(clientId(), QtCloudMessagingClientOnline);
+
+    flushPendingRequests();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseClient::queueRequest
+ * Private function to keep the request until Firebase is ready.
+ * \param type
+ * \param msg
+ * \param clientToken
+ * \param channel
+ */
+void QCloudMessagingFirebaseClient::queueRequest(int type, const QByteArray &msg,
+                                                 const QString &clientToken,
+                                                 const QString &channel)
+{
+    QCloudMessagingFirebasePendingRequest request;
+    request.type = QCloudMessagingFirebasePendingRequest::RequestType(type);
+    request.message = msg;
+    request.clientToken = clientToken;
+    request.channel = channel;
+    d->m_pending.append(request);
+}
 
+/*!
+ * \brief QCloudMessagingFirebaseClient::flushPendingRequests
+ * Private function to run the requests made during initialization, in the
+ * order they were made.
+ */
+void QCloudMessagingFirebaseClient::flushPendingRequests()
+{
+    const QVector<QCloudMessagingFirebasePendingRequest> pending = std::move(d->m_pending);
+    d->m_pending.clear();
+
+    for (const QCloudMessagingFirebasePendingRequest &request : pending) {
+        switch (request.type) {
+        case QCloudMessagingFirebasePendingRequest::SendMessage:
+            sendFirebaseMessage(request.message, request.clientToken);
+            break;
+        case QCloudMessagingFirebasePendingRequest::Subscribe:
+            ::firebase::messaging::Subscribe(request.channel.toLatin1());
+            break;
+        case QCloudMessagingFirebasePendingRequest::Unsubscribe:
+            ::firebase::messaging::Unsubscribe(request.channel.toLatin1());
+            break;
+        }
+    }
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseClient::failPendingRequests
+ * Private function to drop the requests made during a failed
+ * initialization, in the order they were made.
+ */
+void QCloudMessagingFirebaseClient::failPendingRequests()
+{
+    const QVector<QCloudMessagingFirebasePendingRequest> pending = std::move(d->m_pending);
+    d->m_pending.clear();
+
+    for (const QCloudMessagingFirebasePendingRequest &request : pending)
+        emit queuedRequestFailed(clientId(), request.message, request.clientToken,
+                                 request.channel);
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseClient::sendFirebaseMessage
+ * \param msg
+ * \param clientToken
+ * \return
+ */
+bool QCloudMessagingFirebaseClient::sendFirebaseMessage(const QByteArray &msg,
+                                                        const QString &clientToken)
+{
     ::firebase::messaging::Message message;
 
     QString message_to = clientToken + "@gcm.googleapis.com";
@@ -140,6 +274,9 @@ bool QCloudMessagingFirebaseClient::sendMessage(const QByteArray &msg,  const QS
  */
 void QCloudMessagingFirebaseClient::disconnectClient()
 {
+    d->m_ready = false;
+    d->m_failed = false;
+    d->m_pending.clear();
     QCloudMessagingClient::disconnectClient();
 }
 
@@ -151,7 +288,7 @@ void QCloudMessagingFirebaseClient::disconnectClient()
 void QCloudMessagingFirebaseClient::cloudMessageReceived(const QString  &client,
                                                          const QByteArray  &message)
 {
-    emit messageReceived(client, message);
+    deliverMessage(client, message);
 }
 
 /*!
@@ -161,6 +298,8 @@ void QCloudMessagingFirebaseClient::cloudMessageReceived(const QString  &client,
 void QCloudMessagingFirebaseClient::OnTokenReceived(const char *token)
 {
     d->m_token = QString::fromLatin1(token);
+    QCloudMessagingTokenStore::defaultStore()->setToken(clientId() + QStringLiteral("/token"),
+                                                        d->m_token);
 }
 
 /*!
@@ -169,8 +308,7 @@ void QCloudMessagingFirebaseClient::OnTokenReceived(const char *token)
  */
 void QCloudMessagingFirebaseClient::OnMessage(const::firebase::messaging::Message &message)
 {
-    d->m_last_firebase_message = message;
-    emit messageReceived(clientId(), parseMessage(d->m_last_firebase_message).toUtf8());
+    deliverFirebaseMessage(QCloudMessagingFirebaseMessage(message));
 }
 
 /*!
@@ -180,114 +318,26 @@ void QCloudMessagingFirebaseClient::OnMessage(const::firebase::messaging::Messag
 void QCloudMessagingFirebaseClient::setClientToken(const QString  &uuid)
 {
     d->m_token = uuid;
+    QCloudMessagingTokenStore::defaultStore()->setToken(clientId() + QStringLiteral("/token"),
+                                                        d->m_token);
     emit clientTokenReceived(d->m_token);
 }
 
 /*!
- * \brief QCloudMessagingFirebaseClient::parseMessage
- * \param msg_map
- * \return
+ * \brief QCloudMessagingFirebaseClient::deliverFirebaseMessage
+ * Private function to emit the received message. The structured message is
+ * always emitted. The inbound history keeps the message itself, JSON is
+ * written only when messageReceived reaches a receiver or the history is
+ * read, and then only once.
+ * \param message
  */
-QString QCloudMessagingFirebaseClient::parseMessage(::firebase::messaging::Message  msg_map)
+void QCloudMessagingFirebaseClient::deliverFirebaseMessage(const QCloudMessagingFirebaseMessage &message)
 {
-    QString msg;
-    msg = QString::fromLatin1("{");
-    bool dotSign = false;
-
-    if (!msg_map.from.empty()) {
-        if (dotSign) msg += QString::fromLatin1(",");
-        msg += QString::fromLatin1("\"from\":\"") + QString::fromLatin1(msg_map.from.c_str()) + "\"";
-        dotSign = true;
-    }
-    if (!msg_map.error.empty()) {
-        if (dotSign) msg += QString::fromLatin1(",");
-        msg += QString::fromLatin1("\"error\":\"") + QString::fromLatin1(msg_map.error.c_str()) + "\"";
-        dotSign = true;
-    }
-    if (!msg_map.message_id.empty()) {
-        if (dotSign) msg += QString::fromLatin1(",");
-        msg += QString::fromLatin1("\"message_id\":\"") + QString::fromLatin1(
-                   msg_map.message_id.c_str()) + "\"";
-        dotSign = true;
-    }
-
-    if (msg_map.notification) {
-
-        if (dotSign) msg += QString::fromLatin1(",");
-
-        msg += QString::fromLatin1("\"notification\":{");
-
-        if (msg_map.notification_opened)
-            msg += QString::fromLatin1("\"notification_opened\":true");
-        else
-            msg += QString::fromLatin1("\"notification_opened\":false");
-
-        if (!msg_map.notification->title.empty())
-            msg += QString::fromLatin1(",\"title\":\"") + QString::fromLatin1(
-                   msg_map.notification->title.c_str()) + QString::fromLatin1("\"");
-
-        if (!msg_map.notification->body.empty())
-            msg += QString::fromLatin1(",\"body\":\"") + QString::fromLatin1(msg_map.notification->body.c_str())
-                   + QString::fromLatin1("\"");
-
-        if (!msg_map.notification->icon.empty())
-            msg += QString::fromLatin1(",\"icon\":\"") + QString::fromLatin1(msg_map.notification->icon.c_str())
-                   + QString::fromLatin1("\"");
-
-        if (!msg_map.notification->tag.empty())
-            msg += QString::fromLatin1(",\"tag\":\"") + QString::fromLatin1(msg_map.notification->tag.c_str()) +
-                   QString::fromLatin1("\"");
-
-        if (!msg_map.notification->color.empty())
-            msg += QString::fromLatin1(",\"color\":\"") + QString::fromLatin1(
-                   msg_map.notification->color.c_str()) + QString::fromLatin1("\"");
-
-        if (!msg_map.notification->sound.empty())
-            msg += QString::fromLatin1(",\"sound\":\"") + QString::fromLatin1(
-                   msg_map.notification->sound.c_str()) + QString::fromLatin1("\"");
-
-        if (!msg_map.notification->click_action.empty())
-            msg += QString::fromLatin1(",\"click_action\":\"") + QString::fromLatin1(
-                   msg_map.notification->click_action.c_str()) + QString::fromLatin1("\"");
-
-        msg += QString::fromLatin1("}");
-
-        dotSign = true;
-    }
-    if (msg_map.data.size() > 0) {
-        if (dotSign) msg += QString::fromLatin1(",");
-
-        dotSign = false;
-
-        msg += QString::fromLatin1("\"data\":{");
-
-        for (const auto &field : msg_map.data) {
+    emit firebaseMessageReceived(clientId(), message);
 
-            if (!field.first.empty() && !field.second.empty()) {
-                if (dotSign) msg += QString::fromLatin1(",");
-
-                msg += QString::fromLatin1("\"") + QString::fromStdString(field.first) + QString::fromLatin1("\":")
-                       + QString::fromStdString(field.second);
-
-                dotSign = true;
-            }
-        }
-        msg += QString::fromLatin1("}");
-    }
-    msg += QString::fromLatin1("}");
-    return msg;
-}
-
-/*!
- * \brief QCloudMessagingFirebaseClient::flushMessageQueue
- * \return
- */
-bool QCloudMessagingFirebaseClient::flushMessageQueue()
-{
-    if (!d->m_last_firebase_message.message_id.empty()) {
-        emit messageReceived(clientId(), parseMessage(d->m_last_firebase_message).toUtf8());
-    }
-    return true;
+    deliverMessage(clientId(), message.jsonSizeHint(), [message]() {
+        return message.toJson();
+    });
 }
 
 /*!
@@ -297,6 +347,12 @@ bool QCloudMessagingFirebaseClient::flushMessageQueue()
  */
 bool QCloudMessagingFirebaseClient::subscribeToChannel(const QString  &channel)
 {
+    if (!d->m_ready) {
+        if (d->m_failed)
+            return false;
+        queueRequest(QCloudMessagingFirebasePendingRequest::Subscribe, QByteArray(), QString(), channel);
+        return true;
+    }
     ::firebase::messaging::Subscribe(channel.toLatin1());
     return true;
 }
@@ -308,6 +364,12 @@ bool QCloudMessagingFirebaseClient::subscribeToChannel(const QString  &channel)
  */
 bool QCloudMessagingFirebaseClient::unsubscribeFromChannel(const QString  &channel)
 {
+    if (!d->m_ready) {
+        if (d->m_failed)
+            return false;
+        queueRequest(QCloudMessagingFirebasePendingRequest::Unsubscribe, QByteArray(), QString(), channel);
+        return true;
+    }
     ::firebase::messaging::Unsubscribe(channel.toLatin1());
     return true;
 }
@@ -330,6 +392,29 @@ QString QCloudMessagingFirebaseClient::clientUuid()
     return d->m_token;
 }
 
+// Signals documentation
+/*!
+    \fn QCloudMessagingFirebaseClient::firebaseMessageReceived(const QString &clientId, const QCloudMessagingFirebaseMessage &message)
+    This signal is triggered when a message is received, before
+    messageReceived. The message fields are available without parsing
+    the JSON payload.
+
+    \param clientId
+    \param message
+*/
+
+/*!
+    \fn QCloudMessagingFirebaseClient::queuedRequestFailed(const QString &clientId, const QByteArray &message, const QString &clientToken, const QString &channel)
+    This signal is triggered for each message or channel change that was
+    queued during initialization, when the initialization fails. The
+    message is empty for channel changes.
+
+    \param clientId
+    \param message
+    \param clientToken
+    \param channel
+*/
+
 // Provide link to main - which will be in the app using this service.
 extern int main(int argc, char *argv[]);
 
@@ -33,6 +33,7 @@
 #include "firebase/app.h"
 #include "firebase/messaging.h"
 #include "firebase/util.h"
+#include "qcloudmessagingfirebasemessage.h"
 #include <QObject>
 #include <QVariantMap>
 #include <QScopedPointer>
@@ -43,7 +44,7 @@ class QCloudMessagingFirebaseClientPrivate;
 
 class QCloudMessagingFirebaseClient: public QCloudMessagingClient, firebase::messaging::Listener
 {
-
+    Q_OBJECT
 public:
 
     explicit QCloudMessagingFirebaseClient(QObject *parent = nullptr);
@@ -59,8 +60,6 @@ public:
 
     //! Qt Cloud messaging client virtual functions
 
-    virtual bool flushMessageQueue() override;
-
     virtual QString connectClient(const QString &clientId,
                                   const QVariantMap &parameters = QVariantMap()) override;
 
@@ -83,8 +82,20 @@ public:
 
     void setClientToken(const QString &uuid) override;
 
+Q_SIGNALS:
+    void firebaseMessageReceived(const QString &clientId,
+                                 const QCloudMessagingFirebaseMessage &message);
+    void queuedRequestFailed(const QString &clientId, const QByteArray &message,
+                             const QString &clientToken, const QString &channel);
+
 private:
-    QString parseMessage(firebase::messaging::Message msg_map);
+    void deliverFirebaseMessage(const QCloudMessagingFirebaseMessage &message);
+    void initializationCompleted(int error);
+    void queueRequest(int type, const QByteArray &msg, const QString &clientToken,
+                      const QString &channel);
+    void flushPendingRequests();
+    void failPendingRequests();
+    bool sendFirebaseMessage(const QByteArray &msg, const QString &clientToken);
 
     QScopedPointer<QCloudMessagingFirebaseClientPrivate> d;
 };
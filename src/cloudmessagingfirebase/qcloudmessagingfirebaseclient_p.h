@@ -47,15 +47,45 @@
 #include "firebase/messaging.h"
 #include "firebase/util.h"
 
+#include <QPointer>
+#include <QVector>
+
 
 QT_BEGIN_NAMESPACE
 
 class QCloudMessaging;
 
+// Request made before Firebase Messaging finished initializing
+class QCloudMessagingFirebasePendingRequest
+{
+public:
+    enum RequestType {
+        SendMessage,
+        Subscribe,
+        Unsubscribe
+    };
+
+    RequestType type;
+    QByteArray message;
+    QString clientToken;
+    QString channel;
+};
+
+// Passed to the Firebase completion callback; the context object lives in
+// the client's thread and receives the result from the Firebase thread.
+struct QCloudMessagingFirebaseInitGuard
+{
+    QPointer<QCloudMessagingFirebaseClient> client;
+    QObject *context;
+};
+
 class QCloudMessagingFirebaseClientPrivate
 {
 public:
     QCloudMessagingFirebaseClientPrivate()
+        : m_firebaseApp(nullptr),
+          m_ready(false),
+          m_failed(false)
     {
     }
 
@@ -66,7 +96,9 @@ public:
 
     ::firebase::App *m_firebaseApp;
     ::firebase::ModuleInitializer  m_firebase_initializer;
-    ::firebase::messaging::Message m_last_firebase_message;
+    bool m_ready;
+    bool m_failed;
+    QVector<QCloudMessagingFirebasePendingRequest> m_pending;
 
 };
 
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QCLOUDMESSAGINGFIREBASEJSON_P_H
+#define QCLOUDMESSAGINGFIREBASEJSON_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include <QByteArray>
+#include <QString>
+
+#include <string>
+
+QT_BEGIN_NAMESPACE
+
+/*
+ * Appends the UTF-8 value as a quoted JSON string. Only quotes, backslashes
+ * and control characters need escaping.
+ */
+inline void qCloudMessagingAppendJsonString(QByteArray &out, const char *value, int size)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out.append('"');
+    for (int i = 0; i < size; i++) {
+        const char c = value[i];
+        switch (c) {
+        case '"': out.append("\\\"", 2); break;
+        case '\\': out.append("\\\\", 2); break;
+        case '\n': out.append("\\n", 2); break;
+        case '\r': out.append("\\r", 2); break;
+        case '\t': out.append("\\t", 2); break;
+        case '\b': out.append("\\b", 2); break;
+        case '\f': out.append("\\f", 2); break;
+        default:
+            if (uchar(c) < 0x20) {
+                out.append("\\u00", 4);
+                out.append(hex[uchar(c) >> 4]);
+                out.append(hex[uchar(c) & 0xf]);
+            } else {
+                out.append(c);
+            }
+        }
+    }
+    out.append('"');
+}
+
+inline void qCloudMessagingAppendJsonString(QByteArray &out, const std::string &value)
+{
+    qCloudMessagingAppendJsonString(out, value.data(), int(value.size()));
+}
+
+inline void qCloudMessagingAppendJsonString(QByteArray &out, const QString &value)
+{
+    const QByteArray utf8 = value.toUtf8();
+    qCloudMessagingAppendJsonString(out, utf8.constData(), utf8.size());
+}
+
+QT_END_NAMESPACE
+
+#endif // QCLOUDMESSAGINGFIREBASEJSON_P_H
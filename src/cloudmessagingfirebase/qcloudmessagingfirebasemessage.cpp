@@ -0,0 +1,321 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qcloudmessagingfirebasemessage.h"
+#include "qcloudmessagingfirebasejson_p.h"
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingFirebaseMessageData : public QSharedData
+{
+public:
+    ::firebase::messaging::Message message;
+    mutable QByteArray json;
+};
+
+static void appendJsonField(QByteArray &out, bool &separator, const char *key,
+                            const std::string &value)
+{
+    if (value.empty())
+        return;
+
+    if (separator)
+        out.append(',');
+    out.append('"').append(key).append("\":", 2);
+    qCloudMessagingAppendJsonString(out, value);
+    separator = true;
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::QCloudMessagingFirebaseMessage
+ */
+QCloudMessagingFirebaseMessage::QCloudMessagingFirebaseMessage() :
+    d(new QCloudMessagingFirebaseMessageData)
+{
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::QCloudMessagingFirebaseMessage
+ * Wraps the received Firebase message. Fields are converted only when they
+ * are asked for.
+ * \param message
+ */
+QCloudMessagingFirebaseMessage::QCloudMessagingFirebaseMessage(
+        const ::firebase::messaging::Message &message) :
+    d(new QCloudMessagingFirebaseMessageData)
+{
+    d->message = message;
+}
+
+QCloudMessagingFirebaseMessage::QCloudMessagingFirebaseMessage(
+        const QCloudMessagingFirebaseMessage &other) = default;
+
+QCloudMessagingFirebaseMessage &QCloudMessagingFirebaseMessage::operator=(
+        const QCloudMessagingFirebaseMessage &other) = default;
+
+QCloudMessagingFirebaseMessage::~QCloudMessagingFirebaseMessage() = default;
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::isEmpty
+ * \return
+ */
+bool QCloudMessagingFirebaseMessage::isEmpty() const
+{
+    return d->message.message_id.empty();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::from
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::from() const
+{
+    return QString::fromStdString(d->message.from);
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::messageId
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::messageId() const
+{
+    return QString::fromStdString(d->message.message_id);
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::error
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::error() const
+{
+    return QString::fromStdString(d->message.error);
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::hasNotification
+ * \return
+ */
+bool QCloudMessagingFirebaseMessage::hasNotification() const
+{
+    return d->message.notification != nullptr;
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::notificationOpened
+ * \return
+ */
+bool QCloudMessagingFirebaseMessage::notificationOpened() const
+{
+    return d->message.notification_opened;
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::title
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::title() const
+{
+    return hasNotification() ? QString::fromStdString(d->message.notification->title) : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::body
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::body() const
+{
+    return hasNotification() ? QString::fromStdString(d->message.notification->body) : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::icon
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::icon() const
+{
+    return hasNotification() ? QString::fromStdString(d->message.notification->icon) : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::tag
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::tag() const
+{
+    return hasNotification() ? QString::fromStdString(d->message.notification->tag) : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::color
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::color() const
+{
+    return hasNotification() ? QString::fromStdString(d->message.notification->color) : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::sound
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::sound() const
+{
+    return hasNotification() ? QString::fromStdString(d->message.notification->sound) : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::clickAction
+ * \return
+ */
+QString QCloudMessagingFirebaseMessage::clickAction() const
+{
+    return hasNotification() ? QString::fromStdString(d->message.notification->click_action)
+                             : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::data
+ * \return
+ * Data payload of the message.
+ */
+QHash<QString, QString> QCloudMessagingFirebaseMessage::data() const
+{
+    QHash<QString, QString> values;
+    values.reserve(int(d->message.data.size()));
+    for (const auto &field : d->message.data)
+        values.insert(QString::fromStdString(field.first), QString::fromStdString(field.second));
+    return values;
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::dataValue
+ * \param key
+ * \return
+ * Single value of the data payload, without converting the others.
+ */
+QString QCloudMessagingFirebaseMessage::dataValue(const QString &key) const
+{
+    const auto it = d->message.data.find(key.toStdString());
+    return it != d->message.data.end() ? QString::fromStdString(it->second) : QString();
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::firebaseMessage
+ * \return
+ */
+const ::firebase::messaging::Message &QCloudMessagingFirebaseMessage::firebaseMessage() const
+{
+    return d->message;
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::jsonSizeHint
+ * Estimates the size of toJson without serializing the message.
+ * \return
+ */
+int QCloudMessagingFirebaseMessage::jsonSizeHint() const
+{
+    const ::firebase::messaging::Message &msg = d->message;
+
+    int size = 16 + int(msg.from.size() + msg.error.size() + msg.message_id.size());
+    if (msg.notification) {
+        const ::firebase::messaging::Notification &n = *msg.notification;
+        size += 128 + int(n.title.size() + n.body.size() + n.icon.size() + n.tag.size()
+                          + n.color.size() + n.sound.size() + n.click_action.size());
+    }
+    for (const auto &field : msg.data)
+        size += 6 + int(field.first.size() + field.second.size());
+    return size;
+}
+
+/*!
+ * \brief QCloudMessagingFirebaseMessage::toJson
+ * Serializes the message to UTF-8 JSON on first use. The buffer is sized
+ * for the whole message up front and written directly, later calls return
+ * the same data.
+ * \return
+ */
+QByteArray QCloudMessagingFirebaseMessage::toJson() const
+{
+    if (!d->json.isNull())
+        return d->json;
+
+    const ::firebase::messaging::Message &msg = d->message;
+    const int size = jsonSizeHint();
+
+    QByteArray out;
+    out.reserve(size + size / 8);
+
+    bool separator = false;
+    out.append('{');
+    appendJsonField(out, separator, "from", msg.from);
+    appendJsonField(out, separator, "error", msg.error);
+    appendJsonField(out, separator, "message_id", msg.message_id);
+
+    if (msg.notification) {
+        const ::firebase::messaging::Notification &n = *msg.notification;
+        if (separator)
+            out.append(',');
+        out.append("\"notification\":{\"notification_opened\":");
+        out.append(msg.notification_opened ? "true" : "false");
+        bool notificationSeparator = true;
+        appendJsonField(out, notificationSeparator, "title", n.title);
+        appendJsonField(out, notificationSeparator, "body", n.body);
+        appendJsonField(out, notificationSeparator, "icon", n.icon);
+        appendJsonField(out, notificationSeparator, "tag", n.tag);
+        appendJsonField(out, notificationSeparator, "color", n.color);
+        appendJsonField(out, notificationSeparator, "sound", n.sound);
+        appendJsonField(out, notificationSeparator, "click_action", n.click_action);
+        out.append('}');
+        separator = true;
+    }
+
+    if (!msg.data.empty()) {
+        if (separator)
+            out.append(',');
+        out.append("\"data\":{");
+        bool dataSeparator = false;
+        for (const auto &field : msg.data) {
+            if (field.first.empty() || field.second.empty())
+                continue;
+            if (dataSeparator)
+                out.append(',');
+            qCloudMessagingAppendJsonString(out, field.first);
+            out.append(':');
+            qCloudMessagingAppendJsonString(out, field.second);
+            dataSeparator = true;
+        }
+        out.append('}');
+    }
+    out.append('}');
+
+    d->json = out;
+    return out;
+}
+
+QT_END_NAMESPACE
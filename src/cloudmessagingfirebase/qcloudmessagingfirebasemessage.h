@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtCloudMessaging module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3-COMM$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCLOUDMESSAGINGFIREBASEMESSAGE_H
+#define QCLOUDMESSAGINGFIREBASEMESSAGE_H
+
+#include <QtCloudMessaging/qtcloudmessagingglobal.h>
+#include "firebase/messaging.h"
+#include <QByteArray>
+#include <QHash>
+#include <QMetaType>
+#include <QSharedDataPointer>
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+
+class QCloudMessagingFirebaseMessageData;
+
+class QCloudMessagingFirebaseMessage
+{
+public:
+    QCloudMessagingFirebaseMessage();
+    explicit QCloudMessagingFirebaseMessage(const ::firebase::messaging::Message &message);
+    QCloudMessagingFirebaseMessage(const QCloudMessagingFirebaseMessage &other);
+    QCloudMessagingFirebaseMessage &operator=(const QCloudMessagingFirebaseMessage &other);
+    ~QCloudMessagingFirebaseMessage();
+
+    bool isEmpty() const;
+
+    QString from() const;
+    QString messageId() const;
+    QString error() const;
+
+    bool hasNotification() const;
+    bool notificationOpened() const;
+    QString title() const;
+    QString body() const;
+    QString icon() const;
+    QString tag() const;
+    QString color() const;
+    QString sound() const;
+    QString clickAction() const;
+
+    QHash<QString, QString> data() const;
+    QString dataValue(const QString &key) const;
+
+    const ::firebase::messaging::Message &firebaseMessage() const;
+
+    int jsonSizeHint() const;
+    QByteArray toJson() const;
+
+private:
+    QSharedDataPointer<QCloudMessagingFirebaseMessageData> d;
+};
+
+QT_END_NAMESPACE
+
+Q_DECLARE_METATYPE(QCloudMessagingFirebaseMessage)
+
+#endif // QCLOUDMESSAGINGFIREBASEMESSAGE_H
@@ -64,6 +64,10 @@ QCloudMessagingFirebaseProvider::QCloudMessagingFirebaseProvider(QObject *parent
     d(new QCloudMessagingFirebaseProviderPrivate)
 {
     m_FirebaseServiceProvider  = this;
+    d->m_restInterface.setParent(this);
+
+    connect(&d->m_restInterface, &FirebaseRestServer::tokenResultsReceived,
+            this, &QCloudMessagingFirebaseProvider::tokenResultsReceived);
 }
 
 /*!
@@ -174,6 +178,50 @@ bool QCloudMessagingFirebaseProvider::sendMessage(const QByteArray &msg, const Q
     return false;
 }
 
+/*!
+ * \brief QCloudMessagingFirebaseProvider::sendMessages
+ * Messages sent to device tokens via rest api are grouped by the payload
+ * and sent as multicast requests. Result of every token is reported with
+ * tokenResultsReceived. Other messages are sent one by one.
+ * \param messages
+ * \param clientId
+ * \return
+ */
+int QCloudMessagingFirebaseProvider::sendMessages(const QVector<QCloudMessagingBatchMessage> &messages,
+                                                  const QString &clientId)
+{
+    if (!clientId.isEmpty())
+        return QCloudMessagingProvider::sendMessages(messages, clientId);
+
+    int sent = 0;
+    QVector<QByteArray> payloads;
+    QVector<QStringList> tokens;
+    QHash<QByteArray, int> groups;
+
+    for (const QCloudMessagingBatchMessage &message : messages) {
+        if (message.clientToken.isEmpty() || !message.channel.isEmpty()) {
+            if (sendMessage(message.msg, clientId, message.clientToken, message.channel))
+                sent++;
+            continue;
+        }
+
+        auto group = groups.constFind(message.msg);
+        if (group == groups.constEnd()) {
+            group = groups.insert(message.msg, payloads.count());
+            payloads.append(message.msg);
+            tokens.append(QStringList());
+        }
+        tokens[group.value()].append(message.clientToken);
+    }
+
+    for (int i = 0; i < payloads.count(); i++) {
+        d->m_restInterface.sendMulticast(tokens.at(i), payloads.at(i));
+        sent += tokens.at(i).count();
+    }
+
+    return sent;
+}
+
 /*!
  * \brief QCloudMessagingFirebaseProvider::disconnectClient
  * \param clientId
@@ -190,7 +238,7 @@ void QCloudMessagingFirebaseProvider::disconnectClient(const QString &clientId,
  * \brief QCloudMessagingFirebaseProvider::clients
  * \return
  */
-QMap <QString, QCloudMessagingClient *>   *QCloudMessagingFirebaseProvider::clients()
+QHash<QString, QCloudMessagingClient *> *QCloudMessagingFirebaseProvider::clients()
 {
     return QCloudMessagingProvider::clients();
 }
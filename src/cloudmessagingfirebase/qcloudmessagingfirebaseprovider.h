@@ -32,6 +32,7 @@
 #include <QtCloudMessaging/QtCloudMessaging>
 #include <QtCloudMessaging/qcloudmessagingrestapi.h>
 #include <QtCloudMessagingFirebase/qcloudmessagingfirebaseclient.h>
+#include <QtCloudMessagingFirebase/qcloudmessagingfirebaserest.h>
 #include "firebase/app.h"
 #include "firebase/messaging.h"
 #include "firebase/util.h"
@@ -68,12 +69,14 @@ public:
                      const QString &clientToken = QString(),
                      const QString &channel = QString()) override;
 
+    int sendMessages(const QVector<QCloudMessagingBatchMessage> &messages,
+                     const QString &clientId = QString()) override;
 
     virtual bool subscribeToChannel(const QString &channel, const QString &clientId = QString()) override;
 
     virtual bool unsubscribeFromChannel(const QString &channel, const QString &clientId = QString()) override;
 
-    QMap <QString, QCloudMessagingClient *>  *clients() override;
+    QHash<QString, QCloudMessagingClient *> *clients() override;
 
     // Firefox server API tbd.
     bool remoteClients() override;
@@ -83,6 +86,9 @@ public:
     void setClientToken(const QString &clientId, const QString &uuid);
 
 
+Q_SIGNALS:
+    void tokenResultsReceived(const QVector<QCloudMessagingFirebaseTokenResult> &results);
+
 private Q_SLOTS:
     void cloudMessageReceived(const QString &clientId, const QByteArray &message);
 
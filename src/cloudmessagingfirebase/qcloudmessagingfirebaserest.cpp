@@ -29,12 +29,52 @@
 #include <QtCloudMessaging/QtCloudMessaging>
 #include "qtcloudmessagingglobal.h"
 #include "qcloudmessagingfirebaserest.h"
+#include "qcloudmessagingfirebasejson_p.h"
 
 #include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 /* REST API INTERFACE */
 const QString SERVER_ADDRESS = QStringLiteral("https://fcm.googleapis.com/fcm/send");
 
+/*!
+ * \brief FirebaseRestServer::FirebaseRestServer
+ */
+FirebaseRestServer::FirebaseRestServer()
+    : m_request(QUrl(SERVER_ADDRESS)),
+      m_next_batch(1)
+{
+    m_request.setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/json"));
+
+    connect(this, &QCloudMessagingRestApi::networkMessageExpired,
+            this, &FirebaseRestServer::multicastExpired);
+}
+
+/*!
+ * \brief FirebaseRestServer::setAuthKey
+ * Sets the server key of the request used for all the messages.
+ * \param key
+ */
+void FirebaseRestServer::setAuthKey(const QString &key)
+{
+    m_auth_key = key;
+
+    m_request.setRawHeader(QByteArrayLiteral("Authorization"), "key=" + m_auth_key.toLocal8Bit());
+}
+
+/*!
+ * \brief FirebaseRestServer::setServerAddress
+ * Sets the address of the FCM send endpoint, for example of a proxy or
+ * a test server. Default is https://fcm.googleapis.com/fcm/send.
+ * \param url
+ */
+void FirebaseRestServer::setServerAddress(const QUrl &url)
+{
+    m_request.setUrl(url);
+}
+
 /*!
  * \brief FirebaseRestServer::sendToDevice
  * \param token
@@ -43,23 +83,68 @@ const QString SERVER_ADDRESS = QStringLiteral("https://fcm.googleapis.com/fcm/se
  */
 bool FirebaseRestServer::sendToDevice(const QString &token, const QByteArray &data)
 {
-    QString data_to_send = "{\"to\":\"" + token + "\",\"data\":" + QString::fromUtf8(data) + "}";
-    QString url = SERVER_ADDRESS;
-    QUrl uri(url);
-    m_auth_key = "key=" + m_auth_key;
-    QNetworkRequest request(uri);
-    QString authHeader = QString::fromLatin1("Authorization");
-    request.setHeader(QNetworkRequest::ContentTypeHeader, QString::fromLatin1("application/json"));
-    request.setRawHeader(authHeader.toLocal8Bit(), m_auth_key.toLocal8Bit());
+    QByteArray data_to_send;
+    data_to_send.reserve(token.size() + data.size() + 20);
+    data_to_send.append("{\"to\":");
+    qCloudMessagingAppendJsonString(data_to_send, token);
+    data_to_send.append(",\"data\":");
+    data_to_send.append(data);
+    data_to_send.append('}');
 
     return sendMessage(POST_MSG,
-                       REQ_SEND_BROADCAST_DATA_TO_CHANNEL,
-                       request,
-                       data_to_send.toUtf8(),
+                       REQ_SEND_DATA_TO_DEVICE,
+                       m_request,
+                       data_to_send,
                        true,
                        QString());
 }
 
+/*!
+ * \brief FirebaseRestServer::sendMulticast
+ * Sends the same data to many devices. Tokens are packed to requests of
+ * at most MaxRegistrationIds tokens. Result of every token is reported
+ * with tokenResultsReceived.
+ * \param tokens
+ * \param data
+ * \return
+ * Returns the amount of requests queued.
+ */
+int FirebaseRestServer::sendMulticast(const QStringList &tokens, const QByteArray &data)
+{
+    int requests = 0;
+
+    for (int first = 0; first < tokens.count(); first += MaxRegistrationIds) {
+        const QStringList chunk = tokens.mid(first, MaxRegistrationIds);
+
+        QByteArray data_to_send;
+        // FCM tokens are about 150 characters
+        data_to_send.reserve(chunk.count() * 160 + data.size() + 40);
+        data_to_send.append("{\"registration_ids\":[");
+        for (int i = 0; i < chunk.count(); i++) {
+            if (i)
+                data_to_send.append(',');
+            qCloudMessagingAppendJsonString(data_to_send, chunk.at(i));
+        }
+        data_to_send.append("],\"data\":");
+        data_to_send.append(data);
+        data_to_send.append('}');
+
+        // Tokens of the request are needed to map the per token results
+        const QString batch = QString::number(m_next_batch++);
+        m_multicast_tokens.insert(batch, chunk);
+
+        sendMessage(POST_MSG,
+                    REQ_SEND_DATA_TO_DEVICES,
+                    m_request,
+                    data_to_send,
+                    true,
+                    batch);
+        requests++;
+    }
+
+    return requests;
+}
+
 /*!
  * \brief FirebaseRestServer::sendBroadcast
  * \param channel
@@ -68,26 +153,26 @@ bool FirebaseRestServer::sendToDevice(const QString &token, const QByteArray &da
  */
 bool FirebaseRestServer::sendBroadcast(const QString &channel, const QByteArray &data)
 {
-    QString mod_data = QString::fromUtf8(data);
-    if (mod_data[0] == '{')
+    QByteArray mod_data = data.trimmed();
+    if (mod_data.startsWith('{'))
         mod_data.remove(0, 1);
-    if (mod_data[mod_data.length() - 1] == '}')
-        mod_data.remove(mod_data.length() - 1, 1);
+    if (mod_data.endsWith('}'))
+        mod_data.chop(1);
 
-    QString data_to_send = "{\"to\":\"/topics/" + channel + "\"," + mod_data + "}";
-
-    QString url = SERVER_ADDRESS;
-    QUrl uri(url);
-    QString auth = "key=" + m_auth_key;
-    QNetworkRequest request(uri);
-    QString authHeader = QString::fromLatin1("Authorization");
-    request.setHeader(QNetworkRequest::ContentTypeHeader, QString::fromLatin1("application/json"));
-    request.setRawHeader(authHeader.toLocal8Bit(), auth.toLocal8Bit());
+    QByteArray data_to_send;
+    data_to_send.reserve(channel.size() + mod_data.size() + 20);
+    data_to_send.append("{\"to\":");
+    qCloudMessagingAppendJsonString(data_to_send, QStringLiteral("/topics/") + channel);
+    if (!mod_data.isEmpty()) {
+        data_to_send.append(',');
+        data_to_send.append(mod_data);
+    }
+    data_to_send.append('}');
 
     return sendMessage(POST_MSG,
                        REQ_SEND_BROADCAST_DATA_TO_CHANNEL,
-                       request,
-                       data_to_send.toUtf8(),
+                       m_request,
+                       data_to_send,
                        true,
                        QString());
 
@@ -96,12 +181,16 @@ bool FirebaseRestServer::sendBroadcast(const QString &channel, const QByteArray
 /*!
  * \brief FirebaseRestServer::xmlHttpRequestReply
  * \param reply
+ * \param context
  */
-void FirebaseRestServer::xmlHttpRequestReply(QNetworkReply *reply)
+void FirebaseRestServer::xmlHttpRequestReply(QNetworkReply *reply,
+                                             const QCloudMessagingRequestContext &context)
 {
-    getNetworkManager()->disconnect(SIGNAL(finished(QNetworkReply *)));
-    QString m_msg_uuid = reply->property("uuid").toString();
-    int req_id = reply->property("req_id").toInt();
+    if (context.req_id == REQ_SEND_DATA_TO_DEVICES) {
+        reportMulticastResults(context.info, reply);
+        clearMessage(context.msg_id);
+        return;
+    }
 
     if (reply->error()) {
         emit xmlHttpRequestError(reply->errorString());
@@ -114,6 +203,74 @@ void FirebaseRestServer::xmlHttpRequestReply(QNetworkReply *reply)
 
     emit xmlHttpRequestReplyData(data);
 
-    reply->deleteLater();
-    clearMessage(m_msg_uuid);
+    clearMessage(context.msg_id);
+}
+
+/*!
+ * \brief FirebaseRestServer::reportMulticastResults
+ * Parses the results array of the multicast response. Results are in the
+ * same order as the registration_ids of the request.
+ * \param batch
+ * \param reply
+ */
+void FirebaseRestServer::reportMulticastResults(const QString &batch, QNetworkReply *reply)
+{
+    const QStringList tokens = m_multicast_tokens.take(batch);
+    if (tokens.isEmpty())
+        return;
+
+    QJsonArray results;
+    QString error;
+    if (reply->error()) {
+        error = reply->errorString();
+        emit xmlHttpRequestError(error);
+    } else {
+        const QByteArray data = reply->readAll();
+        results = QJsonDocument::fromJson(data).object().value(QStringLiteral("results")).toArray();
+        if (results.isEmpty())
+            error = QStringLiteral("No results in response");
+        emit xmlHttpRequestReplyData(data);
+    }
+
+    QVector<QCloudMessagingFirebaseTokenResult> tokenResults(tokens.count());
+    for (int i = 0; i < tokens.count(); i++) {
+        QCloudMessagingFirebaseTokenResult &result = tokenResults[i];
+        result.token = tokens.at(i);
+
+        const QJsonObject object = results.at(i).toObject();
+        result.messageId = object.value(QStringLiteral("message_id")).toString();
+        result.canonicalToken = object.value(QStringLiteral("registration_id")).toString();
+        result.error = object.value(QStringLiteral("error")).toString(error);
+        result.status = result.messageId.isEmpty() ? QCloudMessagingFirebaseTokenResult::Failure
+                                                   : QCloudMessagingFirebaseTokenResult::Success;
+    }
+
+    emit tokenResultsReceived(tokenResults);
+}
+
+/*!
+ * \brief FirebaseRestServer::multicastExpired
+ * Reports the tokens of the dropped multicast request as failed.
+ * \param msg_id
+ * \param req_id
+ * \param info
+ */
+void FirebaseRestServer::multicastExpired(quint64 msg_id, int req_id, const QString &info)
+{
+    Q_UNUSED(msg_id);
+
+    if (req_id != REQ_SEND_DATA_TO_DEVICES)
+        return;
+
+    const QStringList tokens = m_multicast_tokens.take(info);
+
+    QVector<QCloudMessagingFirebaseTokenResult> tokenResults(tokens.count());
+    for (int i = 0; i < tokens.count(); i++) {
+        tokenResults[i].token = tokens.at(i);
+        tokenResults[i].status = QCloudMessagingFirebaseTokenResult::Failure;
+        tokenResults[i].error = QStringLiteral("Expired");
+    }
+
+    if (!tokenResults.isEmpty())
+        emit tokenResultsReceived(tokenResults);
 }
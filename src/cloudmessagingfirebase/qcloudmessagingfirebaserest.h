@@ -31,42 +31,82 @@
 #include <QtCloudMessaging/QtCloudMessaging>
 #include <QtCloudMessaging/qtcloudmessagingglobal.h>
 #include <QtCloudMessaging/qcloudmessagingrestapi.h>
-#include <QtCloudMessagingFirebase/qcloudmessagingfirebaseclient.h>
+#include <QHash>
+#include <QNetworkRequest>
+#include <QVector>
 
 QT_BEGIN_NAMESPACE
 
+class QCloudMessagingFirebaseTokenResult
+{
+public:
+    enum Status {
+        Success,
+        Failure
+    };
+
+    QCloudMessagingFirebaseTokenResult()
+        : status(Failure)
+    {
+    }
+
+    QString token;
+    Status status;
+    QString messageId;
+    QString canonicalToken;
+    QString error;
+};
+
 class FirebaseRestServer : public QCloudMessagingRestApi
 {
     Q_OBJECT
 public:
+    // Maximum amount of registration_ids in one FCM request
+    static const int MaxRegistrationIds = 1000;
+
     enum FirebaseRESTRequests {
         REQ_NO_REQ,
         REQ_GET_DEVICES_BY_CUSTOMER_ID,
         REQ_GET_ALL_DEVICES,
         REQ_SEND_DATA_TO_DEVICE,
         REQ_SEND_BROADCAST_DATA_TO_CHANNEL,
-        REQ_GET_DEVICE_INFO
+        REQ_GET_DEVICE_INFO,
+        REQ_SEND_DATA_TO_DEVICES
     };
     Q_ENUM(FirebaseRESTRequests)
 
-    void setAuthKey(const QString &key)
-    {
-        m_auth_key = key;
-    }
+    FirebaseRestServer();
+
+    void setAuthKey(const QString &key);
+
+    void setServerAddress(const QUrl &url);
 
     // Response function
-    void  xmlHttpRequestReply(QNetworkReply *reply);
+    void xmlHttpRequestReply(QNetworkReply *reply,
+                             const QCloudMessagingRequestContext &context) override;
 
     bool sendToDevice(const QString &token, const QByteArray &data);
     bool sendBroadcast(const QString &channel, const QByteArray &data);
+    int sendMulticast(const QStringList &tokens, const QByteArray &data);
 
 Q_SIGNALS:
     void xmlHttpRequestReplyData(const QByteArray &data);
+    void tokenResultsReceived(const QVector<QCloudMessagingFirebaseTokenResult> &results);
+
+private Q_SLOTS:
+    void multicastExpired(quint64 msg_id, int req_id, const QString &info);
 
 private:
+    void reportMulticastResults(const QString &batch, QNetworkReply *reply);
+
     QString m_auth_key;
+    QNetworkRequest m_request;
+    quint64 m_next_batch;
+    QHash<QString, QStringList> m_multicast_tokens;
 };
 
 QT_END_NAMESPACE
 
+Q_DECLARE_METATYPE(QCloudMessagingFirebaseTokenResult)
+
 #endif // QCLOUDMESSAGINGFIREBASEREST_H
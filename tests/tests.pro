@@ -1,4 +1,8 @@
-QT       += testlib cloudmessaging
+QT       += testlib network websockets cloudmessaging cloudmessaging-private
+# Provider modules are built only with their SDKs
+qtHaveModule(cloudmessagingfirebase): QT += cloudmessagingfirebase
+qtHaveModule(cloudmessagingembeddedkaltiot): \
+    QT += cloudmessagingembeddedkaltiot cloudmessagingembeddedkaltiot-private
 QT       -= gui
 
 TARGET = tst_qcloudmessaging
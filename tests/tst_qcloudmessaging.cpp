@@ -28,6 +28,252 @@
 
 #include <QString>
 #include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QNetworkProxy>
+#include <QNetworkReply>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QWebSocket>
+#include <QWebSocketServer>
+#include <QtCloudMessaging/qcloudmessaging.h>
+#include <QtCloudMessaging/qcloudmessagingrestapi.h>
+#include <QtCloudMessaging/qcloudmessagingtokenstore.h>
+#include <QtCloudMessaging/qcloudmessagingdatastream.h>
+#include <QtCloudMessaging/qcloudmessagingloopbackprovider.h>
+#include <QtCloudMessaging/private/qcloudmessagingoutboundqueue_p.h>
+#include <QtCloudMessaging/private/qcloudmessagingrestjournal_p.h>
+#include <QtCloudMessaging/private/qcloudmessagingratelimiter_p.h>
+#include <QtCloudMessaging/private/qcloudmessagingringbuffer_p.h>
+#include <QtCloudMessaging/private/qcloudmessaginginboundhistory_p.h>
+#ifdef QT_CLOUDMESSAGINGFIREBASE_LIB
+#include <QtCloudMessagingFirebase/qcloudmessagingfirebaserest.h>
+#endif
+#ifdef QT_CLOUDMESSAGINGEMBEDDEDKALTIOT_LIB
+#include <QtCloudMessagingEmbeddedKaltiot/private/qcloudmessagingembeddedkaltiotregistry_p.h>
+#endif
+
+#include <functional>
+
+class TestProvider : public QCloudMessagingProvider
+{
+public:
+    QString connectClient(const QString &clientId, const QVariantMap &) override
+    {
+        return clientId;
+    }
+
+    bool sendMessage(const QByteArray &msg, const QString &, const QString &clientToken,
+                     const QString &channel) override
+    {
+        sent.append(msg + '>' + (clientToken.isEmpty() ? channel : clientToken).toUtf8());
+        return !msg.isEmpty();
+    }
+
+    bool remoteClients() override { return false; }
+    bool subscribeToChannel(const QString &channel, const QString &) override
+    {
+        if (channels.contains(channel))
+            return false;
+        channels.append(channel);
+        return true;
+    }
+
+    bool unsubscribeFromChannel(const QString &, const QString &) override { return true; }
+
+    QList<QByteArray> sent;
+    QStringList channels;
+};
+
+class TestClient : public QCloudMessagingClient
+{
+public:
+    void cloudMessageReceived(const QString &client, const QByteArray &message) override
+    {
+        deliverMessage(client, message);
+    }
+
+    QString clientToken() override { return QString(); }
+    void setClientToken(const QString &) override {}
+    bool sendMessage(const QByteArray &, const QString &, const QString &) override { return true; }
+    bool subscribeToChannel(const QString &) override { return true; }
+    bool unsubscribeFromChannel(const QString &) override { return true; }
+};
+
+// Client delivering serializers instead of payloads, counting their calls.
+class TestLazyClient : public TestClient
+{
+public:
+    TestLazyClient() : serialized(0) {}
+
+    void deliverLazy(const QByteArray &payload)
+    {
+        deliverMessage(clientId(), payload.size(), [this, payload]() {
+            serialized++;
+            return payload;
+        });
+    }
+
+    int serialized;
+};
+
+class TestRelayProvider : public TestProvider
+{
+public:
+    QString connectClient(const QString &clientId, const QVariantMap &parameters) override
+    {
+        return connectClientToProvider(clientId, parameters, new TestLazyClient);
+    }
+};
+
+// Minimal HTTP/1.1 responder for the REST tests. Requests are answered in
+// arrival order with the queued status lines, or with 200 OK when the queue
+// is empty. Response body is made by the handler from the request body.
+// While hold is set, requests are answered only by release().
+class TestHttpServer : public QTcpServer
+{
+public:
+    TestHttpServer() : hold(false), requests(0)
+    {
+        listen(QHostAddress::LocalHost);
+        connect(this, &QTcpServer::newConnection, this, [this] {
+            while (QTcpSocket *socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket] { read(socket); });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+    }
+
+    QUrl url(const QString &path = QStringLiteral("/")) const
+    {
+        return QUrl(QStringLiteral("http://127.0.0.1:%1%2").arg(serverPort()).arg(path));
+    }
+
+    void release()
+    {
+        const QList<QPair<QPointer<QTcpSocket>, QByteArray> > pending = held;
+        held.clear();
+        for (const auto &request : pending) {
+            if (request.first)
+                respond(request.first, request.second);
+        }
+    }
+
+    bool hold;
+    int requests;
+    QList<QByteArray> responses;
+    QList<QByteArray> bodies;
+    std::function<QByteArray (const QByteArray &)> handler;
+
+private:
+    void read(QTcpSocket *socket)
+    {
+        QByteArray &buffer = m_buffers[socket];
+        buffer += socket->readAll();
+
+        for (;;) {
+            const int end = buffer.indexOf("\r\n\r\n");
+            if (end < 0)
+                return;
+
+            int length = 0;
+            const QList<QByteArray> lines = buffer.left(end).split('\n');
+            for (const QByteArray &line : lines) {
+                if (line.toLower().startsWith("content-length:"))
+                    length = line.mid(15).trimmed().toInt();
+            }
+            if (buffer.size() < end + 4 + length)
+                return;
+
+            const QByteArray body = buffer.mid(end + 4, length);
+            buffer.remove(0, end + 4 + length);
+            requests++;
+            bodies.append(body);
+            if (hold)
+                held.append(qMakePair(QPointer<QTcpSocket>(socket), body));
+            else
+                respond(socket, body);
+        }
+    }
+
+    void respond(QTcpSocket *socket, const QByteArray &request)
+    {
+        const QByteArray status = responses.isEmpty() ? QByteArrayLiteral("200 OK")
+                                                      : responses.takeFirst();
+        const QByteArray body = handler ? handler(request) : QByteArray();
+        socket->write("HTTP/1.1 " + status + "\r\nContent-Length: " +
+                      QByteArray::number(body.size()) + "\r\n\r\n" + body);
+    }
+
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    QList<QPair<QPointer<QTcpSocket>, QByteArray> > held;
+};
+
+static void setUpRestApi(QCloudMessagingRestApi *api)
+{
+    api->getNetworkManager()->setProxy(QNetworkProxy::NoProxy);
+    // Tests do not depend on the bearer state of the machine
+    QMetaObject::invokeMethod(api, "onlineStateChanged", Q_ARG(bool, true));
+}
+
+static bool postRestMessage(QCloudMessagingRestApi *api, const QUrl &url, int req_id,
+                            const QString &info)
+{
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/json"));
+    return api->sendMessage(QCloudMessagingRestApi::POST_MSG, req_id, request,
+                            QByteArrayLiteral("{}"), true, info);
+}
+
+class TestRestApi : public QCloudMessagingRestApi
+{
+public:
+    TestRestApi()
+    {
+        setUpRestApi(this);
+    }
+
+    bool post(const QUrl &url, int req_id = 1, const QString &info = QString())
+    {
+        return postRestMessage(this, url, req_id, info);
+    }
+
+    QList<QCloudMessagingRequestContext> contexts;
+    QList<int> statuses;
+
+protected:
+    void xmlHttpRequestReply(QNetworkReply *reply,
+                             const QCloudMessagingRequestContext &context) override
+    {
+        contexts.append(context);
+        statuses.append(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+        clearMessage(context.msg_id);
+    }
+};
+
+// Reimplements only the deprecated overload
+class TestLegacyRestApi : public QCloudMessagingRestApi
+{
+public:
+    TestLegacyRestApi()
+    {
+        setUpRestApi(this);
+    }
+
+    bool post(const QUrl &url, int req_id, const QString &info)
+    {
+        return postRestMessage(this, url, req_id, info);
+    }
+
+    void xmlHttpRequestReply(QNetworkReply *reply) override
+    {
+        infos.append(reply->property("info").toString());
+        clearMessage(reply->property("uuid").toString());
+    }
+
+    QStringList infos;
+};
 
 class QCloudmessaging : public QObject
 {
@@ -40,6 +286,40 @@ private Q_SLOTS:
     void initTestCase();
     void cleanupTestCase();
     void testCase1();
+    void outboundQueue();
+    void outboundQueueSchedule();
+    void outboundQueueBenchmark_data();
+    void outboundQueueBenchmark();
+    void restJournal();
+    void restJournalCompaction();
+    void rateLimiter();
+    void restInFlightWindow();
+    void restReplyContext();
+    void restRetryPolicy();
+    void restDestroyParked();
+    void restCircuitBreaker();
+    void restClearMessageBuffer();
+    void rateLimiterEndpoints();
+#ifdef QT_CLOUDMESSAGINGFIREBASE_LIB
+    void firebaseMulticast();
+    void firebaseMulticastExpired();
+#endif
+#ifdef QT_CLOUDMESSAGINGEMBEDDEDKALTIOT_LIB
+    void kaltiotDeviceRegistry();
+#endif
+    void sendMessages();
+    void subscribeToChannels();
+    void ringBuffer();
+    void ringBufferProducers();
+    void tokenStore();
+    void dataStream();
+    void inboundHistory();
+    void inboundHistoryLazy();
+    void clientHandles();
+    void threadedProvider();
+    void loopbackProvider();
+    void loopbackBenchmark_data();
+    void loopbackBenchmark();
 };
 
 QCloudmessaging::QCloudmessaging()
@@ -58,6 +338,1345 @@ void QCloudmessaging::testCase1()
 {
 }
 
-QTEST_APPLESS_MAIN(QCloudmessaging)
+void QCloudmessaging::outboundQueue()
+{
+    QCloudMessagingOutboundQueue queue;
+    QCloudMessagingNetworkMessage msg;
+    msg.type = QCloudMessagingRestApi::POST_MSG;
+    msg.req_id = 1;
+    msg.retry_count = 0;
+
+    QCloudMessagingOutboundEntry *first = queue.enqueue(msg);
+    QCloudMessagingOutboundEntry *second = queue.enqueue(msg);
+    QCloudMessagingOutboundEntry *third = queue.enqueue(msg);
+
+    QCOMPARE(queue.count(), 3);
+    QCOMPARE(first->msg.uuid, QString::number(first->id));
+    QCOMPARE(queue.nextPending(), first);
+
+    queue.markInFlight(first);
+    QCOMPARE(queue.nextPending(), second);
+    QCOMPARE(queue.pendingCount(), 2);
+    QCOMPARE(queue.inFlightCount(), 1);
+
+    // Retried message goes to the end of the queue
+    queue.markPending(first);
+    queue.markInFlight(second);
+    QCOMPARE(queue.nextPending(), third);
+
+    QVERIFY(queue.remove(third->id));
+    QCOMPARE(queue.nextPending(), first);
+    QVERIFY(!queue.find(third->id));
+
+    const quint64 secondId = second->id;
+    QVERIFY(queue.remove(secondId));
+    QVERIFY(!queue.remove(secondId));
+    QCOMPARE(queue.inFlightCount(), 0);
+
+    queue.clear();
+    QCOMPARE(queue.count(), 0);
+    QVERIFY(!queue.nextPending());
+}
+
+void QCloudmessaging::outboundQueueSchedule()
+{
+    QCloudMessagingOutboundQueue queue;
+    QCloudMessagingNetworkMessage msg;
+    msg.type = QCloudMessagingRestApi::GET_MSG;
+    msg.req_id = 1;
+    msg.retry_count = 0;
+
+    QCloudMessagingOutboundEntry *first = queue.enqueue(msg);
+    QCloudMessagingOutboundEntry *second = queue.enqueue(msg);
+    queue.advance(1000);
+
+    queue.markInFlight(first);
+    queue.markInFlight(second);
+    queue.schedule(first, 1500);
+    // Longer than one round of the wheel
+    queue.schedule(second, 1000 + 120000);
+    QCOMPARE(queue.scheduledCount(), 2);
+    QVERIFY(!queue.nextPending());
+
+    QCOMPARE(queue.advance(1400), 0);
+    QCOMPARE(queue.advance(1600), 1);
+    QCOMPARE(queue.nextPending(), first);
+
+    QCOMPARE(queue.advance(60000), 0);
+    QCOMPARE(queue.advance(121100), 1);
+    QCOMPARE(queue.scheduledCount(), 0);
+
+    // Scheduled message can be removed
+    queue.schedule(first, 200000);
+    QVERIFY(queue.remove(first->id));
+    QCOMPARE(queue.scheduledCount(), 0);
+    QCOMPARE(queue.count(), 1);
+}
+
+void QCloudmessaging::outboundQueueBenchmark_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+    QTest::newRow("100000") << 100000;
+}
+
+void QCloudmessaging::outboundQueueBenchmark()
+{
+    QFETCH(int, count);
+
+    QCloudMessagingNetworkMessage msg;
+    msg.type = QCloudMessagingRestApi::POST_MSG;
+    msg.req_id = 1;
+    msg.retry_count = 0;
+    msg.request = QNetworkRequest(QUrl(QStringLiteral("https://localhost/")));
+
+    QVector<quint64> ids(count);
+
+    // Cost per message stays constant when the queue grows.
+    QBENCHMARK {
+        QCloudMessagingOutboundQueue queue;
+        for (int i = 0; i < count; i++)
+            ids[i] = queue.enqueue(msg)->id;
+
+        // Send half of the messages and acknowledge everything in reverse
+        // order, which was the worst case for the list scan.
+        for (int i = 0; i < count / 2; i++)
+            queue.markInFlight(queue.nextPending());
+
+        for (int i = count - 1; i >= 0; i--)
+            queue.remove(ids.at(i));
+    }
+}
+
+void QCloudmessaging::restJournal()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QCloudMessagingNetworkMessage msg;
+    msg.type = QCloudMessagingRestApi::PUT_MSG;
+    msg.req_id = 7;
+    msg.retry_count = 0;
+    msg.info = QStringLiteral("info");
+    msg.request = QNetworkRequest(QUrl(QStringLiteral("https://localhost/rid")));
+    msg.request.setRawHeader("Authorization", "key");
+    msg.data = QByteArray(512, 'x');
+
+    {
+        QCloudMessagingRestJournal journal;
+        // Small segments to force the rotation
+        QVERIFY(journal.open(dir.path(), 1024));
+        for (quint64 id = 1; id <= 10; id++)
+            QVERIFY(journal.append(id, msg));
+        QVERIFY(journal.segmentCount() > 1);
+
+        QVERIFY(journal.updateRetryCount(9, 2));
+        for (quint64 id = 1; id <= 8; id++)
+            QVERIFY(journal.remove(id));
+    }
+
+    QCloudMessagingRestJournal journal;
+    QVERIFY(journal.open(dir.path(), 1024));
+
+    const QVector<QCloudMessagingJournalRecord> records = journal.takeReplayedRecords();
+    QCOMPARE(records.count(), 2);
+    QCOMPARE(records.at(0).id, quint64(9));
+    QCOMPARE(records.at(0).retry_count, 2);
+    QCOMPARE(records.at(0).req_id, 7);
+    QCOMPARE(records.at(1).id, quint64(10));
+
+    QCloudMessagingNetworkMessage loaded;
+    QVERIFY(journal.load(10, &loaded));
+    QCOMPARE(loaded.type, int(QCloudMessagingRestApi::PUT_MSG));
+    QCOMPARE(loaded.info, msg.info);
+    QCOMPARE(loaded.request.url(), msg.request.url());
+    QCOMPARE(loaded.request.rawHeader("Authorization"), QByteArray("key"));
+    QCOMPARE(loaded.data, msg.data);
+
+    // Acknowledged segments are compacted away
+    QVERIFY(journal.remove(9));
+    QVERIFY(journal.remove(10));
+    QCOMPARE(journal.segmentCount(), 1);
+
+    // Relocation was interrupted before the original segment was deleted,
+    // the copy in the next segment replaces the original record
+    const auto interruptedRelocation = [&msg](const QString &path, bool acknowledged) {
+        QCloudMessagingNetworkMessage copy = msg;
+        {
+            QCloudMessagingRestJournal journal;
+            QVERIFY(journal.open(path, 1 << 20));
+            QVERIFY(journal.append(1, msg));
+        }
+        QCloudMessagingRestJournal journal;
+        QVERIFY(journal.open(path, 1 << 20));
+        QCOMPARE(journal.segmentCount(), 2);
+        copy.retry_count = 3;
+        QVERIFY(journal.append(1, copy));
+        if (acknowledged)
+            QVERIFY(journal.remove(1));
+        QCOMPARE(journal.segmentCount(), 2);
+    };
+
+    QTemporaryDir acknowledgedDir;
+    QVERIFY(acknowledgedDir.isValid());
+    interruptedRelocation(acknowledgedDir.path(), true);
+    if (QTest::currentTestFailed())
+        return;
+    QVERIFY(journal.open(acknowledgedDir.path(), 1 << 20));
+    QVERIFY(journal.takeReplayedRecords().isEmpty());
+
+    QTemporaryDir pendingDir;
+    QVERIFY(pendingDir.isValid());
+    interruptedRelocation(pendingDir.path(), false);
+    if (QTest::currentTestFailed())
+        return;
+    QVERIFY(journal.open(pendingDir.path(), 1 << 20));
+    const QVector<QCloudMessagingJournalRecord> relocated = journal.takeReplayedRecords();
+    QCOMPARE(relocated.count(), 1);
+    QCOMPARE(relocated.at(0).id, quint64(1));
+    QCOMPARE(relocated.at(0).retry_count, 3);
+}
+
+void QCloudmessaging::restJournalCompaction()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QCloudMessagingNetworkMessage msg;
+    msg.type = QCloudMessagingRestApi::POST_MSG;
+    msg.req_id = 3;
+    msg.retry_count = 0;
+    msg.request = QNetworkRequest(QUrl(QStringLiteral("https://localhost/send")));
+    msg.data = QByteArray(512, 'y');
+
+    {
+        QCloudMessagingRestJournal journal;
+        QVERIFY(journal.open(dir.path(), 4096));
+        for (quint64 id = 1; id <= 64; id++)
+            QVERIFY(journal.append(id, msg));
+        const int segments = journal.segmentCount();
+        QVERIFY(segments > 4);
+
+        // Oldest message is still waiting while the later ones are sent
+        QVERIFY(journal.updateRetryCount(1, 2));
+        for (quint64 id = 2; id <= 64; id++)
+            QVERIFY(journal.remove(id));
+        QVERIFY(journal.segmentCount() <= 2);
+        QCOMPARE(QDir(dir.path()).entryList(QDir::Files).count(), journal.segmentCount());
+    }
+
+    QCloudMessagingRestJournal journal;
+    QVERIFY(journal.open(dir.path(), 4096));
+
+    const QVector<QCloudMessagingJournalRecord> records = journal.takeReplayedRecords();
+    QCOMPARE(records.count(), 1);
+    QCOMPARE(records.at(0).id, quint64(1));
+    QCOMPARE(records.at(0).retry_count, 2);
+    QCOMPARE(records.at(0).req_id, 3);
+
+    QCloudMessagingNetworkMessage loaded;
+    QVERIFY(journal.load(1, &loaded));
+    QCOMPARE(loaded.request.url(), msg.request.url());
+    QCOMPARE(loaded.data, msg.data);
+
+    QVERIFY(journal.remove(1));
+    QCOMPARE(journal.segmentCount(), 1);
+}
+
+void QCloudmessaging::rateLimiter()
+{
+    QCloudMessagingRateLimiter limiter;
+    limiter.setLimit(QStringLiteral("restapi.torqhub.io"), -1, 10, 2);
+
+    QCloudMessagingEndpoint *endpoint = limiter.endpoint(QStringLiteral("restapi.torqhub.io"), 1);
+    QVERIFY(limiter.tryAcquire(endpoint, 1000));
+    QVERIFY(limiter.tryAcquire(endpoint, 1000));
+    QVERIFY(!limiter.tryAcquire(endpoint, 1000));
+    // 10 requests per second
+    QVERIFY(limiter.tryAcquire(endpoint, 1100));
+
+    // Other hosts are not limited
+    QCloudMessagingEndpoint *other = limiter.endpoint(QStringLiteral("fcm.googleapis.com"), 1);
+    QVERIFY(other != endpoint);
+    QCOMPARE(limiter.available(other, 1100), INT_MAX);
+
+    limiter.block(other, 5000);
+    QVERIFY(!limiter.tryAcquire(other, 4999));
+    QVERIFY(limiter.tryAcquire(other, 5000));
+
+    const QDateTime now(QDate(2015, 10, 21), QTime(7, 28, 0), Qt::UTC);
+    QCOMPARE(QCloudMessagingRateLimiter::parseRetryAfter("120", now), qint64(120000));
+    QCOMPARE(QCloudMessagingRateLimiter::parseRetryAfter("Wed, 21 Oct 2015 07:28:30 GMT", now),
+             qint64(30000));
+    QCOMPARE(QCloudMessagingRateLimiter::parseRetryAfter("soon", now), qint64(-1));
+
+    // Parked messages return to the front of the queue in their order
+    QCloudMessagingOutboundQueue queue;
+    QCloudMessagingNetworkMessage msg;
+    msg.type = QCloudMessagingRestApi::POST_MSG;
+    msg.req_id = 1;
+    msg.retry_count = 0;
+    QCloudMessagingOutboundEntry *first = queue.enqueue(msg);
+    QCloudMessagingOutboundEntry *second = queue.enqueue(msg);
+    QCloudMessagingOutboundEntry *third = queue.enqueue(msg);
+
+    queue.markInFlight(first);
+    queue.park(second, &endpoint->parked);
+    queue.park(first, &endpoint->parked);
+    QCOMPARE(endpoint->parked.first(), first);
+    QCOMPARE(queue.parkedCount(), 2);
+
+    QCOMPARE(queue.unpark(&endpoint->parked, 1), 1);
+    QCOMPARE(queue.nextPending(), first);
+    QCOMPARE(first->next, third);
+
+    queue.clear();
+    QCOMPARE(endpoint->parked.count(), 0);
+}
+
+void QCloudmessaging::restInFlightWindow()
+{
+    TestHttpServer server;
+    server.hold = true;
+
+    TestRestApi api;
+    api.setMaxInFlightRequests(2);
+
+    for (int i = 0; i < 5; i++)
+        api.post(server.url());
+
+    QCOMPARE(api.getInFlightRequestCount(), 2);
+    QCOMPARE(api.getPendingRequestCount(), 3);
+    QTRY_COMPARE(server.requests, 2);
+
+    // Window stays full while the server holds the replies
+    QTest::qWait(200);
+    QCOMPARE(server.requests, 2);
+    QCOMPARE(api.getInFlightRequestCount(), 2);
+
+    // Every finished reply sends the next queued message
+    server.hold = false;
+    server.release();
+    QTRY_COMPARE(api.contexts.count(), 5);
+    QCOMPARE(server.requests, 5);
+    QCOMPARE(api.getNetworkRequestCount(), 0);
+    QCOMPARE(api.getInFlightRequestCount(), 0);
+}
+
+void QCloudmessaging::restReplyContext()
+{
+    TestHttpServer server;
+    TestRestApi api;
+    api.setMaxInFlightRequests(3);
+
+    QStringList infos;
+    for (int i = 0; i < 6; i++) {
+        infos.append(QString::number(i));
+        api.post(server.url(), 100 + i, infos.last());
+    }
+
+    QTRY_COMPARE(api.contexts.count(), 6);
+    QTest::qWait(100);
+    QCOMPARE(api.contexts.count(), 6);
+    QCOMPARE(server.requests, 6);
+
+    // Each reply reaches the handler once, with the context of its request
+    QSet<quint64> ids;
+    for (const QCloudMessagingRequestContext &context : qAsConst(api.contexts)) {
+        QVERIFY(!ids.contains(context.msg_id));
+        ids.insert(context.msg_id);
+        QCOMPARE(context.type, int(QCloudMessagingRestApi::POST_MSG));
+        QCOMPARE(context.uuid, QString::number(context.msg_id));
+        QCOMPARE(context.req_id, 100 + context.info.toInt());
+        QVERIFY(infos.removeOne(context.info));
+    }
+    QVERIFY(infos.isEmpty());
+    QCOMPARE(api.statuses, QList<int>() << 200 << 200 << 200 << 200 << 200 << 200);
+
+    // Subclass of the deprecated overload gets the context as properties
+    TestLegacyRestApi legacy;
+    legacy.post(server.url(), 1, QStringLiteral("first"));
+    legacy.post(server.url(), 2, QStringLiteral("second"));
+    QTRY_COMPARE(legacy.infos.count(), 2);
+    QVERIFY(legacy.infos.contains(QStringLiteral("first")));
+    QVERIFY(legacy.infos.contains(QStringLiteral("second")));
+    QCOMPARE(legacy.getNetworkRequestCount(), 0);
+}
+
+void QCloudmessaging::restRetryPolicy()
+{
+    TestHttpServer server;
+
+    {
+        // Message is sent once by default
+        TestRestApi api;
+        QCOMPARE(api.retryPolicy().maxAttempts, 1);
+        server.responses << "500 Internal Server Error";
+        api.post(server.url());
+        QTRY_COMPARE(api.contexts.count(), 1);
+        QCOMPARE(api.statuses.at(0), 500);
+        QTest::qWait(100);
+        QCOMPARE(server.requests, 1);
+
+        // Retry count is clamped as in setRetryPolicy
+        api.setServerTimers(800, 10, 0);
+        QCOMPARE(api.retryPolicy().maxAttempts, 1);
+    }
+
+    {
+        // Backoff doubles from the initial delay
+        TestRestApi api;
+        api.setServerTimers(20, 100, 3);
+        QCloudMessagingRetryPolicy policy = api.retryPolicy();
+        QCOMPARE(policy.maxAttempts, 3);
+        policy.initialBackoff = 200;
+        policy.jitter = 0.0;
+        api.setRetryPolicy(policy);
+
+        server.requests = 0;
+        server.responses << "503 Service Unavailable" << "500 Internal Server Error";
+
+        QElapsedTimer timer;
+        timer.start();
+        api.post(server.url());
+        QTRY_COMPARE(api.getScheduledRequestCount(), 1);
+        QTRY_COMPARE(api.contexts.count(), 1);
+        QVERIFY(timer.elapsed() >= 200 + 400 - 50);
+        QCOMPARE(server.requests, 3);
+        QCOMPARE(api.statuses.at(0), 200);
+        QCOMPARE(api.getNetworkRequestCount(), 0);
+    }
+
+    {
+        // Message which waits over its deadline is expired
+        TestRestApi api;
+        api.setServerTimers(20, 100, 1);
+        api.setMaxInFlightRequests(1);
+        QCloudMessagingRetryPolicy policy = api.retryPolicy();
+        policy.deadline = 200;
+        api.setRetryPolicy(policy);
+
+        QSignalSpy expired(&api, &QCloudMessagingRestApi::networkMessageExpired);
+
+        server.requests = 0;
+        server.hold = true;
+        api.post(server.url(), 1);
+        api.post(server.url(), 2, QStringLiteral("late"));
+        QTRY_COMPARE(server.requests, 1);
+
+        QTest::qWait(300);
+        server.hold = false;
+        server.release();
+
+        QTRY_COMPARE(expired.count(), 1);
+        QCOMPARE(expired.at(0).at(1).toInt(), 2);
+        QCOMPARE(expired.at(0).at(2).toString(), QStringLiteral("late"));
+        QCOMPARE(api.contexts.count(), 1);
+        QCOMPARE(api.contexts.at(0).req_id, 1);
+        QCOMPARE(expired.at(0).at(0).toULongLong(), api.contexts.at(0).msg_id + 1);
+        QCOMPARE(server.requests, 1);
+        QCOMPARE(api.getNetworkRequestCount(), 0);
+    }
+}
+
+void QCloudmessaging::restDestroyParked()
+{
+    TestHttpServer server;
+    server.hold = true;
+
+    TestRestApi *api = new TestRestApi;
+    api->setRateLimit(QStringLiteral("127.0.0.1"), 0.01, 1);
+    api->post(server.url());
+    api->post(server.url());
+    api->post(server.url());
+
+    QCOMPARE(api->getInFlightRequestCount(), 1);
+    QTRY_COMPARE(api->getThrottledRequestCount(), 2);
+
+    // Queue is cleared before the endpoints owning the parked lists
+    delete api;
+
+    server.release();
+}
+
+void QCloudmessaging::restCircuitBreaker()
+{
+    qRegisterMetaType<QCloudMessagingRestApi::CircuitState>();
+
+    const QString host = QStringLiteral("127.0.0.1");
+
+    QCloudMessagingCircuitBreakerPolicy policy;
+    policy.minimumRequests = 2;
+    policy.failureThreshold = 0.5;
+    policy.openDuration = 300;
+
+    TestHttpServer server;
+
+    {
+        // Responses with Retry-After throttle the endpoint but do not
+        // open the circuit
+        TestRestApi api;
+        api.setServerTimers(20, 100, 1);
+        api.setCircuitBreakerPolicy(policy);
+        QSignalSpy states(&api, &QCloudMessagingRestApi::circuitStateChanged);
+
+        server.responses << "503 Service Unavailable\r\nRetry-After: 0"
+                         << "503 Service Unavailable\r\nRetry-After: 0";
+        api.post(server.url());
+        QTRY_COMPARE(api.contexts.count(), 1);
+        QCOMPARE(api.statuses.at(0), 200);
+        QCOMPARE(server.requests, 3);
+        QCOMPARE(states.count(), 0);
+        QCOMPARE(api.circuitState(host), QCloudMessagingRestApi::CircuitClosed);
+
+        // Unused host is closed
+        QCOMPARE(api.circuitState(QStringLiteral("unused.example")),
+                 QCloudMessagingRestApi::CircuitClosed);
+    }
+
+    {
+        TestRestApi api;
+        api.setServerTimers(20, 100, 1);
+        api.setCircuitBreakerPolicy(policy);
+        QSignalSpy states(&api, &QCloudMessagingRestApi::circuitStateChanged);
+
+        // Closed -> open
+        server.requests = 0;
+        server.responses << "500 Internal Server Error" << "500 Internal Server Error";
+        api.post(server.url());
+        api.post(server.url());
+        QTRY_COMPARE(api.contexts.count(), 2);
+        QCOMPARE(api.circuitState(host), QCloudMessagingRestApi::CircuitOpen);
+        QCOMPARE(states.count(), 1);
+
+        // Message to the open circuit waits
+        api.post(server.url());
+        QCOMPARE(api.getThrottledRequestCount(), 1);
+        QTest::qWait(100);
+        QCOMPARE(server.requests, 2);
+
+        // Open -> half-open, and the successful probe closes the circuit
+        QTRY_COMPARE(api.contexts.count(), 3);
+        QCOMPARE(api.statuses.at(2), 200);
+        QCOMPARE(states.count(), 3);
+        QCOMPARE(states.at(0).at(0).toString(), host);
+        QCOMPARE(states.at(0).at(1).value<QCloudMessagingRestApi::CircuitState>(),
+                 QCloudMessagingRestApi::CircuitOpen);
+        QCOMPARE(states.at(1).at(1).value<QCloudMessagingRestApi::CircuitState>(),
+                 QCloudMessagingRestApi::CircuitHalfOpen);
+        QCOMPARE(states.at(2).at(1).value<QCloudMessagingRestApi::CircuitState>(),
+                 QCloudMessagingRestApi::CircuitClosed);
+        QCOMPARE(api.circuitState(host), QCloudMessagingRestApi::CircuitClosed);
+    }
+}
+
+void QCloudmessaging::restClearMessageBuffer()
+{
+    TestHttpServer server;
+    server.hold = true;
+
+    TestRestApi api;
+    api.setMaxInFlightRequests(1);
+    QSignalSpy expired(&api, &QCloudMessagingRestApi::networkMessageExpired);
+
+    api.post(server.url(), 1, QStringLiteral("sent"));
+    api.post(server.url(), 2, QStringLiteral("second"));
+    api.post(server.url(), 3, QStringLiteral("third"));
+    QTRY_COMPARE(server.requests, 1);
+
+    // Dropped messages are reported in queue order
+    api.clearMessageBuffer();
+    QCOMPARE(api.getNetworkRequestCount(), 0);
+    QCOMPARE(expired.count(), 2);
+    QCOMPARE(expired.at(0).at(1).toInt(), 2);
+    QCOMPARE(expired.at(0).at(2).toString(), QStringLiteral("second"));
+    QCOMPARE(expired.at(1).at(1).toInt(), 3);
+    QCOMPARE(expired.at(1).at(2).toString(), QStringLiteral("third"));
+
+    // Reply of the sent message is still delivered
+    server.hold = false;
+    server.release();
+    QTRY_COMPARE(api.contexts.count(), 1);
+    QCOMPARE(api.contexts.at(0).info, QStringLiteral("sent"));
+    QCOMPARE(expired.count(), 2);
+}
+
+void QCloudmessaging::rateLimiterEndpoints()
+{
+    QCloudMessagingRateLimiter limiter;
+    QVERIFY(!limiter.findEndpoint(QStringLiteral("example.com")));
+    QVERIFY(limiter.endpoints().isEmpty());
+
+    QCloudMessagingEndpoint *endpoint = limiter.endpoint(QStringLiteral("example.com"), 1);
+    QCOMPARE(limiter.findEndpoint(QStringLiteral("example.com")), endpoint);
+    QCOMPARE(endpoint->circuit, endpoint);
+}
+
+#ifdef QT_CLOUDMESSAGINGFIREBASE_LIB
+// FCM response with a result for every registration id of the request
+static QByteArray firebaseResults(const QByteArray &request)
+{
+    const QJsonArray tokens = QJsonDocument::fromJson(request).object()
+            .value(QStringLiteral("registration_ids")).toArray();
+
+    QJsonArray results;
+    for (const QJsonValue &value : tokens) {
+        const QString token = value.toString();
+        QJsonObject result;
+        if (token.startsWith(QLatin1String("invalid"))) {
+            result.insert(QStringLiteral("error"), QStringLiteral("NotRegistered"));
+        } else {
+            result.insert(QStringLiteral("message_id"), QStringLiteral("m-") + token);
+            if (token.startsWith(QLatin1String("old")))
+                result.insert(QStringLiteral("registration_id"), QStringLiteral("new-") + token);
+        }
+        results.append(result);
+    }
+
+    QJsonObject response;
+    response.insert(QStringLiteral("results"), results);
+    return QJsonDocument(response).toJson(QJsonDocument::Compact);
+}
+
+void QCloudmessaging::firebaseMulticast()
+{
+    QCOMPARE(QCloudMessagingFirebaseTokenResult().status,
+             QCloudMessagingFirebaseTokenResult::Failure);
+
+    TestHttpServer server;
+    server.handler = firebaseResults;
+
+    FirebaseRestServer rest;
+    setUpRestApi(&rest);
+    rest.setServerAddress(server.url(QStringLiteral("/fcm/send")));
+
+    QHash<QString, QCloudMessagingFirebaseTokenResult> results;
+    connect(&rest, &FirebaseRestServer::tokenResultsReceived,
+            [&results](const QVector<QCloudMessagingFirebaseTokenResult> &tokenResults) {
+        for (const QCloudMessagingFirebaseTokenResult &result : tokenResults)
+            results.insert(result.token, result);
+    });
+
+    QStringList tokens;
+    for (int i = 0; i < 2 * FirebaseRestServer::MaxRegistrationIds + 1; i++)
+        tokens.append(QStringLiteral("token-%1").arg(i));
+    tokens[5] = QStringLiteral("old-5");
+    tokens[1500] = QStringLiteral("invalid-1500");
+    tokens[2000] = QStringLiteral("quote\"2000");
+
+    // Tokens are packed to requests of at most 1000 tokens
+    QCOMPARE(rest.sendMulticast(tokens, QByteArrayLiteral("{\"a\":1}")), 3);
+    QTRY_COMPARE(results.count(), tokens.count());
+
+    QList<int> sizes;
+    for (const QByteArray &body : qAsConst(server.bodies)) {
+        const QJsonObject object = QJsonDocument::fromJson(body).object();
+        QCOMPARE(object.value(QStringLiteral("data")).toObject().value(QStringLiteral("a")).toInt(), 1);
+        sizes.append(object.value(QStringLiteral("registration_ids")).toArray().count());
+    }
+    std::sort(sizes.begin(), sizes.end());
+    QCOMPARE(sizes, QList<int>() << 1 << 1000 << 1000);
+
+    // Results are mapped to the tokens in request order
+    for (const QString &token : qAsConst(tokens)) {
+        const QCloudMessagingFirebaseTokenResult result = results.value(token);
+        QCOMPARE(result.token, token);
+        if (token == QLatin1String("invalid-1500")) {
+            QCOMPARE(result.status, QCloudMessagingFirebaseTokenResult::Failure);
+            QCOMPARE(result.error, QStringLiteral("NotRegistered"));
+            QVERIFY(result.messageId.isEmpty());
+        } else {
+            QCOMPARE(result.status, QCloudMessagingFirebaseTokenResult::Success);
+            QCOMPARE(result.messageId, QStringLiteral("m-") + token);
+            QVERIFY(result.error.isEmpty());
+        }
+    }
+
+    // Canonical registration id replaces the old token
+    QCOMPARE(results.value(QStringLiteral("old-5")).canonicalToken, QStringLiteral("new-old-5"));
+    QVERIFY(results.value(QStringLiteral("token-6")).canonicalToken.isEmpty());
+}
+
+void QCloudmessaging::firebaseMulticastExpired()
+{
+    TestHttpServer server;
+    server.handler = firebaseResults;
+    server.hold = true;
+
+    FirebaseRestServer rest;
+    setUpRestApi(&rest);
+    rest.setServerAddress(server.url(QStringLiteral("/fcm/send")));
+    rest.setServerTimers(20, 100, 1);
+    rest.setMaxInFlightRequests(1);
+    QCloudMessagingRetryPolicy policy = rest.retryPolicy();
+    policy.deadline = 200;
+    rest.setRetryPolicy(policy);
+
+    QHash<QString, QCloudMessagingFirebaseTokenResult> results;
+    connect(&rest, &FirebaseRestServer::tokenResultsReceived,
+            [&results](const QVector<QCloudMessagingFirebaseTokenResult> &tokenResults) {
+        for (const QCloudMessagingFirebaseTokenResult &result : tokenResults)
+            results.insert(result.token, result);
+    });
+
+    QStringList tokens;
+    for (int i = 0; i < FirebaseRestServer::MaxRegistrationIds + 500; i++)
+        tokens.append(QStringLiteral("token-%1").arg(i));
+
+    QCOMPARE(rest.sendMulticast(tokens, QByteArrayLiteral("{}")), 2);
+    QTRY_COMPARE(server.requests, 1);
+
+    // Second request waits over its deadline behind the held one
+    QTest::qWait(300);
+    server.hold = false;
+    server.release();
+
+    QTRY_COMPARE(results.count(), tokens.count());
+    QCOMPARE(server.requests, 1);
+    for (int i = 0; i < tokens.count(); i++) {
+        const QCloudMessagingFirebaseTokenResult result = results.value(tokens.at(i));
+        if (i < FirebaseRestServer::MaxRegistrationIds) {
+            QCOMPARE(result.status, QCloudMessagingFirebaseTokenResult::Success);
+        } else {
+            QCOMPARE(result.status, QCloudMessagingFirebaseTokenResult::Failure);
+            QCOMPARE(result.error, QStringLiteral("Expired"));
+        }
+    }
+}
+#endif
+
+#ifdef QT_CLOUDMESSAGINGEMBEDDEDKALTIOT_LIB
+static QCloudMessagingEmbeddedKaltiotIdentity kaltiotIdentity(const QString &rid, qint64 timestamp,
+                                                              const QString &customerId = QString())
+{
+    QCloudMessagingEmbeddedKaltiotIdentity identity;
+    identity.rid = rid;
+    identity.timestamp = timestamp;
+    identity.customerId = customerId;
+    return identity;
+}
+
+void QCloudmessaging::kaltiotDeviceRegistry()
+{
+    QCloudMessagingEmbeddedKaltiotDeviceRegistry registry;
+    QCOMPARE(registry.watermark(), qint64(0));
+
+    // Full sync adds the listed devices, known devices are updated in place
+    registry.beginFullSync();
+    QVERIFY(registry.isFullSyncRunning());
+    QVector<QCloudMessagingEmbeddedKaltiotIdentity> added = registry.merge(
+                QVector<QCloudMessagingEmbeddedKaltiotIdentity>()
+                << kaltiotIdentity(QStringLiteral("a"), 100)
+                << kaltiotIdentity(QStringLiteral("b"), 300)
+                << kaltiotIdentity(QString(), 900));
+    QCOMPARE(added.count(), 2);
+    added = registry.merge(QVector<QCloudMessagingEmbeddedKaltiotIdentity>()
+                           << kaltiotIdentity(QStringLiteral("a"), 100, QStringLiteral("customer")));
+    QVERIFY(added.isEmpty());
+    QCOMPARE(registry.device(QStringLiteral("a")).customerId, QStringLiteral("customer"));
+    QVERIFY(registry.endFullSync(true).isEmpty());
+    QVERIFY(!registry.isFullSyncRunning());
+    QCOMPARE(registry.count(), 2);
+
+    // Watermark follows the server timestamps, not the local clock
+    QCOMPARE(registry.newestTimestamp(), qint64(300));
+    registry.advanceWatermark(10000);
+    QCOMPARE(registry.watermark(), qint64(300));
+
+    // Incomplete listing does not remove anything
+    registry.beginFullSync();
+    registry.merge(QVector<QCloudMessagingEmbeddedKaltiotIdentity>()
+                   << kaltiotIdentity(QStringLiteral("a"), 100));
+    QVERIFY(registry.endFullSync(false).isEmpty());
+    QVERIFY(registry.contains(QStringLiteral("b")));
+
+    // Complete listing removes the devices which were not listed
+    registry.beginFullSync();
+    registry.merge(QVector<QCloudMessagingEmbeddedKaltiotIdentity>()
+                   << kaltiotIdentity(QStringLiteral("a"), 100));
+    QCOMPARE(registry.endFullSync(true), QStringList() << QStringLiteral("b"));
+    QVERIFY(!registry.contains(QStringLiteral("b")));
+    QCOMPARE(registry.count(), 1);
+
+    // Devices found again in the overlap of incremental syncs are not added
+    // twice and the watermark never moves backwards
+    added = registry.merge(QVector<QCloudMessagingEmbeddedKaltiotIdentity>()
+                           << kaltiotIdentity(QStringLiteral("a"), 100)
+                           << kaltiotIdentity(QStringLiteral("c"), 250));
+    QCOMPARE(added.count(), 1);
+    QCOMPARE(added.at(0).rid, QStringLiteral("c"));
+    registry.advanceWatermark(5);
+    QCOMPARE(registry.watermark(), qint64(300));
+
+    registry.merge(QVector<QCloudMessagingEmbeddedKaltiotIdentity>()
+                   << kaltiotIdentity(QStringLiteral("d"), 500));
+    registry.advanceWatermark(5);
+    QCOMPARE(registry.watermark(), qint64(500));
+
+    // Local time is used when the server sends no timestamps
+    registry.clear();
+    QCOMPARE(registry.count(), 0);
+    QCOMPARE(registry.watermark(), qint64(0));
+    registry.merge(QVector<QCloudMessagingEmbeddedKaltiotIdentity>()
+                   << kaltiotIdentity(QStringLiteral("e"), 0));
+    registry.advanceWatermark(42);
+    QCOMPARE(registry.watermark(), qint64(42));
+}
+#endif
+
+void QCloudmessaging::sendMessages()
+{
+    QCloudMessaging messaging;
+    TestProvider *provider = new TestProvider;
+    provider->setParent(&messaging);
+    QVERIFY(messaging.registerProvider(QStringLiteral("test"), provider));
+
+    QVector<QCloudMessagingBatchMessage> messages;
+    messages.append({QByteArray("a"), QStringLiteral("token1"), QString()});
+    messages.append({QByteArray(), QStringLiteral("token2"), QString()});
+    messages.append({QByteArray("c"), QString(), QStringLiteral("news")});
+
+    // Default implementation sends the messages one by one
+    QCOMPARE(messaging.sendMessages(messages, QStringLiteral("test")), 2);
+    QCOMPARE(provider->sent.count(), 3);
+    QCOMPARE(provider->sent.at(0), QByteArray("a>token1"));
+    QCOMPARE(provider->sent.at(2), QByteArray("c>news"));
+
+    QCOMPARE(messaging.sendMessages(messages, QStringLiteral("unknown")), 0);
+}
+
+void QCloudmessaging::subscribeToChannels()
+{
+    QCloudMessaging messaging;
+    TestProvider *provider = new TestProvider;
+    provider->setParent(&messaging);
+    QVERIFY(messaging.registerProvider(QStringLiteral("test"), provider));
+
+    // Default implementation subscribes channels one by one
+    const QStringList channels = {QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("a")};
+    QCOMPARE(messaging.subscribeToChannels(channels, QStringLiteral("test")), 2);
+    QCOMPARE(provider->channels, QStringList({QStringLiteral("a"), QStringLiteral("b")}));
+
+    QCOMPARE(messaging.subscribeToChannels(channels, QStringLiteral("unknown")), 0);
+}
+
+void QCloudmessaging::ringBuffer()
+{
+    QCloudMessagingRingBuffer<QByteArray> ring(3);
+    QCOMPARE(ring.capacity(), 4);
+
+    for (int i = 0; i < 5; i++) {
+        const bool pushed = ring.push([i](QByteArray &slot) {
+            slot = QByteArray::number(i);
+        });
+        QCOMPARE(pushed, i < 4);
+    }
+    QCOMPARE(ring.count(), 4);
+    QCOMPARE(ring.droppedCount(), quint32(1));
+
+    // Drained in order, in batches
+    QList<QByteArray> drained;
+    auto consume = [&drained](QByteArray &slot) { drained.append(slot); };
+    QCOMPARE(ring.drain(consume, 3), 3);
+    QCOMPARE(ring.drain(consume), 1);
+    QCOMPARE(ring.drain(consume), 0);
+    QCOMPARE(drained, QList<QByteArray>({"0", "1", "2", "3"}));
+    QVERIFY(ring.isEmpty());
+
+    // Slots are reused after wrapping around
+    QVERIFY(ring.push([](QByteArray &slot) { slot = "4"; }));
+    QCOMPARE(ring.drain(consume), 1);
+    QCOMPARE(drained.last(), QByteArray("4"));
+}
+
+void QCloudmessaging::ringBufferProducers()
+{
+    enum { Producers = 4, Messages = 10000 };
+    QCloudMessagingRingBuffer<int> ring(64, QCloudMessagingRingBuffer<int>::Block);
+
+    QList<QThread *> producers;
+    for (int p = 0; p < Producers; p++) {
+        producers.append(QThread::create([&ring, p] {
+            for (int i = 0; i < Messages; i++)
+                ring.push([p, i](int &slot) { slot = p * Messages + i; });
+        }));
+        producers.last()->start();
+    }
+
+    // Every message arrives once and each producer's messages stay in order
+    QVector<int> next(Producers, 0);
+    int received = 0;
+    while (received < Producers * Messages) {
+        received += ring.drain([&next](int &slot) {
+            const int producer = slot / Messages;
+            QCOMPARE(slot % Messages, next[producer]);
+            next[producer]++;
+        });
+    }
+
+    for (QThread *producer : qAsConst(producers)) {
+        producer->wait();
+        delete producer;
+    }
+    QCOMPARE(ring.droppedCount(), quint32(0));
+    QVERIFY(ring.isEmpty());
+}
+
+void QCloudmessaging::tokenStore()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("tokens.ini"));
+
+    {
+        QCloudMessagingTokenStore store(fileName);
+        QVERIFY(store.setToken(QStringLiteral("device/rid"), QStringLiteral("abc")));
+        QVERIFY(!store.setToken(QStringLiteral("device/rid"), QStringLiteral("abc")));
+        QVERIFY(store.isDirty());
+
+        // Nothing is written before flush
+        QVERIFY(!QFile::exists(fileName));
+        store.flush();
+        QVERIFY(!store.isDirty());
+
+        // Changing back to the stored value leaves nothing to write
+        QVERIFY(store.setToken(QStringLiteral("device/rid"), QStringLiteral("xyz")));
+        QVERIFY(store.setToken(QStringLiteral("device/rid"), QStringLiteral("abc")));
+        QVERIFY(!store.isDirty());
+
+        // Pending change is written on destruction
+        QVERIFY(store.setToken(QStringLiteral("other/token"), QStringLiteral("t1")));
+    }
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    QCOMPARE(settings.value(QStringLiteral("clients/device/rid")).toString(), QStringLiteral("abc"));
+
+    QCloudMessagingTokenStore store(fileName);
+    QCOMPARE(store.token(QStringLiteral("device/rid")), QStringLiteral("abc"));
+    QCOMPARE(store.token(QStringLiteral("other/token")), QStringLiteral("t1"));
+
+    store.removeToken(QStringLiteral("other/token"));
+    QVERIFY(store.token(QStringLiteral("other/token")).isEmpty());
+    store.flush();
+    settings.sync();
+    QVERIFY(!settings.contains(QStringLiteral("clients/other/token")));
+}
+
+void QCloudmessaging::dataStream()
+{
+    // Stand-in for the session endpoint, hands out s1, s2, ...
+    QTcpServer sessionServer;
+    QVERIFY(sessionServer.listen(QHostAddress::LocalHost));
+    int sessionRequests = 0;
+    connect(&sessionServer, &QTcpServer::newConnection, this, [&] {
+        QTcpSocket *socket = sessionServer.nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, socket, [socket, &sessionRequests] {
+            const QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+            socket->setProperty("request", request);
+            if (!request.contains("\r\n\r\n"))
+                return;
+
+            const QByteArray body = "{\"sessionId\":\"s" + QByteArray::number(++sessionRequests) + "\"}";
+            socket->write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+                          + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+            socket->disconnectFromHost();
+        });
+    });
+
+    // Stand-in for the stream, drops the first connection after sending
+    QWebSocketServer streamServer(QStringLiteral("stream"), QWebSocketServer::NonSecureMode);
+    QVERIFY(streamServer.listen(QHostAddress::LocalHost));
+    QStringList paths;
+    connect(&streamServer, &QWebSocketServer::newConnection, this, [&] {
+        QWebSocket *socket = streamServer.nextPendingConnection();
+        connect(socket, &QWebSocket::disconnected, socket, &QObject::deleteLater);
+        paths.append(socket->requestUrl().path());
+        if (paths.count() == 1) {
+            socket->sendBinaryMessage("a\nb");
+            socket->sendTextMessage(QStringLiteral("c"));
+            socket->close();
+        } else {
+            socket->sendBinaryMessage("d");
+        }
+    });
+
+    QCloudMessagingDataStream stream;
+    stream.setSessionRequest(QNetworkRequest(QUrl(QStringLiteral("http://127.0.0.1:%1/cn/42/data_stream")
+                                                  .arg(sessionServer.serverPort()))));
+    stream.setStreamUrl(QUrl(QStringLiteral("ws://127.0.0.1:%1/cn/42/data_stream")
+                             .arg(streamServer.serverPort())));
+
+    QCloudMessagingRetryPolicy policy;
+    policy.maxAttempts = 0;
+    policy.initialBackoff = 10;
+    policy.jitter = 0;
+    stream.setReconnectPolicy(policy);
+
+    QSignalSpy sessions(&stream, &QCloudMessagingDataStream::sessionCreated);
+    QSignalSpy messages(&stream, &QCloudMessagingDataStream::messageReceived);
+    stream.open();
+
+    // Records of one message are delivered separately, in order
+    QTRY_COMPARE(messages.count(), 4);
+    QCOMPARE(messages.at(0).at(0).toByteArray(), QByteArray("a"));
+    QCOMPARE(messages.at(1).at(0).toByteArray(), QByteArray("b"));
+    QCOMPARE(messages.at(2).at(0).toByteArray(), QByteArray("c"));
+    QCOMPARE(messages.at(3).at(0).toByteArray(), QByteArray("d"));
+    QCOMPARE(stream.receivedMessageCount(), qint64(4));
+
+    // Reconnect resumes the session instead of creating a new one
+    QCOMPARE(sessionRequests, 1);
+    QCOMPARE(sessions.count(), 1);
+    QCOMPARE(stream.sessionId(), QStringLiteral("s1"));
+    QCOMPARE(paths, QStringList({QStringLiteral("/cn/42/data_stream/sessionId/s1"),
+                                 QStringLiteral("/cn/42/data_stream/sessionId/s1")}));
+    QTRY_COMPARE(stream.state(), QCloudMessagingDataStream::StreamOpen);
+
+    stream.close();
+    QCOMPARE(stream.state(), QCloudMessagingDataStream::StreamClosed);
+}
+
+void QCloudmessaging::inboundHistory()
+{
+    QCloudMessagingInboundHistory history(3, 10);
+
+    // Oldest messages are evicted by count and by size
+    QCOMPARE(history.append("a", "1234"), quint64(1));
+    QCOMPARE(history.append("a", "5678"), quint64(2));
+    QCOMPARE(history.append("b", "9"), quint64(3));
+    QCOMPARE(history.count(), 3);
+    QCOMPARE(history.append("b", "abcdef"), quint64(4));
+    QCOMPARE(history.count(), 2);
+    QCOMPARE(history.bytes(), qint64(7));
+    QCOMPARE(history.evictedCount(), quint64(2));
+    QCOMPARE(history.evictedBytes(), qint64(8));
+
+    // Too large for the history at all
+    QCOMPARE(history.append("b", "0123456789a"), quint64(5));
+    QCOMPARE(history.count(), 2);
+    QCOMPARE(history.evictedCount(), quint64(3));
+
+    QVector<QCloudMessagingInboundHistory::Entry> entries = history.entries();
+    QCOMPARE(entries.count(), 2);
+    QCOMPARE(entries.at(0).sequence, quint64(3));
+    QCOMPARE(entries.at(1).payload, QByteArray("abcdef"));
+    QCOMPARE(history.entries(4).count(), 1);
+
+    // Payloads are shared with the caller
+    const QByteArray payload("shared");
+    history.setLimits(2, 100);
+    history.append("c", payload);
+    QVERIFY(history.entries(6).at(0).payload.constData() == payload.constData());
+    QCOMPARE(history.nextSequence(), quint64(7));
+
+    // Client flush replays messages received before connecting, once
+    TestClient client;
+    client.cloudMessageReceived("x", "early1");
+    client.cloudMessageReceived("x", "early2");
+
+    QSignalSpy received(&client, &QCloudMessagingClient::messageReceived);
+    QVERIFY(client.flushMessageQueue());
+    QCOMPARE(received.count(), 2);
+    QCOMPARE(received.at(0).at(1).toByteArray(), QByteArray("early1"));
+    QVERIFY(client.flushMessageQueue());
+    QCOMPARE(received.count(), 2);
+
+    // Messages received while connected are not flushed again
+    client.cloudMessageReceived("x", "late");
+    QCOMPARE(received.count(), 3);
+    QVERIFY(client.flushMessageQueue());
+    QCOMPARE(received.count(), 3);
+    QCOMPARE(client.replayMessages(0), 3);
+    QCOMPARE(received.count(), 6);
+
+    client.setInboundHistoryLimits(0, 0);
+    client.cloudMessageReceived("x", "dropped");
+    QCOMPARE(client.inboundHistoryCount(), 0);
+    QCOMPARE(client.evictedMessageCount(), quint64(4));
+}
+
+void QCloudmessaging::inboundHistoryLazy()
+{
+    int serialized = 0;
+    const QCloudMessagingInboundHistory::Serializer serialize = [&serialized] {
+        serialized++;
+        return QByteArray("lazy");
+    };
+
+    // Evicted messages are never serialized, kept ones once
+    QCloudMessagingInboundHistory history(2, 100);
+    history.append("a", 4, serialize);
+    history.append("a", 4, serialize);
+    history.append("a", 4, serialize);
+    QCOMPARE(history.bytes(), qint64(8));
+    QCOMPARE(serialized, 0);
+    QCOMPARE(history.entries().at(1).payload, QByteArray("lazy"));
+    QCOMPARE(serialized, 2);
+    history.entries();
+    QCOMPARE(serialized, 2);
+
+    // Relayed signal without receivers is not worth serializing for
+    TestRelayProvider provider;
+    QCloudMessaging messaging;
+    QVERIFY(messaging.registerProvider(QStringLiteral("relay"), &provider));
+    QCOMPARE(messaging.connectClient(QStringLiteral("relay"), QStringLiteral("c1")),
+             QStringLiteral("c1"));
+    TestLazyClient *client = static_cast<TestLazyClient *>(provider.client(QStringLiteral("c1")));
+
+    client->deliverLazy("first");
+    QCOMPARE(client->serialized, 0);
+    QCOMPARE(client->inboundHistoryCount(), 1);
+
+    QSignalSpy received(&messaging, &QCloudMessaging::messageReceived);
+    client->deliverLazy("second");
+    QCOMPARE(client->serialized, 1);
+    QCOMPARE(received.count(), 1);
+    QCOMPARE(received.at(0).at(2).toByteArray(), QByteArray("second"));
+
+    // History is serialized when it is read, flush skips the delivered one
+    messaging.flushMessageQueue(QStringLiteral("relay"));
+    QCOMPARE(received.count(), 2);
+    QCOMPARE(received.at(1).at(2).toByteArray(), QByteArray("first"));
+    QCOMPARE(client->serialized, 2);
+    messaging.flushMessageQueue(QStringLiteral("relay"));
+    QCOMPARE(received.count(), 2);
+    QCOMPARE(client->replayMessages(0), 2);
+    QCOMPARE(client->serialized, 3);
+    client->replayMessages(0);
+    QCOMPARE(client->serialized, 3);
+
+    // Receivers of the client or the provider count too
+    messaging.deregisterProvider(QStringLiteral("relay"));
+    TestRelayProvider direct;
+    direct.registerProvider(QStringLiteral("direct"));
+    direct.connectClient(QStringLiteral("c2"), QVariantMap());
+    client = static_cast<TestLazyClient *>(direct.client(QStringLiteral("c2")));
+    client->deliverLazy("unobserved");
+    QCOMPARE(client->serialized, 0);
+    QSignalSpy relayed(&direct, &QCloudMessagingProvider::messageReceived);
+    client->deliverLazy("relayed");
+    QCOMPARE(client->serialized, 1);
+    QCOMPARE(relayed.count(), 1);
+}
+
+void QCloudmessaging::clientHandles()
+{
+    QCloudMessaging messaging;
+    TestProvider *provider = new TestProvider;
+    QVERIFY(messaging.registerProvider(QStringLiteral("test"), provider));
+
+    QCloudMessagingClientHandle handle;
+    QCOMPARE(messaging.connectClient(QStringLiteral("test"), QStringLiteral("c1"),
+                                     QVariantMap(), &handle), QStringLiteral("c1"));
+    QVERIFY(handle.isValid());
+    QCOMPARE(handle.clientId, QStringLiteral("c1"));
+    QVERIFY(messaging.sendMessage(handle, "a", QStringLiteral("token1")));
+    QCOMPARE(provider->sent.last(), QByteArray("a>token1"));
+
+    // Unknown ids are not added to the registries
+    QVERIFY(!messaging.clientHandle(QStringLiteral("unknown"), QStringLiteral("c1")).isValid());
+    messaging.removeClient(QStringLiteral("test"), QStringLiteral("missing"));
+    messaging.setClientToken(QStringLiteral("test"), QStringLiteral("missing"), QStringLiteral("t"));
+    QCOMPARE(messaging.clientToken(QStringLiteral("test"), QStringLiteral("missing")), QString());
+    QVERIFY(!messaging.subscribeToChannel(QStringLiteral("news"), QStringLiteral("test"),
+                                          QStringLiteral("missing")));
+    QVERIFY(provider->clients()->isEmpty());
+    QVERIFY(messaging.localClients(QStringLiteral("unknown")).isEmpty());
+
+    // Handle does not outlive the provider
+    messaging.deregisterProvider(QStringLiteral("test"));
+    delete provider;
+    QVERIFY(!handle.isValid());
+    QVERIFY(!messaging.sendMessage(handle, "b"));
+}
+
+void QCloudmessaging::threadedProvider()
+{
+    enum { Producers = 4, Messages = 5000 };
+    QCloudMessaging messaging;
+    TestProvider *provider = new TestProvider;
+
+    QThread *stateThread = nullptr;
+    connect(&messaging, &QCloudMessaging::serviceStateUpdated, [&stateThread] {
+        stateThread = QThread::currentThread();
+    });
+
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("worker_thread"), true);
+    parameters.insert(QStringLiteral("submission_queue_size"), 64);
+    parameters.insert(QStringLiteral("submission_overflow"), QStringLiteral("block"));
+    QVERIFY(messaging.registerProvider(QStringLiteral("test"), provider, parameters));
+    QVERIFY(provider->thread() != QThread::currentThread());
+
+    // Signals from the provider thread arrive in the thread of QCloudMessaging
+    QTRY_COMPARE(stateThread, QThread::currentThread());
+
+    // Calls returning a value wait for the provider thread
+    QCOMPARE(messaging.connectClient(QStringLiteral("test"), QStringLiteral("c1")),
+             QStringLiteral("c1"));
+    QVERIFY(messaging.subscribeToChannel(QStringLiteral("news"), QStringLiteral("test")));
+    QVERIFY(!messaging.subscribeToChannel(QStringLiteral("news"), QStringLiteral("test")));
+    QCOMPARE(messaging.localClients(QStringLiteral("test")), QStringList(QStringLiteral("c1")));
+
+    // Waiting calls run after the messages submitted before them
+    for (int i = 0; i < 200; i++)
+        QVERIFY(messaging.sendMessage("m", QStringLiteral("test"), QString(), QStringLiteral("t")));
+    QVector<QCloudMessagingBatchMessage> batch(1);
+    batch[0].msg = "batch";
+    batch[0].clientToken = QStringLiteral("t");
+    QCOMPARE(messaging.sendMessages(batch, QStringLiteral("test")), 1);
+    QCOMPARE(provider->sent.count(), 201);
+    QCOMPARE(provider->sent.last(), QByteArray("batch>t"));
+    provider->sent.clear();
+
+    // Handles only carry ids to other threads
+    const QCloudMessagingClientHandle handle =
+            messaging.clientHandle(QStringLiteral("test"), QStringLiteral("c1"));
+    QThread *handleSender = QThread::create([&messaging, handle] {
+        messaging.sendMessage(handle, "h", QStringLiteral("t"));
+    });
+    handleSender->start();
+    handleSender->wait();
+    delete handleSender;
+    // Waiting call is also a barrier for the message
+    QCOMPARE(messaging.localClients(QStringLiteral("test")).count(), 1);
+    QCOMPARE(provider->sent, QList<QByteArray>() << "h>t");
+    provider->sent.clear();
+
+    QList<QThread *> producers;
+    for (int p = 0; p < Producers; p++) {
+        producers.append(QThread::create([&messaging, p] {
+            for (int i = 0; i < Messages; i++)
+                messaging.sendMessage(QByteArray::number(p * Messages + i),
+                                      QStringLiteral("test"), QString(), QStringLiteral("t"));
+        }));
+        producers.last()->start();
+    }
+    for (QThread *producer : qAsConst(producers)) {
+        producer->wait();
+        delete producer;
+    }
+
+    // Deregistering sends what is still queued and hands the provider back
+    messaging.deregisterProvider(QStringLiteral("test"));
+    QCOMPARE(provider->thread(), QThread::currentThread());
+    QCOMPARE(provider->sent.count(), Producers * Messages);
+
+    // Each producer's messages stay in order
+    QVector<int> next(Producers, 0);
+    for (const QByteArray &sent : qAsConst(provider->sent)) {
+        const int value = sent.left(sent.indexOf('>')).toInt();
+        QCOMPARE(value % Messages, next[value / Messages]);
+        next[value / Messages]++;
+    }
+    delete provider;
+}
+
+void QCloudmessaging::loopbackProvider()
+{
+    QCloudMessaging messaging;
+    QCloudMessagingLoopbackProvider *provider = new QCloudMessagingLoopbackProvider;
+    QVERIFY(messaging.registerProvider(QStringLiteral("local"), provider));
+    QCOMPARE(provider->getServiceState(),
+             QCloudMessagingProvider::QtCloudMessagingProviderRegistered);
+
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("channels"), QStringList(QStringLiteral("news")));
+    QCOMPARE(messaging.connectClient(QStringLiteral("local"), QStringLiteral("a"), parameters),
+             QStringLiteral("a"));
+    QCOMPARE(messaging.connectClient(QStringLiteral("local"), QStringLiteral("b")),
+             QStringLiteral("b"));
+    QCOMPARE(messaging.clientToken(QStringLiteral("local"), QStringLiteral("b")),
+             QStringLiteral("local/b"));
+    QVERIFY(messaging.subscribeToChannel(QStringLiteral("news"), QStringLiteral("local"),
+                                         QStringLiteral("b")));
+    QVERIFY(!messaging.subscribeToChannel(QStringLiteral("news"), QStringLiteral("local"),
+                                          QStringLiteral("b")));
+    QCOMPARE(provider->subscriberCount(QStringLiteral("news")), 2);
+
+    QSignalSpy received(&messaging, &QCloudMessaging::messageReceived);
+    const QByteArray payload(256, 'x');
+
+    // Token reaches its owner, and the receiver gets the sender's buffer
+    QVERIFY(messaging.sendMessage(payload, QStringLiteral("local"), QString(),
+                                  QStringLiteral("local/b")));
+    QCOMPARE(received.count(), 1);
+    QCOMPARE(received.at(0).at(1).toString(), QStringLiteral("b"));
+    QVERIFY(received.at(0).at(2).toByteArray().constData() == payload.constData());
+    QVERIFY(!messaging.sendMessage("x", QStringLiteral("local"), QString(),
+                                   QStringLiteral("unknown")));
+
+    // Channel fans out to every subscriber
+    QVERIFY(messaging.sendMessage("all", QStringLiteral("local"), QString(), QString(),
+                                  QStringLiteral("news")));
+    QCOMPARE(received.count(), 3);
+    QCOMPARE(provider->publish(QStringLiteral("news"), "again"), 2);
+    QCOMPARE(provider->publish(QStringLiteral("empty"), "none"), 0);
+
+    // Removed client loses its token and subscriptions
+    messaging.removeClient(QStringLiteral("local"), QStringLiteral("b"));
+    QCOMPARE(provider->subscriberCount(QStringLiteral("news")), 1);
+    QVERIFY(!provider->clientForToken(QStringLiteral("local/b")));
+    QVERIFY(!messaging.sendMessage("x", QStringLiteral("local"), QString(),
+                                   QStringLiteral("local/b")));
+
+    // Receiver removing a later subscriber during a broadcast
+    messaging.connectClient(QStringLiteral("local"), QStringLiteral("c"), parameters);
+    messaging.connectClient(QStringLiteral("local"), QStringLiteral("d"), parameters);
+    QMetaObject::Connection connection = connect(&messaging, &QCloudMessaging::messageReceived,
+            [&messaging](const QString &, const QString &clientId, const QByteArray &) {
+        if (clientId == QLatin1String("c"))
+            messaging.removeClient(QStringLiteral("local"), QStringLiteral("d"));
+    });
+    QCOMPARE(provider->publish(QStringLiteral("news"), "partial"), 2);
+    disconnect(connection);
+    QCOMPARE(provider->channels(), QStringList(QStringLiteral("news")));
+
+    messaging.deregisterProvider(QStringLiteral("local"));
+    QVERIFY(provider->channels().isEmpty());
+    delete provider;
+}
+
+void QCloudmessaging::loopbackBenchmark_data()
+{
+    QTest::addColumn<int>("subscribers");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("10") << 10;
+    QTest::newRow("100") << 100;
+}
+
+void QCloudmessaging::loopbackBenchmark()
+{
+    QFETCH(int, subscribers);
+    enum { Messages = 1000 };
+
+    QCloudMessagingLoopbackProvider provider;
+    QCloudMessaging messaging;
+    QVERIFY(messaging.registerProvider(QStringLiteral("local"), &provider));
+
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("channels"), QStringList(QStringLiteral("bench")));
+    parameters.insert(QStringLiteral("inbound_history_size"), 0);
+    for (int i = 0; i < subscribers; i++)
+        messaging.connectClient(QStringLiteral("local"), QString::number(i), parameters);
+
+    int received = 0;
+    connect(&messaging, &QCloudMessaging::messageReceived, [&received] { received++; });
+
+    // Whole path from the facade to the signal of every subscriber
+    const QByteArray payload(1024, 'x');
+    QBENCHMARK {
+        for (int i = 0; i < Messages; i++)
+            messaging.sendMessage(payload, QStringLiteral("local"), QString(), QString(),
+                                  QStringLiteral("bench"));
+    }
+    QVERIFY(received >= Messages * subscribers);
+}
+
+QTEST_GUILESS_MAIN(QCloudmessaging)
 
 #include "tst_qcloudmessaging.moc"